@@ -0,0 +1,556 @@
+#include "alloctrack.h"
+
+#ifdef ALLOC_TRACKING
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <cxxabi.h>
+#include <execinfo.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CALLER_ADDRESS() _ReturnAddress()
+#else
+#define CALLER_ADDRESS() __builtin_return_address(0)
+#endif
+
+//Nothing in here may allocate, it runs inside operator new
+
+struct AllocSite
+{
+    const void *address;
+    const char *exempt;
+    Uint64 count;
+    Uint64 bytes;
+};
+
+//Open addressing on the caller address, sites past the table are only counted
+static const int SITE_SLOTS = 4096;
+static AllocSite sites[SITE_SLOTS];
+static Uint64 siteOverflow = 0;
+static SDL_SpinLock siteLock = 0;
+static SDL_atomic_t recording;
+
+//The frame so far, 64 bit so a single huge allocation cannot wrap the bytes
+static AllocCounts frame = {0,0,0,0};
+static SDL_SpinLock frameLock = 0;
+
+//Finished frames, added up by alloc_begin_frame()
+static AllocCounts totals = {0,0,0,0};
+static SDL_SpinLock totalsLock = 0;
+
+static thread_local const char *exemptReason = NULL;
+
+static SDL_malloc_func sdlMalloc = NULL;
+static SDL_calloc_func sdlCalloc = NULL;
+static SDL_realloc_func sdlRealloc = NULL;
+static SDL_free_func sdlFree = NULL;
+
+//Module SDL was loaded from, NULL when it is linked into the executable
+static const void *sdlModule = NULL;
+
+//Charged with SDL allocations whose caller outside SDL could not be found
+static const char sdlBucket = 0;
+static const int SDL_BACKTRACE_FRAMES = 16;
+
+static void record_site(size_t size, const void *caller)
+{
+    SDL_AtomicLock(&siteLock);
+    size_t slot = ((size_t)caller >> 4) % SITE_SLOTS;
+    for(int probe = 0; probe < SITE_SLOTS; ++probe)
+    {
+        AllocSite &site = sites[slot];
+        if(site.address == caller || site.address == NULL)
+        {
+            site.address = caller;
+            site.exempt = exemptReason;
+            site.count++;
+            site.bytes += size;
+            SDL_AtomicUnlock(&siteLock);
+            return;
+        }
+        slot = (slot + 1) % SITE_SLOTS;
+    }
+    siteOverflow++;
+    SDL_AtomicUnlock(&siteLock);
+}
+
+static void count_allocation(size_t size, const void *caller)
+{
+    SDL_AtomicLock(&frameLock);
+    if(exemptReason != NULL)
+    {
+        frame.exempt++;
+    }
+    else
+    {
+        frame.allocations++;
+        frame.bytes += size;
+    }
+    SDL_AtomicUnlock(&frameLock);
+
+    if(SDL_AtomicGet(&recording))
+        record_site(size,caller);
+}
+
+static void count_free(void *pointer)
+{
+    if(pointer == NULL)
+        return;
+    SDL_AtomicLock(&frameLock);
+    frame.frees++;
+    SDL_AtomicUnlock(&frameLock);
+}
+
+static void *allocate(size_t size, const void *caller)
+{
+    count_allocation(size,caller);
+    return malloc(size > 0 ? size : 1);
+}
+
+static void *allocate_aligned(size_t size, size_t alignment, const void *caller)
+{
+    count_allocation(size,caller);
+    if(size == 0)
+        size = 1;
+#ifdef _WIN32
+    return _aligned_malloc(size,alignment);
+#else
+    void *pointer = NULL;
+    if(posix_memalign(&pointer,alignment < sizeof(void*) ? sizeof(void*) : alignment,size) != 0)
+        return NULL;
+    return pointer;
+#endif
+}
+
+static void free_aligned(void *pointer)
+{
+    count_free(pointer);
+#ifdef _WIN32
+    _aligned_free(pointer);
+#else
+    free(pointer);
+#endif
+}
+
+//------------------ Global operator new/delete  -------------------------
+
+void *operator new(std::size_t size)
+{
+    void *pointer = allocate(size,CALLER_ADDRESS());
+    if(pointer == NULL)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void *operator new[](std::size_t size)
+{
+    void *pointer = allocate(size,CALLER_ADDRESS());
+    if(pointer == NULL)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void *operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size,CALLER_ADDRESS());
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size,CALLER_ADDRESS());
+}
+
+void operator delete(void *pointer) noexcept
+{
+    count_free(pointer);
+    free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    count_free(pointer);
+    free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t size) noexcept
+{
+    count_free(pointer);
+    free(pointer);
+}
+
+void operator delete[](void *pointer, std::size_t size) noexcept
+{
+    count_free(pointer);
+    free(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t&) noexcept
+{
+    count_free(pointer);
+    free(pointer);
+}
+
+void operator delete[](void *pointer, const std::nothrow_t&) noexcept
+{
+    count_free(pointer);
+    free(pointer);
+}
+
+#ifdef __cpp_aligned_new
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    void *pointer = allocate_aligned(size,(size_t)alignment,CALLER_ADDRESS());
+    if(pointer == NULL)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+    void *pointer = allocate_aligned(size,(size_t)alignment,CALLER_ADDRESS());
+    if(pointer == NULL)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void operator delete(void *pointer, std::align_val_t alignment) noexcept
+{
+    free_aligned(pointer);
+}
+
+void operator delete[](void *pointer, std::align_val_t alignment) noexcept
+{
+    free_aligned(pointer);
+}
+
+void operator delete(void *pointer, std::size_t size, std::align_val_t alignment) noexcept
+{
+    free_aligned(pointer);
+}
+
+void operator delete[](void *pointer, std::size_t size, std::align_val_t alignment) noexcept
+{
+    free_aligned(pointer);
+}
+#endif
+
+//------------------ SDL allocator  -------------------------
+
+static const void *module_of(const void *address)
+{
+#ifdef _WIN32
+    HMODULE module = NULL;
+    if(!GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,(LPCSTR)address,&module))
+        return NULL;
+    return module;
+#else
+    Dl_info info;
+    if(dladdr(address,&info) == 0)
+        return NULL;
+    return info.dli_fbase;
+#endif
+}
+
+//The hooks are called from inside SDL_malloc, so their return address is
+//always in SDL. While recording, the stack is walked to the first frame
+//outside SDL's module instead; with SDL linked in statically there is no
+//telling the two apart and everything goes to the SDL bucket.
+static const void *sdl_caller()
+{
+    if(!SDL_AtomicGet(&recording))
+        return &sdlBucket;
+    if(sdlModule == NULL)
+        return &sdlBucket;
+
+    void *frames[SDL_BACKTRACE_FRAMES];
+#ifdef _WIN32
+    int count = CaptureStackBackTrace(0,SDL_BACKTRACE_FRAMES,frames,NULL);
+#else
+    int count = backtrace(frames,SDL_BACKTRACE_FRAMES);
+#endif
+    //Skips this function and the hook, then SDL itself
+    bool inSdl = false;
+    for(int i = 1; i < count; ++i)
+    {
+        if(module_of(frames[i]) == sdlModule)
+            inSdl = true;
+        else if(inSdl)
+            return frames[i];
+    }
+    return &sdlBucket;
+}
+
+static void *SDLCALL counted_malloc(size_t size)
+{
+    count_allocation(size,sdl_caller());
+    return sdlMalloc(size);
+}
+
+static void *SDLCALL counted_calloc(size_t count, size_t size)
+{
+    count_allocation(count*size,sdl_caller());
+    return sdlCalloc(count,size);
+}
+
+//Growing or moving a block counts as an allocation, shrinking to nothing as a free
+static void *SDLCALL counted_realloc(void *pointer, size_t size)
+{
+    if(size > 0)
+        count_allocation(size,sdl_caller());
+    else
+        count_free(pointer);
+    return sdlRealloc(pointer,size);
+}
+
+static void SDLCALL counted_free(void *pointer)
+{
+    count_free(pointer);
+    sdlFree(pointer);
+}
+
+void alloc_hook_sdl()
+{
+    if(sdlMalloc != NULL)
+        return;
+
+    SDL_GetMemoryFunctions(&sdlMalloc,&sdlCalloc,&sdlRealloc,&sdlFree);
+
+    //Looked up by name, in a non-PIE executable &SDL_GetMemoryFunctions is its own PLT entry
+#ifdef _WIN32
+    sdlModule = GetModuleHandleA("SDL2.dll");
+#else
+    sdlModule = module_of(dlsym(RTLD_DEFAULT,"SDL_GetMemoryFunctions"));
+#endif
+    if(sdlModule == module_of((const void*)alloc_hook_sdl))
+        sdlModule = NULL;
+#ifndef _WIN32
+    //The first backtrace() loads the unwinder, which allocates
+    void *frames[SDL_BACKTRACE_FRAMES];
+    backtrace(frames,SDL_BACKTRACE_FRAMES);
+#endif
+
+    if(SDL_SetMemoryFunctions(counted_malloc,counted_calloc,counted_realloc,counted_free) != 0)
+    {
+        printf("Could not hook SDL's allocator: %s\n",SDL_GetError());
+        sdlMalloc = NULL;
+    }
+}
+
+//------------------ Counters  -------------------------
+
+static AllocCounts current_frame()
+{
+    SDL_AtomicLock(&frameLock);
+    AllocCounts counts = frame;
+    SDL_AtomicUnlock(&frameLock);
+    return counts;
+}
+
+void alloc_begin_frame()
+{
+    SDL_AtomicLock(&frameLock);
+    AllocCounts counts = frame;
+    frame.allocations = 0;
+    frame.frees = 0;
+    frame.bytes = 0;
+    frame.exempt = 0;
+    SDL_AtomicUnlock(&frameLock);
+
+    SDL_AtomicLock(&totalsLock);
+    totals.allocations += counts.allocations;
+    totals.frees += counts.frees;
+    totals.bytes += counts.bytes;
+    totals.exempt += counts.exempt;
+    SDL_AtomicUnlock(&totalsLock);
+}
+
+AllocCounts alloc_frame_counts()
+{
+    return current_frame();
+}
+
+AllocCounts alloc_total_counts()
+{
+    AllocCounts counts = current_frame();
+    SDL_AtomicLock(&totalsLock);
+    counts.allocations += totals.allocations;
+    counts.frees += totals.frees;
+    counts.bytes += totals.bytes;
+    counts.exempt += totals.exempt;
+    SDL_AtomicUnlock(&totalsLock);
+    return counts;
+}
+
+//------------------ Call sites  -------------------------
+
+void alloc_set_recording(bool on)
+{
+    SDL_AtomicSet(&recording,on ? 1 : 0);
+}
+
+void alloc_clear_sites()
+{
+    SDL_AtomicLock(&siteLock);
+    for(int i = 0; i < SITE_SLOTS; ++i)
+    {
+        sites[i].address = NULL;
+        sites[i].exempt = NULL;
+        sites[i].count = 0;
+        sites[i].bytes = 0;
+    }
+    siteOverflow = 0;
+    SDL_AtomicUnlock(&siteLock);
+}
+
+static bool more_allocations(const AllocSite &a, const AllocSite &b)
+{
+    return a.count > b.count;
+}
+
+//Function name where the platform can find one, otherwise module+offset for addr2line
+static void print_site(FILE *file, const void *address)
+{
+    if(address == &sdlBucket)
+    {
+        fprintf(file,"SDL (caller outside SDL not found)");
+        return;
+    }
+#ifdef _WIN32
+    fprintf(file,"%p",address);
+#else
+    Dl_info info;
+    if(dladdr(address,&info) == 0)
+    {
+        fprintf(file,"%p",address);
+        return;
+    }
+
+    if(info.dli_sname != NULL)
+    {
+        int status = -1;
+        char *demangled = abi::__cxa_demangle(info.dli_sname,NULL,NULL,&status);
+        fprintf(file,"%s+0x%lx",status == 0 ? demangled : info.dli_sname,(unsigned long)((const char*)address - (const char*)info.dli_saddr));
+        free(demangled);
+    }
+    else
+    {
+        fprintf(file,"%s+0x%lx",info.dli_fname,(unsigned long)((const char*)address - (const char*)info.dli_fbase));
+    }
+#endif
+}
+
+void alloc_report(FILE *file, int maxSites)
+{
+    //Copied out first, naming a site may allocate
+    static AllocSite sorted[SITE_SLOTS];
+    int count = 0;
+    Uint64 overflow;
+
+    SDL_AtomicLock(&siteLock);
+    for(int i = 0; i < SITE_SLOTS; ++i)
+    {
+        if(sites[i].address != NULL)
+            sorted[count++] = sites[i];
+    }
+    overflow = siteOverflow;
+    SDL_AtomicUnlock(&siteLock);
+
+    std::sort(sorted,sorted + count,more_allocations);
+
+    bool wasRecording = SDL_AtomicSet(&recording,0) != 0;
+    for(int i = 0; i < count && i < maxSites; ++i)
+    {
+        fprintf(file,"  %8llu allocations %10.1f KB  ",(unsigned long long)sorted[i].count,sorted[i].bytes/1024.0);
+        print_site(file,sorted[i].address);
+        if(sorted[i].exempt != NULL)
+            fprintf(file,"  (exempt: %s)",sorted[i].exempt);
+        fprintf(file,"\n");
+    }
+    if(count > maxSites)
+        fprintf(file,"  ... %d more call sites\n",count - maxSites);
+    if(overflow > 0)
+        fprintf(file,"  %llu allocations from call sites past the table\n",(unsigned long long)overflow);
+    SDL_AtomicSet(&recording,wasRecording ? 1 : 0);
+}
+
+//------------------ Exemptions  -------------------------
+
+const char *alloc_set_exempt(const char *reason)
+{
+    const char *previous = exemptReason;
+    exemptReason = reason;
+    return previous;
+}
+
+const char *alloc_get_exempt()
+{
+    return exemptReason;
+}
+
+bool alloc_tracking_enabled()
+{
+    return true;
+}
+
+#else
+
+//Without ALLOC_TRACKING nothing is replaced and nothing is counted
+
+void alloc_hook_sdl()
+{
+}
+
+void alloc_begin_frame()
+{
+}
+
+AllocCounts alloc_frame_counts()
+{
+    AllocCounts counts = {0,0,0,0};
+    return counts;
+}
+
+AllocCounts alloc_total_counts()
+{
+    AllocCounts counts = {0,0,0,0};
+    return counts;
+}
+
+void alloc_set_recording(bool recording)
+{
+}
+
+void alloc_clear_sites()
+{
+}
+
+void alloc_report(FILE *file, int maxSites)
+{
+    fprintf(file,"  Allocations are not tracked, build with -DALLOC_TRACKING\n");
+}
+
+const char *alloc_set_exempt(const char *reason)
+{
+    return NULL;
+}
+
+const char *alloc_get_exempt()
+{
+    return NULL;
+}
+
+bool alloc_tracking_enabled()
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef ALLOCTRACK_H
+#define ALLOCTRACK_H
+
+#include <SDL2/SDL.h>
+#include <cstdio>
+
+//Counts heap allocations. Global operator new/delete are replaced and SDL's
+//allocator is wrapped, so every allocation made by the program or by SDL is
+//counted per frame and, while recording, per call site. Libraries that call
+//malloc themselves (libpng, freetype) are not seen.
+//
+//This is a debugging layer that costs a lock on every allocation, so it is
+//only compiled in with -DALLOC_TRACKING. Without it the functions below do
+//nothing and every count is 0.
+
+struct AllocCounts
+{
+    Uint64 allocations;
+    Uint64 frees;
+    Uint64 bytes;
+
+    //Allocations made inside an AllocExempt scope, not included in allocations
+    Uint64 exempt;
+};
+
+//False unless built with ALLOC_TRACKING
+bool alloc_tracking_enabled();
+
+//Routes SDL_malloc and friends through the counters. Call before SDL_Init,
+//SDL refuses new memory functions once it has allocated anything.
+void alloc_hook_sdl();
+
+//Starts a new frame, alloc_frame_counts() covers everything since
+void alloc_begin_frame();
+AllocCounts alloc_frame_counts();
+AllocCounts alloc_total_counts();
+
+//While on, every allocation is charged to the address it was made from,
+//for SDL's allocations the first one outside SDL
+void alloc_set_recording(bool recording);
+void alloc_clear_sites();
+
+//Prints the call sites with the most allocations since the last clear
+void alloc_report(FILE *file, int maxSites);
+
+//Allocations that are expected every so often in steady state, like labels
+//rebuilt twice a second, are counted separately under a reason
+const char *alloc_set_exempt(const char *reason);
+const char *alloc_get_exempt();
+
+//Marks allocations as expected for the lifetime of the scope
+class AllocExempt
+{
+    public:
+        AllocExempt(const char *reason) {previous = alloc_set_exempt(reason);};
+        ~AllocExempt() {alloc_set_exempt(previous);};
+    private:
+        const char *previous;
+};
+
+#endif // ALLOCTRACK_H
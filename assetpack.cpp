@@ -0,0 +1,247 @@
+#include "assetpack.h"
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char PACK_MAGIC[8] = {'H','A','T','C','H','P','K','1'};
+
+//Pixel data starts on a 64 byte boundary so rows can be read with aligned loads
+static const Uint64 PACK_ALIGNMENT = 64;
+
+struct PackHeader
+{
+    char magic[8];
+    Uint32 count;
+    Uint32 reserved;
+};
+
+static const Uint8 *packData = NULL;
+static Uint64 packSize = 0;
+static std::map<std::string, const PackEntry*> packIndex;
+
+#ifdef _WIN32
+static HANDLE packFile = INVALID_HANDLE_VALUE;
+static HANDLE packMapping = NULL;
+#endif
+
+PackWriter::~PackWriter()
+{
+    for(unsigned int i = 0; i < surfaces.size(); ++i)
+    {
+        SDL_FreeSurface(surfaces[i]);
+    }
+}
+
+void PackWriter::add(const std::string &name, SDL_Surface *surface)
+{
+    if(surface == NULL)
+    {
+        return;
+    }
+    if(name.size() >= sizeof(((PackEntry*)0)->name))
+    {
+        printf("Asset name too long for pack: %s\n",name.c_str());
+        return;
+    }
+    for(unsigned int i = 0; i < names.size(); ++i)
+    {
+        if(names[i] == name)
+            return;
+    }
+
+    SDL_Surface *converted = SDL_ConvertSurfaceFormat(surface,PACK_PIXEL_FORMAT,0);
+    if(converted == NULL)
+    {
+        printf("Could not convert %s: %s\n",name.c_str(),SDL_GetError());
+        return;
+    }
+    names.push_back(name);
+    surfaces.push_back(converted);
+}
+
+bool PackWriter::write(const char *path)
+{
+    FILE *file = fopen(path,"wb");
+    if(file == NULL)
+    {
+        printf("Could not open %s\n",path);
+        return false;
+    }
+
+    PackHeader header;
+    memcpy(header.magic,PACK_MAGIC,sizeof(header.magic));
+    header.count = surfaces.size();
+    header.reserved = 0;
+
+    std::vector<PackEntry> entries(surfaces.size());
+    Uint64 offset = sizeof(PackHeader) + entries.size()*sizeof(PackEntry);
+    for(unsigned int i = 0; i < entries.size(); ++i)
+    {
+        offset = (offset + PACK_ALIGNMENT - 1)/PACK_ALIGNMENT*PACK_ALIGNMENT;
+
+        memset(&entries[i],0,sizeof(PackEntry));
+        strncpy(entries[i].name,names[i].c_str(),sizeof(entries[i].name)-1);
+        entries[i].width = surfaces[i]->w;
+        entries[i].height = surfaces[i]->h;
+        entries[i].pitch = surfaces[i]->w*4;
+        entries[i].offset = offset;
+
+        offset += (Uint64)entries[i].pitch*entries[i].height;
+    }
+
+    bool written = fwrite(&header,sizeof(header),1,file) == 1;
+    if(written && !entries.empty())
+    {
+        written = fwrite(&entries[0],sizeof(PackEntry),entries.size(),file) == entries.size();
+    }
+
+    Uint64 position = sizeof(PackHeader) + entries.size()*sizeof(PackEntry);
+    static const char padding[PACK_ALIGNMENT] = {0};
+    for(unsigned int i = 0; i < entries.size() && written; ++i)
+    {
+        size_t gap = entries[i].offset-position;
+        written = fwrite(padding,1,gap,file) == gap;
+        position = entries[i].offset;
+
+        SDL_LockSurface(surfaces[i]);
+        for(Uint32 y = 0; y < entries[i].height && written; ++y)
+        {
+            written = fwrite((Uint8*)surfaces[i]->pixels + y*surfaces[i]->pitch,1,entries[i].pitch,file) == entries[i].pitch;
+        }
+        SDL_UnlockSurface(surfaces[i]);
+        position += (Uint64)entries[i].pitch*entries[i].height;
+    }
+
+    //A full disk may only show up when the buffered tail is flushed
+    if(fclose(file) != 0)
+        written = false;
+    if(!written)
+    {
+        printf("Could not write %s, removed the partial pack\n",path);
+        remove(path);
+        return false;
+    }
+    printf("Packed %d assets into %s (%.1f MB)\n",(int)entries.size(),path,position/1048576.0);
+    return true;
+}
+
+bool pack_open(const char *path)
+{
+    pack_close();
+
+#ifdef _WIN32
+    packFile = CreateFileA(path,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+    if(packFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(packFile,&size);
+    packSize = size.QuadPart;
+    packMapping = CreateFileMappingA(packFile,NULL,PAGE_READONLY,0,0,NULL);
+    if(packMapping != NULL)
+    {
+        packData = (const Uint8*)MapViewOfFile(packMapping,FILE_MAP_READ,0,0,0);
+    }
+#else
+    int fd = open(path,O_RDONLY);
+    if(fd < 0)
+    {
+        return false;
+    }
+    struct stat info;
+    if(fstat(fd,&info) == 0 && info.st_size > 0)
+    {
+        packSize = info.st_size;
+        void *mapping = mmap(NULL,packSize,PROT_READ,MAP_PRIVATE,fd,0);
+        if(mapping != MAP_FAILED)
+        {
+            packData = (const Uint8*)mapping;
+        }
+    }
+    close(fd);
+#endif
+
+    if(packData == NULL)
+    {
+        printf("Could not map %s\n",path);
+        pack_close();
+        return false;
+    }
+
+    const PackHeader *header = (const PackHeader*)packData;
+    if(packSize < sizeof(PackHeader) || memcmp(header->magic,PACK_MAGIC,sizeof(PACK_MAGIC)) != 0
+       || packSize < sizeof(PackHeader) + (Uint64)header->count*sizeof(PackEntry))
+    {
+        printf("%s is not an asset pack\n",path);
+        pack_close();
+        return false;
+    }
+
+    const PackEntry *entries = (const PackEntry*)(packData + sizeof(PackHeader));
+    for(Uint32 i = 0; i < header->count; ++i)
+    {
+        if(entries[i].offset + (Uint64)entries[i].pitch*entries[i].height > packSize)
+        {
+            printf("%s is truncated\n",path);
+            pack_close();
+            return false;
+        }
+        packIndex[std::string(entries[i].name,strnlen(entries[i].name,sizeof(entries[i].name)))] = &entries[i];
+    }
+    return true;
+}
+
+void pack_close()
+{
+    packIndex.clear();
+#ifdef _WIN32
+    if(packData != NULL)
+        UnmapViewOfFile(packData);
+    if(packMapping != NULL)
+        CloseHandle(packMapping);
+    if(packFile != INVALID_HANDLE_VALUE)
+        CloseHandle(packFile);
+    packMapping = NULL;
+    packFile = INVALID_HANDLE_VALUE;
+#else
+    if(packData != NULL)
+        munmap((void*)packData,packSize);
+#endif
+    packData = NULL;
+    packSize = 0;
+}
+
+bool pack_is_open()
+{
+    return packData != NULL;
+}
+
+const void *pack_find(const std::string &name, int *width, int *height, int *pitch)
+{
+    std::map<std::string, const PackEntry*>::iterator it = packIndex.find(name);
+    if(it == packIndex.end())
+    {
+        return NULL;
+    }
+    *width = it->second->width;
+    *height = it->second->height;
+    *pitch = it->second->pitch;
+    return packData + it->second->offset;
+}
+
+std::string pack_text_key(const std::string &message, SDL_Color color)
+{
+    char prefix[16];
+    sprintf(prefix,"text%02x%02x%02x%02x:",color.r,color.g,color.b,color.a);
+    return prefix + message;
+}
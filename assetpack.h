@@ -0,0 +1,50 @@
+#ifndef ASSETPACK_H
+#define ASSETPACK_H
+
+#include <SDL2/SDL.h>
+#include <string>
+#include <vector>
+
+//An asset pack is a single file of ARGB8888 pixel data with an index in
+//front, written by --pack. At startup it is memory mapped and textures are
+//uploaded straight from the mapping, so nothing is decoded or copied.
+
+const Uint32 PACK_PIXEL_FORMAT = SDL_PIXELFORMAT_ARGB8888;
+
+struct PackEntry
+{
+    char name[104];
+    Uint32 width;
+    Uint32 height;
+    Uint32 pitch;
+    Uint32 reserved;
+    Uint64 offset;
+};
+
+//Collects surfaces while the packer runs and writes them out in one go
+class PackWriter
+{
+    public:
+        ~PackWriter();
+
+        //Copies the surface, converting it to PACK_PIXEL_FORMAT. Repeated names are ignored.
+        void add(const std::string &name, SDL_Surface *surface);
+        bool write(const char *path);
+
+    private:
+        std::vector<std::string> names;
+        std::vector<SDL_Surface*> surfaces;
+};
+
+//Maps a pack file, returns false if it does not exist or is not a pack
+bool pack_open(const char *path);
+void pack_close();
+bool pack_is_open();
+
+//Returns a pointer into the mapping, or NULL if the pack has no such asset
+const void *pack_find(const std::string &name, int *width, int *height, int *pitch);
+
+//Key under which pre-rendered text is stored
+std::string pack_text_key(const std::string &message, SDL_Color color);
+
+#endif // ASSETPACK_H
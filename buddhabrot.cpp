@@ -0,0 +1,303 @@
+#include "buddhabrot.h"
+#include "fractal.h"
+#include "jobs.h"
+#include <cmath>
+
+static const int MERGE_BANDS = 64;
+
+//xorshift64*, one state per worker
+static inline Uint64 next_random(Uint64 &state)
+{
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state*2685821657736338717ULL;
+}
+
+//Uniform in [0,1)
+static inline double random_unit(Uint64 &state)
+{
+    return (next_random(state) >> 11)*(1.0/9007199254740992.0);
+}
+
+//Inside the main cardioid or the period 2 bulb, such points never escape
+static inline bool in_main_bulbs(double x, double y)
+{
+    double a = x - 0.25;
+    double q = a*a + y*y;
+    if(q*(q + a) <= 0.25*y*y)
+        return true;
+    return (x + 1.0)*(x + 1.0) + y*y <= 0.0625;
+}
+
+BuddhabrotDensity::BuddhabrotDensity(int size, double centerX, double centerY, double span, int minIt, int maxIt)
+{
+    this->size = size;
+    this->minIt = minIt;
+    this->maxIt = maxIt;
+    pixelSize = span/size;
+    top = centerX - span*0.5;
+    left = centerY - span*0.5;
+
+    mapSize = 0;
+    mapRowsDone = 0;
+    mapCoverage = 0.0;
+
+    samples = 0;
+    orbits = 0;
+    hits = 0;
+    iterations = 0;
+    merges = 0;
+
+    densityMax = 0;
+    bandMax.assign(MERGE_BANDS,0);
+    pixels = NULL;
+    pitch = 0;
+
+    //Black through deep blue and violet to white
+    for(int i = 0; i < 256; ++i)
+    {
+        float t = i/255.0f;
+        Uint8 r = (Uint8)(255.0f*powf(t,1.3f));
+        Uint8 g = (Uint8)(255.0f*powf(t,2.0f));
+        Uint8 b = (Uint8)(255.0f*powf(t,0.7f));
+        palette[i] = 0xFF000000 | (r << 16) | (g << 8) | b;
+    }
+}
+
+void BuddhabrotDensity::build_map_rows(int mapSize, int rowStart, int rowEnd)
+{
+    if(this->mapSize != mapSize)
+    {
+        this->mapSize = mapSize;
+        mapRowsDone = 0;
+        map.assign((size_t)mapSize*mapSize,0);
+        cells.clear();
+    }
+
+    //Each cell is sampled at its center
+    double cellSize = 4.0/mapSize;
+    FractalView view;
+    view.centerX = -2.0 + cellSize*0.5 + (mapSize/2)*cellSize;
+    view.centerY = view.centerX;
+    view.pixelSize = cellSize;
+    view.juliaX = 0.0;
+    view.juliaY = 0.0;
+    view.maxIt = maxIt;
+    FractalKernel kernel = get_iteration_kernel(FRACTAL_MANDELBROT,PRECISION_DOUBLE);
+    kernel(view,&map[0],mapSize*4,mapSize,mapSize,rowStart,rowEnd);
+    mapRowsDone += rowEnd - rowStart;
+    if(mapRowsDone < mapSize)
+        return;
+
+    //0 escapes too soon to count, 1 gives a counted orbit, 2 never escapes.
+    //Cells that differ from a neighbour are kept too, a cell is only judged by its center.
+    std::vector<Uint8> kind(map.size());
+    for(size_t i = 0; i < map.size(); ++i)
+    {
+        Uint32 steps = map[i] + 1;
+        kind[i] = map[i] > (Uint32)maxIt ? 2 : steps >= (Uint32)minIt ? 1 : 0;
+    }
+    cells.clear();
+    for(int y = 0; y < mapSize; ++y)
+    {
+        for(int x = 0; x < mapSize; ++x)
+        {
+            Uint8 own = kind[y*mapSize + x];
+            bool keep = own == 1;
+            for(int dy = -1; dy <= 1 && !keep; ++dy)
+            {
+                for(int dx = -1; dx <= 1 && !keep; ++dx)
+                {
+                    int nx = x + dx;
+                    int ny = y + dy;
+                    if(nx >= 0 && nx < mapSize && ny >= 0 && ny < mapSize && kind[ny*mapSize + nx] != own)
+                        keep = true;
+                }
+            }
+            if(keep)
+                cells.push_back(y*mapSize + x);
+        }
+    }
+    mapCoverage = (double)cells.size()/map.size();
+}
+
+bool BuddhabrotDensity::map_ready()
+{
+    return mapSize > 0 && mapRowsDone >= mapSize;
+}
+
+void BuddhabrotDensity::sample_worker(void *data, int index)
+{
+    BuddhabrotDensity *buddhabrot = (BuddhabrotDensity*)data;
+    Worker &worker = buddhabrot->workers[index];
+    const int size = buddhabrot->size;
+    const int minIt = buddhabrot->minIt;
+    const int maxIt = buddhabrot->maxIt;
+    const int mapSize = buddhabrot->mapSize;
+    const double cellSize = 4.0/mapSize;
+    const double top = buddhabrot->top;
+    const double left = buddhabrot->left;
+    const double inverse = 1.0/buddhabrot->pixelSize;
+    const int cellCount = buddhabrot->cells.size();
+    Uint32 *counts = &worker.counts[0];
+    double *orbit = &worker.orbit[0];
+
+    Uint64 orbits = 0;
+    Uint64 hits = 0;
+    Uint64 iterations = 0;
+    for(int s = 0; s < worker.samples; ++s)
+    {
+        int cell = buddhabrot->cells[next_random(worker.random) % cellCount];
+        double cx = -2.0 + (cell % mapSize + random_unit(worker.random))*cellSize;
+        double cy = -2.0 + (cell / mapSize + random_unit(worker.random))*cellSize;
+        if(in_main_bulbs(cx,cy))
+            continue;
+
+        double x = 0.0;
+        double y = 0.0;
+        int steps = 0;
+        while(steps < maxIt && x*x + y*y <= 4.0)
+        {
+            double xTemp = x*x - y*y + cx;
+            y = 2.0*x*y + cy;
+            x = xTemp;
+            orbit[2*steps] = x;
+            orbit[2*steps + 1] = y;
+            steps++;
+        }
+        iterations += steps;
+        if(x*x + y*y <= 4.0 || steps < minIt)
+            continue;
+
+        //The conjugate of c traces the mirrored orbit, so each orbit is counted on both sides
+        orbits++;
+        for(int i = 0; i < steps; ++i)
+        {
+            int row = (int)((orbit[2*i] - top)*inverse);
+            if(row < 0 || row >= size)
+                continue;
+            int column = (int)((orbit[2*i + 1] - left)*inverse);
+            if(column >= 0 && column < size)
+            {
+                counts[row*size + column]++;
+                hits++;
+            }
+            column = (int)((-orbit[2*i + 1] - left)*inverse);
+            if(column >= 0 && column < size)
+            {
+                counts[row*size + column]++;
+                hits++;
+            }
+        }
+    }
+    worker.orbits = orbits;
+    worker.hits = hits;
+    worker.iterations = iterations;
+}
+
+Uint64 BuddhabrotDensity::sample(int samplesPerThread)
+{
+    if(!map_ready() || cells.empty())
+        return 0;
+
+    //Allocated on first use, the menu creates every screen before one is picked
+    if(workers.empty())
+    {
+        workers.resize(jobs_thread_count());
+        for(unsigned int i = 0; i < workers.size(); ++i)
+        {
+            workers[i].counts.assign((size_t)size*size,0);
+            workers[i].orbit.resize(2*(maxIt + 1));
+            workers[i].random = 0x9E3779B97F4A7C15ULL*(i + 1);
+        }
+        density.assign((size_t)size*size,0);
+    }
+
+    //One job per worker buffer, so a buffer is only ever written by the thread running its job
+    for(unsigned int i = 0; i < workers.size(); ++i)
+        workers[i].samples = samplesPerThread;
+    jobs_parallel_for(sample_worker,this,workers.size());
+
+    Uint64 sampleIterations = 0;
+    for(unsigned int i = 0; i < workers.size(); ++i)
+    {
+        samples += workers[i].samples;
+        orbits += workers[i].orbits;
+        hits += workers[i].hits;
+        sampleIterations += workers[i].iterations;
+    }
+    iterations += sampleIterations;
+    return sampleIterations;
+}
+
+void BuddhabrotDensity::merge_band(void *data, int index)
+{
+    BuddhabrotDensity *buddhabrot = (BuddhabrotDensity*)data;
+    size_t total = buddhabrot->density.size();
+    size_t start = total*index/MERGE_BANDS;
+    size_t end = total*(index + 1)/MERGE_BANDS;
+    Uint32 *density = &buddhabrot->density[0];
+
+    for(unsigned int w = 0; w < buddhabrot->workers.size(); ++w)
+    {
+        Uint32 *counts = &buddhabrot->workers[w].counts[0];
+        for(size_t i = start; i < end; ++i)
+        {
+            Uint32 sum = density[i] + counts[i];
+            density[i] = sum < density[i] ? 0xFFFFFFFF : sum;
+            counts[i] = 0;
+        }
+    }
+
+    Uint32 highest = 0;
+    for(size_t i = start; i < end; ++i)
+    {
+        if(density[i] > highest)
+            highest = density[i];
+    }
+    buddhabrot->bandMax[index] = highest;
+}
+
+void BuddhabrotDensity::merge()
+{
+    if(density.empty())
+        return;
+    jobs_parallel_for(merge_band,this,MERGE_BANDS);
+    densityMax = 0;
+    for(int i = 0; i < MERGE_BANDS; ++i)
+    {
+        if(bandMax[i] > densityMax)
+            densityMax = bandMax[i];
+    }
+    merges++;
+}
+
+void BuddhabrotDensity::colorize_band(void *data, int index)
+{
+    BuddhabrotDensity *buddhabrot = (BuddhabrotDensity*)data;
+    int size = buddhabrot->size;
+    int rowStart = size*index/MERGE_BANDS;
+    int rowEnd = size*(index + 1)/MERGE_BANDS;
+    float scale = buddhabrot->densityMax > 0 ? 1.0f/buddhabrot->densityMax : 0.0f;
+
+    for(int y = rowStart; y < rowEnd; ++y)
+    {
+        const Uint32 *in = &buddhabrot->density[(size_t)y*size];
+        Uint32 *out = (Uint32*)((Uint8*)buddhabrot->pixels + y*buddhabrot->pitch);
+        for(int x = 0; x < size; ++x)
+        {
+            out[x] = buddhabrot->palette[(int)(sqrtf(in[x]*scale)*255.0f)];
+        }
+    }
+}
+
+void BuddhabrotDensity::colorize(Uint32 *pixels, int pitch)
+{
+    if(density.empty())
+        return;
+    this->pixels = pixels;
+    this->pitch = pitch;
+    jobs_parallel_for(colorize_band,this,MERGE_BANDS);
+    this->pixels = NULL;
+}
@@ -0,0 +1,95 @@
+#ifndef BUDDHABROT_H
+#define BUDDHABROT_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+
+//The Buddhabrot: how often the orbits of escaping points c of z = z^2 + c
+//pass through each pixel. Every sample traces a whole orbit, up to maxIt
+//steps, so it costs far more than an escape-time pass and the image only
+//converges over many frames.
+//
+//Every thread of the job pool traces into a buffer of its own, so there are
+//no atomics on the hot path, and merge() adds those buffers into the shared
+//density now and then. Samples are drawn only from cells of a low
+//resolution escape-time map whose points can give a counted orbit, or that
+//border such a cell: points inside the set never escape and points far
+//outside escape before minIt, and together they are most of the plane.
+
+class BuddhabrotDensity
+{
+    public:
+        //A size x size image of the square of the plane centered on centerX,centerY
+        //and span wide, real running down and imaginary across for the upright
+        //figure. Orbits that escape in fewer than minIt steps are not counted.
+        BuddhabrotDensity(int size, double centerX, double centerY, double span, int minIt, int maxIt);
+
+        //Escape counts for rows [rowStart,rowEnd) of the mapSize x mapSize
+        //map over |Re c|,|Im c| <= 2, so the map can be built a few rows a frame.
+        //The last call builds the list of cells to sample from.
+        void build_map_rows(int mapSize, int rowStart, int rowEnd);
+        bool map_ready();
+
+        //Traces samplesPerThread orbits on every thread of the job pool into
+        //its private buffer, returns the iterations run. The buffers are
+        //allocated on the first call.
+        Uint64 sample(int samplesPerThread);
+
+        //Adds the private buffers into the density and clears them
+        void merge();
+
+        //Density as ARGB8888, on a square root scale of the busiest pixel
+        void colorize(Uint32 *pixels, int pitch);
+
+        int size;
+        int minIt;
+        int maxIt;
+
+        //Share of the |c| <= 2 square the map samples from
+        double mapCoverage;
+
+        //Totals since construction. orbits are the samples that were counted,
+        //hits the orbit points that landed in the image.
+        Uint64 samples;
+        Uint64 orbits;
+        Uint64 hits;
+        Uint64 iterations;
+        int merges;
+
+    private:
+        struct Worker
+        {
+            std::vector<Uint32> counts;
+            std::vector<double> orbit;
+            Uint64 random;
+            int samples;
+            Uint64 orbits;
+            Uint64 hits;
+            Uint64 iterations;
+        };
+
+        static void sample_worker(void *data, int index);
+        static void merge_band(void *data, int index);
+        static void colorize_band(void *data, int index);
+
+        double top;
+        double left;
+        double pixelSize;
+
+        int mapSize;
+        int mapRowsDone;
+        std::vector<Uint32> map;
+        std::vector<int> cells;
+
+        std::vector<Worker> workers;
+        std::vector<Uint32> density;
+        Uint32 densityMax;
+        std::vector<Uint32> bandMax;
+
+        //Set for the duration of colorize()
+        Uint32 *pixels;
+        int pitch;
+        Uint32 palette[256];
+};
+
+#endif // BUDDHABROT_H
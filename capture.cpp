@@ -0,0 +1,389 @@
+#include "capture.h"
+#include <SDL2/SDL_image.h>
+#include "memtrack.h"
+
+static const Uint64 FNV_OFFSET = 14695981039346656037ULL;
+static const Uint64 FNV_PRIME = 1099511628211ULL;
+
+//The PNG path goes to snprintf as the format, so it may hold exactly one
+//integer conversion like %d or %05d and otherwise only %%. Without one,
+//%05d goes in front of the extension.
+static bool valid_frame_pattern(std::string &path)
+{
+    int conversions = 0;
+    for(size_t i = 0; i < path.size(); ++i)
+    {
+        if(path[i] != '%')
+            continue;
+        if(i + 1 < path.size() && path[i + 1] == '%')
+        {
+            i++;
+            continue;
+        }
+        size_t end = i + 1;
+        while(end < path.size() && path[end] >= '0' && path[end] <= '9')
+        {
+            end++;
+        }
+        if(end >= path.size() || path[end] != 'd' || end - i > 4)
+            return false;
+        conversions++;
+        i = end;
+    }
+    if(conversions > 1)
+        return false;
+    if(conversions == 0)
+    {
+        size_t dot = path.rfind('.');
+        size_t slash = path.find_last_of("/\\");
+        if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            dot = path.size();
+        path.insert(dot,"%05d");
+    }
+    return true;
+}
+
+FrameCapture::FrameCapture()
+{
+    renderer = NULL;
+    y4m = false;
+    file = NULL;
+    width = 0;
+    height = 0;
+    encoder = NULL;
+    lock = NULL;
+    queuedFrame = NULL;
+    freedBuffer = NULL;
+    waitForBuffers = false;
+    stopping = false;
+    queueStart = 0;
+    queueCount = 0;
+    frameNumber = 0;
+    SDL_zero(counters);
+}
+
+FrameCapture::~FrameCapture()
+{
+    stop();
+}
+
+bool FrameCapture::start(SDL_Renderer *renderer, const char *path, int fps, int queueDepth, bool waitForBuffers)
+{
+    if(encoder != NULL)
+        return false;
+
+    this->renderer = renderer;
+    this->path = path;
+    this->waitForBuffers = waitForBuffers;
+    if(SDL_GetRendererOutputSize(renderer,&width,&height) != 0 || width <= 0 || height <= 0)
+    {
+        printf("Could not get the size to capture at: %s\n",SDL_GetError());
+        return false;
+    }
+
+    y4m = this->path.size() >= 4 && this->path.compare(this->path.size() - 4,4,".y4m") == 0;
+    if(y4m)
+    {
+        file = fopen(path,"wb");
+        if(file == NULL)
+        {
+            printf("Could not open %s\n",path);
+            return false;
+        }
+        //C420jpeg: full range BT.601 with chroma sited between the luma samples
+        fprintf(file,"YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",width,height,fps);
+        planes.resize((size_t)width*height + 2*(size_t)((width + 1)/2)*((height + 1)/2));
+    }
+    else if(!valid_frame_pattern(this->path))
+    {
+        printf("%s should have one %%d (or %%05d and the like) for the frame number, and no other %% but %%%%\n",path);
+        return false;
+    }
+
+    if(queueDepth < 2)
+        queueDepth = 2;
+    for(int i = 0; i < queueDepth; ++i)
+    {
+        //Surfaces start zeroed, so letterbox bars the readback skips stay black
+        SDL_Surface *buffer = mem_track_surface(SDL_CreateRGBSurfaceWithFormat(0,width,height,32,SDL_PIXELFORMAT_ARGB8888),"capture buffer");
+        if(buffer == NULL)
+        {
+            printf("Could not allocate capture buffers\n");
+            stop();
+            return false;
+        }
+        buffers.push_back(buffer);
+        freeBuffers.push_back(i);
+    }
+    queue.resize(queueDepth);
+    queueStart = 0;
+    queueCount = 0;
+    frameNumber = 0;
+    SDL_zero(counters);
+    counters.checksum = FNV_OFFSET;
+
+    stopping = false;
+    lock = SDL_CreateMutex();
+    queuedFrame = SDL_CreateCond();
+    freedBuffer = SDL_CreateCond();
+    encoder = SDL_CreateThread(encoder_main,"capture encoder",this);
+    if(encoder == NULL)
+    {
+        printf("Could not start the capture encoder: %s\n",SDL_GetError());
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void FrameCapture::capture()
+{
+    if(encoder == NULL)
+        return;
+
+    int outputWidth,outputHeight;
+    SDL_GetRendererOutputSize(renderer,&outputWidth,&outputHeight);
+
+    SDL_LockMutex(lock);
+    if(outputWidth != width || outputHeight != height)
+    {
+        counters.resized++;
+        SDL_UnlockMutex(lock);
+        return;
+    }
+    if(freeBuffers.empty() && waitForBuffers)
+    {
+        Uint64 start = SDL_GetPerformanceCounter();
+        while(freeBuffers.empty())
+        {
+            SDL_CondWait(freedBuffer,lock);
+        }
+        counters.waited++;
+        counters.waitMs += (SDL_GetPerformanceCounter() - start)*1000.0/SDL_GetPerformanceFrequency();
+    }
+    if(freeBuffers.empty())
+    {
+        counters.dropped++;
+        SDL_UnlockMutex(lock);
+        return;
+    }
+    int index = freeBuffers.back();
+    freeBuffers.pop_back();
+    SDL_UnlockMutex(lock);
+
+    //The whole output, SDL clips it to the letterboxed viewport and only fills that part
+    Uint64 start = SDL_GetPerformanceCounter();
+    SDL_Rect whole = {0,0,width,height};
+    SDL_Surface *buffer = buffers[index];
+    bool read = SDL_RenderReadPixels(renderer,&whole,SDL_PIXELFORMAT_ARGB8888,buffer->pixels,buffer->pitch) == 0;
+    double ms = (SDL_GetPerformanceCounter() - start)*1000.0/SDL_GetPerformanceFrequency();
+
+    SDL_LockMutex(lock);
+    counters.readbackMs += ms;
+    if(read)
+    {
+        queue[(queueStart + queueCount) % queue.size()] = index;
+        queueCount++;
+        counters.captured++;
+        if(queueCount > counters.maxQueued)
+            counters.maxQueued = queueCount;
+        SDL_CondSignal(queuedFrame);
+    }
+    else
+    {
+        freeBuffers.push_back(index);
+        counters.dropped++;
+    }
+    SDL_UnlockMutex(lock);
+}
+
+int FrameCapture::encoder_main(void *data)
+{
+    FrameCapture *capture = (FrameCapture*)data;
+
+    SDL_LockMutex(capture->lock);
+    while(true)
+    {
+        while(capture->queueCount == 0 && !capture->stopping)
+        {
+            SDL_CondWait(capture->queuedFrame,capture->lock);
+        }
+        //Stopping only ends the thread once the queue is written out
+        if(capture->queueCount == 0)
+            break;
+
+        int index = capture->queue[capture->queueStart];
+        capture->queueStart = (capture->queueStart + 1) % capture->queue.size();
+        capture->queueCount--;
+        Uint64 checksum = capture->counters.checksum;
+        SDL_UnlockMutex(capture->lock);
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        SDL_Surface *frame = capture->buffers[index];
+        for(int y = 0; y < frame->h; ++y)
+        {
+            const Uint32 *row = (const Uint32*)((const Uint8*)frame->pixels + y*frame->pitch);
+            for(int x = 0; x < frame->w; ++x)
+            {
+                checksum = (checksum ^ (row[x] & 0xFFFFFF))*FNV_PRIME;
+            }
+        }
+        long long bytes = capture->encode(frame);
+        double ms = (SDL_GetPerformanceCounter() - start)*1000.0/SDL_GetPerformanceFrequency();
+
+        SDL_LockMutex(capture->lock);
+        capture->counters.checksum = checksum;
+        capture->counters.encodeMs += ms;
+        if(bytes >= 0)
+        {
+            capture->counters.written++;
+            capture->counters.bytes += bytes;
+        }
+        capture->freeBuffers.push_back(index);
+        SDL_CondSignal(capture->freedBuffer);
+    }
+    SDL_UnlockMutex(capture->lock);
+    return 0;
+}
+
+long long FrameCapture::encode(SDL_Surface *frame)
+{
+    if(y4m)
+        return write_y4m(frame);
+
+    //The window's alpha is meaningless, the PNG should not be see-through
+    for(int y = 0; y < frame->h; ++y)
+    {
+        Uint32 *row = (Uint32*)((Uint8*)frame->pixels + y*frame->pitch);
+        for(int x = 0; x < frame->w; ++x)
+        {
+            row[x] |= 0xFF000000;
+        }
+    }
+
+    char name[1024];
+    snprintf(name,sizeof(name),path.c_str(),frameNumber++);
+    if(IMG_SavePNG(frame,name) != 0)
+    {
+        printf("Could not write %s: %s\n",name,SDL_GetError());
+        return -1;
+    }
+
+    long long bytes = 0;
+    FILE *written = fopen(name,"rb");
+    if(written != NULL)
+    {
+        fseek(written,0,SEEK_END);
+        bytes = ftell(written);
+        fclose(written);
+    }
+    return bytes;
+}
+
+//Full range BT.601 in 16.16 fixed point, chroma averaged over each 2x2 block
+long long FrameCapture::write_y4m(SDL_Surface *frame)
+{
+    int chromaWidth = (width + 1)/2;
+    int chromaHeight = (height + 1)/2;
+    Uint8 *lumaPlane = &planes[0];
+    Uint8 *blueDifference = lumaPlane + (size_t)width*height;
+    Uint8 *redDifference = blueDifference + (size_t)chromaWidth*chromaHeight;
+
+    for(int y = 0; y < height; ++y)
+    {
+        const Uint32 *row = (const Uint32*)((const Uint8*)frame->pixels + y*frame->pitch);
+        Uint8 *luma = lumaPlane + (size_t)y*width;
+        for(int x = 0; x < width; ++x)
+        {
+            int r = (row[x] >> 16) & 0xFF;
+            int g = (row[x] >> 8) & 0xFF;
+            int b = row[x] & 0xFF;
+            luma[x] = (Uint8)((19595*r + 38470*g + 7471*b + 32768) >> 16);
+        }
+    }
+
+    for(int y = 0; y < chromaHeight; ++y)
+    {
+        const Uint32 *top = (const Uint32*)((const Uint8*)frame->pixels + 2*y*frame->pitch);
+        const Uint32 *bottom = 2*y + 1 < height ? (const Uint32*)((const Uint8*)top + frame->pitch) : top;
+        for(int x = 0; x < chromaWidth; ++x)
+        {
+            int left = 2*x;
+            int right = 2*x + 1 < width ? 2*x + 1 : 2*x;
+            Uint32 samples[4] = {top[left],top[right],bottom[left],bottom[right]};
+            int r = 0;
+            int g = 0;
+            int b = 0;
+            for(int i = 0; i < 4; ++i)
+            {
+                r += (samples[i] >> 16) & 0xFF;
+                g += (samples[i] >> 8) & 0xFF;
+                b += samples[i] & 0xFF;
+            }
+            //Sums of four samples, so the coefficients are divided by 4 through the shift
+            int u = (-11059*r - 21709*g + 32768*b + (128 << 18) + (1 << 17)) >> 18;
+            int v = (32768*r - 27439*g - 5329*b + (128 << 18) + (1 << 17)) >> 18;
+            blueDifference[(size_t)y*chromaWidth + x] = (Uint8)(u < 0 ? 0 : u > 255 ? 255 : u);
+            redDifference[(size_t)y*chromaWidth + x] = (Uint8)(v < 0 ? 0 : v > 255 ? 255 : v);
+        }
+    }
+
+    fputs("FRAME\n",file);
+    size_t written = fwrite(&planes[0],1,planes.size(),file);
+    if(written != planes.size())
+    {
+        printf("Could not write to %s\n",path.c_str());
+        return -1;
+    }
+    return 6 + (long long)written;
+}
+
+void FrameCapture::stop()
+{
+    if(encoder != NULL)
+    {
+        SDL_LockMutex(lock);
+        stopping = true;
+        SDL_CondSignal(queuedFrame);
+        SDL_UnlockMutex(lock);
+        SDL_WaitThread(encoder,NULL);
+        encoder = NULL;
+    }
+    if(lock != NULL)
+    {
+        SDL_DestroyCond(queuedFrame);
+        SDL_DestroyCond(freedBuffer);
+        SDL_DestroyMutex(lock);
+        queuedFrame = NULL;
+        freedBuffer = NULL;
+        lock = NULL;
+    }
+    if(file != NULL)
+    {
+        fclose(file);
+        file = NULL;
+    }
+    for(unsigned int i = 0; i < buffers.size(); ++i)
+    {
+        mem_free_surface(buffers[i]);
+    }
+    buffers.clear();
+    freeBuffers.clear();
+    queueCount = 0;
+}
+
+bool FrameCapture::running()
+{
+    return encoder != NULL;
+}
+
+CaptureStats FrameCapture::stats()
+{
+    if(lock == NULL)
+        return counters;
+
+    SDL_LockMutex(lock);
+    CaptureStats copy = counters;
+    SDL_UnlockMutex(lock);
+    return copy;
+}
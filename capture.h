@@ -0,0 +1,108 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <SDL2/SDL.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+//Records what the window shows, for demos and for checking a run's output.
+//The draw thread only reads each frame back into one of a fixed pool of
+//buffers and queues it; converting, compressing and writing happen on an
+//encoder thread. When every buffer is still waiting to be written the frame
+//is dropped rather than waited for, so a slow disk costs frames in the
+//recording, never frames on screen. A capture that has to be reproducible,
+//like the one --benchmark checksums, waits for a buffer instead.
+//
+//SDL has no asynchronous readback, so SDL_RenderReadPixels itself still
+//waits for the GPU; it is the only part left on the draw thread.
+
+struct CaptureStats
+{
+    //Frames read back and queued
+    int captured;
+    int written;
+
+    //Frames dropped because every buffer was waiting to be written
+    int dropped;
+
+    //Frames that waited for a buffer instead, and the time the draw thread spent waiting
+    int waited;
+    double waitMs;
+
+    //Frames skipped because the window was resized since capture started
+    int resized;
+
+    //Deepest the queue got
+    int maxQueued;
+
+    //Totals, on the draw thread and on the encoder thread
+    double readbackMs;
+    double encodeMs;
+    Uint64 bytes;
+
+    //FNV-1a over the RGB of every written frame in order, equal runs give equal checksums
+    Uint64 checksum;
+};
+
+class FrameCapture
+{
+    public:
+        FrameCapture();
+        ~FrameCapture();
+
+        //A path ending in .y4m gets one YUV 4:2:0 stream at fps, anything
+        //else is a pattern for a PNG per frame, like "frames/%05d.png", with
+        //one integer conversion (%05d is added if there is none).
+        //Frames are the renderer's output size when called. queueDepth
+        //buffers are allocated, at least 2. With waitForBuffers no frame is
+        //dropped, capture() blocks until the encoder frees a buffer.
+        bool start(SDL_Renderer *renderer, const char *path, int fps, int queueDepth, bool waitForBuffers);
+
+        //Reads the finished frame from the current render target, call
+        //before SDL_RenderPresent
+        void capture();
+
+        //Writes whatever is queued, then closes the stream
+        void stop();
+
+        bool running();
+        CaptureStats stats();
+
+    private:
+        static int encoder_main(void *data);
+
+        //Bytes written, -1 on failure
+        long long encode(SDL_Surface *frame);
+        long long write_y4m(SDL_Surface *frame);
+
+        SDL_Renderer *renderer;
+        std::string path;
+        bool y4m;
+        FILE *file;
+        int width;
+        int height;
+
+        SDL_Thread *encoder;
+        SDL_mutex *lock;
+        SDL_cond *queuedFrame;
+        SDL_cond *freedBuffer;
+        bool waitForBuffers;
+        bool stopping;
+
+        //Buffers not in use, and buffers waiting for the encoder oldest first,
+        //both sized to the pool up front
+        std::vector<SDL_Surface*> buffers;
+        std::vector<int> freeBuffers;
+        std::vector<int> queue;
+        int queueStart;
+        int queueCount;
+
+        //Encoder thread only
+        std::vector<Uint8> planes;
+        int frameNumber;
+
+        CaptureStats counters;
+};
+
+#endif // CAPTURE_H
@@ -0,0 +1,377 @@
+#include "compositor.h"
+#include "memtrack.h"
+#include "jobs.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COMPOSITOR_SSE2
+#include <immintrin.h>
+#endif
+
+//AVX2 is compiled per function and only called when the CPU reports it
+#if defined(COMPOSITOR_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define COMPOSITOR_AVX2
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(COMPOSITOR_SSE2) && defined(_MSC_VER)
+#define COMPOSITOR_AVX2
+#define TARGET_AVX2
+#endif
+
+static const int COMPOSITOR_BANDS = 32;
+
+//Source pixels are sampled at (fx >> 16) + step per destination pixel, fx starting half a step in
+typedef void (*BlendRow)(Uint32 *destination, const Uint32 *source, int count, Uint32 fx, Uint32 step);
+
+//------------------ Scalar  -------------------------
+
+//dst*(255-a) + src*a over 255, the same rounding in every kernel
+static inline Uint32 blend_pixel(Uint32 source, Uint32 destination)
+{
+    Uint32 alpha = source >> 24;
+    Uint32 inverse = 255 - alpha;
+    Uint32 result = 0xFF000000;
+    for(int shift = 0; shift < 24; shift += 8)
+    {
+        Uint32 value = ((source >> shift) & 0xFF)*alpha + ((destination >> shift) & 0xFF)*inverse;
+        value = (value + 1 + (value >> 8)) >> 8;
+        result |= value << shift;
+    }
+    return result;
+}
+
+static void blend_row_scalar(Uint32 *destination, const Uint32 *source, int count, Uint32 fx, Uint32 step)
+{
+    for(int i = 0; i < count; ++i, fx += step)
+    {
+        destination[i] = blend_pixel(source[fx >> 16],destination[i]);
+    }
+}
+
+static void copy_row_scalar(Uint32 *destination, const Uint32 *source, int count, Uint32 fx, Uint32 step)
+{
+    if(step == 0x10000)
+    {
+        memcpy(destination,source + (fx >> 16),count*4);
+        return;
+    }
+    for(int i = 0; i < count; ++i, fx += step)
+    {
+        destination[i] = source[fx >> 16] | 0xFF000000;
+    }
+}
+
+//------------------ SSE2  -------------------------
+
+#ifdef COMPOSITOR_SSE2
+
+static inline __m128i blend_half_sse2(__m128i source, __m128i destination)
+{
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(source,_MM_SHUFFLE(3,3,3,3)),_MM_SHUFFLE(3,3,3,3));
+    __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255),alpha);
+    __m128i value = _mm_add_epi16(_mm_mullo_epi16(source,alpha),_mm_mullo_epi16(destination,inverse));
+    value = _mm_add_epi16(_mm_add_epi16(value,_mm_set1_epi16(1)),_mm_srli_epi16(value,8));
+    return _mm_srli_epi16(value,8);
+}
+
+static inline __m128i blend4_sse2(__m128i source, __m128i destination)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i low = blend_half_sse2(_mm_unpacklo_epi8(source,zero),_mm_unpacklo_epi8(destination,zero));
+    __m128i high = blend_half_sse2(_mm_unpackhi_epi8(source,zero),_mm_unpackhi_epi8(destination,zero));
+    return _mm_or_si128(_mm_packus_epi16(low,high),_mm_set1_epi32((int)0xFF000000));
+}
+
+static inline __m128i gather4_sse2(const Uint32 *source, Uint32 fx, Uint32 step)
+{
+    if(step == 0x10000)
+        return _mm_loadu_si128((const __m128i*)(source + (fx >> 16)));
+    return _mm_set_epi32(source[(fx + 3*step) >> 16],source[(fx + 2*step) >> 16],source[(fx + step) >> 16],source[fx >> 16]);
+}
+
+static void blend_row_sse2(Uint32 *destination, const Uint32 *source, int count, Uint32 fx, Uint32 step)
+{
+    int i = 0;
+    for(; i + 4 <= count; i += 4, fx += 4*step)
+    {
+        __m128i d = _mm_loadu_si128((const __m128i*)(destination + i));
+        _mm_storeu_si128((__m128i*)(destination + i),blend4_sse2(gather4_sse2(source,fx,step),d));
+    }
+    blend_row_scalar(destination + i,source,count - i,fx,step);
+}
+
+static void copy_row_sse2(Uint32 *destination, const Uint32 *source, int count, Uint32 fx, Uint32 step)
+{
+    if(step == 0x10000)
+    {
+        copy_row_scalar(destination,source,count,fx,step);
+        return;
+    }
+    int i = 0;
+    __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+    for(; i + 4 <= count; i += 4, fx += 4*step)
+    {
+        _mm_storeu_si128((__m128i*)(destination + i),_mm_or_si128(gather4_sse2(source,fx,step),alpha));
+    }
+    copy_row_scalar(destination + i,source,count - i,fx,step);
+}
+
+#endif
+
+//------------------ AVX2  -------------------------
+
+#ifdef COMPOSITOR_AVX2
+
+TARGET_AVX2 static inline __m256i blend_half_avx2(__m256i source, __m256i destination)
+{
+    __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(source,_MM_SHUFFLE(3,3,3,3)),_MM_SHUFFLE(3,3,3,3));
+    __m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(255),alpha);
+    __m256i value = _mm256_add_epi16(_mm256_mullo_epi16(source,alpha),_mm256_mullo_epi16(destination,inverse));
+    value = _mm256_add_epi16(_mm256_add_epi16(value,_mm256_set1_epi16(1)),_mm256_srli_epi16(value,8));
+    return _mm256_srli_epi16(value,8);
+}
+
+//Unpack and pack both work inside 128 bit lanes, so pixel order comes back unchanged
+TARGET_AVX2 static inline __m256i blend8_avx2(__m256i source, __m256i destination)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i low = blend_half_avx2(_mm256_unpacklo_epi8(source,zero),_mm256_unpacklo_epi8(destination,zero));
+    __m256i high = blend_half_avx2(_mm256_unpackhi_epi8(source,zero),_mm256_unpackhi_epi8(destination,zero));
+    return _mm256_or_si256(_mm256_packus_epi16(low,high),_mm256_set1_epi32((int)0xFF000000));
+}
+
+TARGET_AVX2 static inline __m256i gather8_avx2(const Uint32 *source, Uint32 fx, Uint32 step)
+{
+    if(step == 0x10000)
+        return _mm256_loadu_si256((const __m256i*)(source + (fx >> 16)));
+    __m256i lanes = _mm256_mullo_epi32(_mm256_set_epi32(7,6,5,4,3,2,1,0),_mm256_set1_epi32(step));
+    __m256i index = _mm256_srli_epi32(_mm256_add_epi32(lanes,_mm256_set1_epi32(fx)),16);
+    return _mm256_i32gather_epi32((const int*)source,index,4);
+}
+
+TARGET_AVX2 static void blend_row_avx2(Uint32 *destination, const Uint32 *source, int count, Uint32 fx, Uint32 step)
+{
+    int i = 0;
+    for(; i + 8 <= count; i += 8, fx += 8*step)
+    {
+        __m256i d = _mm256_loadu_si256((const __m256i*)(destination + i));
+        _mm256_storeu_si256((__m256i*)(destination + i),blend8_avx2(gather8_avx2(source,fx,step),d));
+    }
+    blend_row_sse2(destination + i,source,count - i,fx,step);
+}
+
+TARGET_AVX2 static void copy_row_avx2(Uint32 *destination, const Uint32 *source, int count, Uint32 fx, Uint32 step)
+{
+    if(step == 0x10000)
+    {
+        copy_row_scalar(destination,source,count,fx,step);
+        return;
+    }
+    int i = 0;
+    __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+    for(; i + 8 <= count; i += 8, fx += 8*step)
+    {
+        _mm256_storeu_si256((__m256i*)(destination + i),_mm256_or_si256(gather8_avx2(source,fx,step),alpha));
+    }
+    copy_row_sse2(destination + i,source,count - i,fx,step);
+}
+
+#endif
+
+//Picked once from what the CPU supports
+static BlendRow blendRow = blend_row_scalar;
+static BlendRow copyRow = copy_row_scalar;
+static const char *kernelName = "scalar";
+
+//------------------ Compositor  -------------------------
+
+Compositor::Compositor(SDL_Renderer *renderer, int width, int height)
+{
+    this->renderer = renderer;
+    frame = NULL;
+    scale = 1.0f;
+    clearColor = 0xFF000000;
+
+    framebuffer = mem_track_surface(SDL_CreateRGBSurfaceWithFormat(0,width,height,32,SDL_PIXELFORMAT_ARGB8888),"compositor framebuffer");
+    stream = mem_track_texture(SDL_CreateTexture(renderer,SDL_PIXELFORMAT_ARGB8888,SDL_TEXTUREACCESS_STREAMING,width,height),"compositor stream");
+    SDL_SetTextureBlendMode(stream,SDL_BLENDMODE_NONE);
+
+#ifdef COMPOSITOR_SSE2
+    blendRow = blend_row_sse2;
+    copyRow = copy_row_sse2;
+    kernelName = "sse2";
+#endif
+#ifdef COMPOSITOR_AVX2
+    if(SDL_HasAVX2())
+    {
+        blendRow = blend_row_avx2;
+        copyRow = copy_row_avx2;
+        kernelName = "avx2";
+    }
+#endif
+}
+
+Compositor::~Compositor()
+{
+    for(std::map<SDL_Texture*, Image>::iterator it = images.begin(); it != images.end(); ++it)
+    {
+        mem_free_surface(it->second.surface);
+    }
+    mem_destroy_texture(stream);
+    mem_free_surface(framebuffer);
+}
+
+const char *Compositor::kernel_name()
+{
+    return kernelName;
+}
+
+void Compositor::update(SDL_Texture *texture, const void *pixels, int pitch, int width, int height)
+{
+    if(texture == NULL)
+        return;
+
+    std::map<SDL_Texture*, Image>::iterator it = images.find(texture);
+    if(it == images.end())
+    {
+        int w,h;
+        SDL_QueryTexture(texture,NULL,NULL,&w,&h);
+        Image image;
+        image.surface = mem_track_surface(SDL_CreateRGBSurfaceWithFormat(0,w,h,32,SDL_PIXELFORMAT_ARGB8888),"compositor copy");
+        image.opaque = false;
+        if(image.surface == NULL)
+            return;
+        it = images.insert(std::make_pair(texture,image)).first;
+    }
+
+    Image &image = it->second;
+    if(width > image.surface->w)
+        width = image.surface->w;
+    if(height > image.surface->h)
+        height = image.surface->h;
+
+    //Textures without blending, or whose pixels are all opaque, are copied instead of blended
+    SDL_BlendMode mode = SDL_BLENDMODE_BLEND;
+    SDL_GetTextureBlendMode(texture,&mode);
+    Uint32 alpha = 0xFF000000;
+    for(int y = 0; y < height && pixels != NULL; ++y)
+    {
+        const Uint32 *in = (const Uint32*)((const Uint8*)pixels + y*pitch);
+        Uint32 *out = (Uint32*)((Uint8*)image.surface->pixels + y*image.surface->pitch);
+        memcpy(out,in,width*4);
+        for(int x = 0; x < width; ++x)
+            alpha &= in[x];
+    }
+    image.opaque = mode == SDL_BLENDMODE_NONE || (pixels != NULL && (alpha & 0xFF000000) == 0xFF000000);
+}
+
+void Compositor::update(SDL_Texture *texture, SDL_Surface *surface)
+{
+    if(surface == NULL)
+        return;
+
+    SDL_Surface *converted = surface;
+    if(surface->format->format != SDL_PIXELFORMAT_ARGB8888)
+        converted = SDL_ConvertSurfaceFormat(surface,SDL_PIXELFORMAT_ARGB8888,0);
+    if(converted == NULL)
+        return;
+
+    SDL_LockSurface(converted);
+    update(texture,converted->pixels,converted->pitch,converted->w,converted->h);
+    SDL_UnlockSurface(converted);
+    if(converted != surface)
+        SDL_FreeSurface(converted);
+}
+
+void Compositor::forget(SDL_Texture *texture)
+{
+    std::map<SDL_Texture*, Image>::iterator it = images.find(texture);
+    if(it != images.end())
+    {
+        mem_free_surface(it->second.surface);
+        images.erase(it);
+    }
+}
+
+void Compositor::compose_band(void *data, int index)
+{
+    Compositor *compositor = (Compositor*)data;
+    int height = compositor->drawn.h;
+    compositor->compose_rows(height*index/COMPOSITOR_BANDS,height*(index+1)/COMPOSITOR_BANDS);
+}
+
+//Every band walks the whole command list, so overlapping draws keep their order
+void Compositor::compose_rows(int rowStart, int rowEnd)
+{
+    for(int y = rowStart; y < rowEnd; ++y)
+    {
+        Uint32 *row = (Uint32*)((Uint8*)framebuffer->pixels + y*framebuffer->pitch);
+        for(int x = 0; x < drawn.w; ++x)
+            row[x] = clearColor;
+    }
+
+    for(unsigned int c = 0; c < frame->commands.size(); ++c)
+    {
+        const DrawCommand &command = frame->commands[c];
+        std::map<SDL_Texture*, Image>::iterator it = images.find(command.texture);
+        if(it == images.end())
+            continue;
+        const Image &image = it->second;
+
+        SDL_Rect source = command.source;
+        if(command.wholeTexture)
+        {
+            source.x = 0;
+            source.y = 0;
+            source.w = image.surface->w;
+            source.h = image.surface->h;
+        }
+        if(source.w <= 0 || source.h <= 0)
+            continue;
+
+        int left = (int)floorf(command.destination.x*scale);
+        int top = (int)floorf(command.destination.y*scale);
+        int right = (int)floorf((command.destination.x + command.destination.w)*scale);
+        int bottom = (int)floorf((command.destination.y + command.destination.h)*scale);
+        if(right <= left || bottom <= top)
+            continue;
+
+        Uint32 stepX = (Uint32)(((Uint64)source.w << 16)/(right - left));
+        Uint32 stepY = (Uint32)(((Uint64)source.h << 16)/(bottom - top));
+
+        int clipLeft = left > 0 ? left : 0;
+        int clipRight = right < drawn.w ? right : drawn.w;
+        int clipTop = top > rowStart ? top : rowStart;
+        int clipBottom = bottom < rowEnd ? bottom : rowEnd;
+        if(clipRight <= clipLeft || clipBottom <= clipTop)
+            continue;
+
+        Uint32 fx = (clipLeft - left)*stepX + stepX/2;
+        BlendRow kernel = image.opaque ? copyRow : blendRow;
+        for(int y = clipTop; y < clipBottom; ++y)
+        {
+            int sourceY = source.y + (int)((((Uint64)(y - top)*stepY) + stepY/2) >> 16);
+            const Uint32 *in = (const Uint32*)((const Uint8*)image.surface->pixels + sourceY*image.surface->pitch) + source.x;
+            Uint32 *out = (Uint32*)((Uint8*)framebuffer->pixels + y*framebuffer->pitch) + clipLeft;
+            kernel(out,in,clipRight - clipLeft,fx,stepX);
+        }
+    }
+}
+
+void Compositor::draw(const FrameSnapshot &frame, float scale, SDL_Color color)
+{
+    this->frame = &frame;
+    this->scale = scale;
+    clearColor = 0xFF000000 | (color.r << 16) | (color.g << 8) | color.b;
+
+    drawn.x = 0;
+    drawn.y = 0;
+    drawn.w = (int)(framebuffer->w*scale + 0.5f);
+    drawn.h = (int)(framebuffer->h*scale + 0.5f);
+
+    jobs_parallel_for(compose_band,this,COMPOSITOR_BANDS);
+
+    SDL_UpdateTexture(stream,&drawn,framebuffer->pixels,framebuffer->pitch);
+    SDL_RenderCopy(renderer,stream,&drawn,NULL);
+    this->frame = NULL;
+}
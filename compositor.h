@@ -0,0 +1,58 @@
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include <SDL2/SDL.h>
+#include <map>
+#include "snapshot.h"
+
+//Draws frames on the CPU for machines where SDL falls back to its software
+//renderer. Every texture keeps a copy of its pixels here, a frame's draw
+//commands are blended into one framebuffer split into bands across the job
+//pool, and the result is uploaded once through a streaming texture.
+//Scaling is nearest neighbour like SDL's software renderer, blending is
+//SDL_BLENDMODE_BLEND, rows are done 8 pixels at a time with AVX2 or 4 with
+//SSE2, whichever the CPU has.
+class Compositor
+{
+    public:
+        Compositor(SDL_Renderer *renderer, int width, int height);
+        ~Compositor();
+
+        //Copies width x height ARGB8888 pixels into the texture's copy, starting at
+        //its top left. pixels may be NULL to only register the texture.
+        void update(SDL_Texture *texture, const void *pixels, int pitch, int width, int height);
+        void update(SDL_Texture *texture, SDL_Surface *surface);
+
+        //Drops the copy, called for every texture destroyed
+        void forget(SDL_Texture *texture);
+
+        //Clears to color, blends the frame in at scale (framebuffer pixels per
+        //layout unit) and copies it over the whole current render target
+        void draw(const FrameSnapshot &frame, float scale, SDL_Color color);
+
+        //"avx2", "sse2" or "scalar"
+        const char *kernel_name();
+
+    private:
+        struct Image
+        {
+            SDL_Surface *surface;
+            bool opaque;
+        };
+
+        static void compose_band(void *data, int index);
+        void compose_rows(int rowStart, int rowEnd);
+
+        SDL_Renderer *renderer;
+        SDL_Texture *stream;
+        SDL_Surface *framebuffer;
+        std::map<SDL_Texture*, Image> images;
+
+        //The frame being drawn, read by the bands
+        const FrameSnapshot *frame;
+        float scale;
+        Uint32 clearColor;
+        SDL_Rect drawn;
+};
+
+#endif // COMPOSITOR_H
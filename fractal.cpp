@@ -0,0 +1,72 @@
+#include "fractal.h"
+
+const char *FRACTAL_TYPE_NAMES[FRACTAL_TYPE_COUNT] = {"mandelbrot","julia","burning_ship","multibrot3","multibrot4"};
+const char *FRACTAL_PRECISION_NAMES[FRACTAL_PRECISION_COUNT] = {"float","double","double_double"};
+const char *FRACTAL_COLORING_NAMES[FRACTAL_COLORING_COUNT] = {"banded","smooth"};
+
+template<class Formula, class Real>
+static FractalKernel kernel_for_coloring(FractalColoring coloring)
+{
+    switch(coloring)
+    {
+        case COLORING_SMOOTH: return fractal_kernel<Formula,Real,SmoothColoring>;
+        default: return fractal_kernel<Formula,Real,BandedColoring>;
+    }
+}
+
+template<class Formula>
+static FractalKernel kernel_for_precision(FractalPrecision precision, FractalColoring coloring)
+{
+    switch(precision)
+    {
+        case PRECISION_DOUBLE: return kernel_for_coloring<Formula,double>(coloring);
+        case PRECISION_DOUBLE_DOUBLE: return kernel_for_coloring<Formula,DoubleDouble>(coloring);
+        default: return kernel_for_coloring<Formula,float>(coloring);
+    }
+}
+
+FractalKernel get_fractal_kernel(FractalType type, FractalPrecision precision, FractalColoring coloring)
+{
+    switch(type)
+    {
+        case FRACTAL_JULIA: return kernel_for_precision<JuliaFormula>(precision,coloring);
+        case FRACTAL_BURNING_SHIP: return kernel_for_precision<BurningShipFormula>(precision,coloring);
+        case FRACTAL_MULTIBROT3: return kernel_for_precision<MultibrotFormula<3> >(precision,coloring);
+        case FRACTAL_MULTIBROT4: return kernel_for_precision<MultibrotFormula<4> >(precision,coloring);
+        default: return kernel_for_precision<MandelbrotFormula>(precision,coloring);
+    }
+}
+
+template<class Formula, class Coloring>
+static FractalKernel storing_kernel_for_precision(FractalPrecision precision)
+{
+    switch(precision)
+    {
+        case PRECISION_DOUBLE: return fractal_kernel<Formula,double,Coloring>;
+        case PRECISION_DOUBLE_DOUBLE: return fractal_kernel<Formula,DoubleDouble,Coloring>;
+        default: return fractal_kernel<Formula,float,Coloring>;
+    }
+}
+
+template<class Coloring>
+static FractalKernel storing_kernel(FractalType type, FractalPrecision precision)
+{
+    switch(type)
+    {
+        case FRACTAL_JULIA: return storing_kernel_for_precision<JuliaFormula,Coloring>(precision);
+        case FRACTAL_BURNING_SHIP: return storing_kernel_for_precision<BurningShipFormula,Coloring>(precision);
+        case FRACTAL_MULTIBROT3: return storing_kernel_for_precision<MultibrotFormula<3>,Coloring>(precision);
+        case FRACTAL_MULTIBROT4: return storing_kernel_for_precision<MultibrotFormula<4>,Coloring>(precision);
+        default: return storing_kernel_for_precision<MandelbrotFormula,Coloring>(precision);
+    }
+}
+
+FractalKernel get_iteration_kernel(FractalType type, FractalPrecision precision)
+{
+    return storing_kernel<IterationColoring>(type,precision);
+}
+
+FractalKernel get_escape_kernel(FractalType type, FractalPrecision precision)
+{
+    return storing_kernel<EscapeColoring>(type,precision);
+}
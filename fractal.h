@@ -0,0 +1,331 @@
+#ifndef FRACTAL_H
+#define FRACTAL_H
+
+#include <SDL2/SDL.h>
+#include <cmath>
+
+//Escape-time fractal kernels. The formula, number type and coloring are
+//template parameters, so each combination is compiled into its own inner
+//loop with no virtual calls or per-pixel branches on the fractal type.
+//Pick an instantiation once per pass with get_fractal_kernel().
+
+//------------------ Number types  -------------------------
+
+//Unevaluated sum of two doubles, about 106 bits of mantissa
+struct DoubleDouble
+{
+    double hi;
+    double lo;
+
+    DoubleDouble() {hi = 0.0; lo = 0.0;};
+    DoubleDouble(double value) {hi = value; lo = 0.0;};
+    DoubleDouble(double h, double l) {hi = h; lo = l;};
+};
+
+inline DoubleDouble two_sum(double a, double b)
+{
+    double s = a + b;
+    double v = s - a;
+    return DoubleDouble(s,(a - (s - v)) + (b - v));
+}
+
+inline DoubleDouble quick_two_sum(double a, double b)
+{
+    double s = a + b;
+    return DoubleDouble(s,b - (s - a));
+}
+
+inline DoubleDouble operator+(DoubleDouble a, DoubleDouble b)
+{
+    DoubleDouble s = two_sum(a.hi,b.hi);
+    DoubleDouble t = two_sum(a.lo,b.lo);
+    s.lo += t.hi;
+    s = quick_two_sum(s.hi,s.lo);
+    s.lo += t.lo;
+    return quick_two_sum(s.hi,s.lo);
+}
+
+inline DoubleDouble operator-(DoubleDouble a)
+{
+    return DoubleDouble(-a.hi,-a.lo);
+}
+
+inline DoubleDouble operator-(DoubleDouble a, DoubleDouble b)
+{
+    return a + (-b);
+}
+
+inline DoubleDouble operator*(DoubleDouble a, DoubleDouble b)
+{
+    double p = a.hi*b.hi;
+    double e = fma(a.hi,b.hi,-p);
+    e += a.hi*b.lo + a.lo*b.hi;
+    return quick_two_sum(p,e);
+}
+
+inline double to_double(float a) {return a;}
+inline double to_double(double a) {return a;}
+inline double to_double(DoubleDouble a) {return a.hi + a.lo;}
+
+inline float fractal_abs(float a) {return fabsf(a);}
+inline double fractal_abs(double a) {return fabs(a);}
+inline DoubleDouble fractal_abs(DoubleDouble a) {return a.hi < 0.0 ? -a : a;}
+
+//------------------ Formulas  -------------------------
+
+//z = z^2 + c, starting from z = 0 with c at the pixel
+struct MandelbrotFormula
+{
+    template<class Real>
+    static inline void start(Real px, Real py, Real jx, Real jy, Real &x, Real &y, Real &cx, Real &cy)
+    {
+        x = Real(0);
+        y = Real(0);
+        cx = px;
+        cy = py;
+    }
+
+    template<class Real>
+    static inline void step(Real &x, Real &y, Real cx, Real cy)
+    {
+        Real xTemp = x*x - y*y + cx;
+        y = Real(2)*x*y + cy;
+        x = xTemp;
+    }
+};
+
+//z = z^2 + c, starting from z at the pixel with a fixed c
+struct JuliaFormula
+{
+    template<class Real>
+    static inline void start(Real px, Real py, Real jx, Real jy, Real &x, Real &y, Real &cx, Real &cy)
+    {
+        x = px;
+        y = py;
+        cx = jx;
+        cy = jy;
+    }
+
+    template<class Real>
+    static inline void step(Real &x, Real &y, Real cx, Real cy)
+    {
+        MandelbrotFormula::step(x,y,cx,cy);
+    }
+};
+
+//z = (|Re z| + i|Im z|)^2 + c
+struct BurningShipFormula
+{
+    template<class Real>
+    static inline void start(Real px, Real py, Real jx, Real jy, Real &x, Real &y, Real &cx, Real &cy)
+    {
+        MandelbrotFormula::start(px,py,jx,jy,x,y,cx,cy);
+    }
+
+    template<class Real>
+    static inline void step(Real &x, Real &y, Real cx, Real cy)
+    {
+        Real xTemp = x*x - y*y + cx;
+        y = fractal_abs(Real(2)*x*y) + cy;
+        x = xTemp;
+    }
+};
+
+//z^N by repeated multiplication, unrolled at compile time
+template<int N>
+struct ComplexPower
+{
+    template<class Real>
+    static inline void apply(Real x, Real y, Real &rx, Real &ry)
+    {
+        Real px,py;
+        ComplexPower<N-1>::apply(x,y,px,py);
+        rx = px*x - py*y;
+        ry = px*y + py*x;
+    }
+};
+
+template<>
+struct ComplexPower<1>
+{
+    template<class Real>
+    static inline void apply(Real x, Real y, Real &rx, Real &ry)
+    {
+        rx = x;
+        ry = y;
+    }
+};
+
+//z = z^N + c
+template<int N>
+struct MultibrotFormula
+{
+    template<class Real>
+    static inline void start(Real px, Real py, Real jx, Real jy, Real &x, Real &y, Real &cx, Real &cy)
+    {
+        MandelbrotFormula::start(px,py,jx,jy,x,y,cx,cy);
+    }
+
+    template<class Real>
+    static inline void step(Real &x, Real &y, Real cx, Real cy)
+    {
+        Real rx,ry;
+        ComplexPower<N>::apply(x,y,rx,ry);
+        x = rx + cx;
+        y = ry + cy;
+    }
+};
+
+//------------------ Coloring  -------------------------
+
+//The original look: channels wrap at it*200, it*100, it*50
+struct BandedColoring
+{
+    static inline Uint32 color(int it, int maxIt, double magnitudeSqr)
+    {
+        Uint8 r = it*200;
+        Uint8 g = it*100;
+        Uint8 b = it*50;
+        return 0xFF000000 | (r << 16) | (g << 8) | b;
+    }
+};
+
+//Continuous escape count through a smooth palette, interior is black
+struct SmoothColoring
+{
+    static inline Uint32 color(int it, int maxIt, double magnitudeSqr)
+    {
+        if(it > maxIt)
+        {
+            return 0xFF000000;
+        }
+        double mu = it + 1.0 - log2(log(magnitudeSqr > 4.0 ? magnitudeSqr : 4.0)*0.5);
+        double t = mu*0.15;
+        Uint8 r = 127.5 + 127.5*sin(t);
+        Uint8 g = 127.5 + 127.5*sin(t + 2.094);
+        Uint8 b = 127.5 + 127.5*sin(t + 4.188);
+        return 0xFF000000 | (r << 16) | (g << 8) | b;
+    }
+};
+
+//Stores the escape count instead of a color, maxIt+1 where the point never escapes
+struct IterationColoring
+{
+    static inline Uint32 color(int it, int maxIt, double magnitudeSqr)
+    {
+        return it < 0 ? 0 : it > maxIt ? maxIt + 1 : it;
+    }
+};
+
+//Stores it << 8 | nu*128 for a FractalPalette to color later, where it + nu
+//is the continuous count SmoothColoring uses and nu is clamped to [0,2).
+//Points that never escape store maxIt+1 with no fraction.
+struct EscapeColoring
+{
+    static inline Uint32 color(int it, int maxIt, double magnitudeSqr)
+    {
+        if(it > maxIt)
+        {
+            return (Uint32)(maxIt + 1) << 8;
+        }
+        double nu = 1.0 - log2(log(magnitudeSqr > 4.0 ? magnitudeSqr : 4.0)*0.5);
+        int fraction = (int)(nu*128.0);
+        fraction = fraction < 0 ? 0 : fraction > 255 ? 255 : fraction;
+        return ((Uint32)(it < 0 ? 0 : it) << 8) | fraction;
+    }
+};
+
+//------------------ Kernels  -------------------------
+
+//Region of the plane and iteration cap for one pass
+struct FractalView
+{
+    double centerX;
+    double centerY;
+    double pixelSize;
+    double juliaX;
+    double juliaY;
+    int maxIt;
+};
+
+//Fills rows [rowStart,rowEnd) of a width x height ARGB8888 image, returns the iterations run
+typedef Uint64 (*FractalKernel)(const FractalView &view, Uint32 *pixels, int pitch, int width, int height, int rowStart, int rowEnd);
+
+template<class Formula, class Real, class Coloring>
+Uint64 fractal_kernel(const FractalView &view, Uint32 *pixels, int pitch, int width, int height, int rowStart, int rowEnd)
+{
+    const Real pixelSize = Real(view.pixelSize);
+    const Real left = Real(view.centerX) - Real(width/2)*pixelSize;
+    const Real top = Real(view.centerY) - Real(height/2)*pixelSize;
+    const Real jx = Real(view.juliaX);
+    const Real jy = Real(view.juliaY);
+    const int maxIt = view.maxIt;
+    Uint64 iterations = 0;
+
+    for(int j = rowStart; j < rowEnd; ++j)
+    {
+        Uint32 *row = (Uint32*)((Uint8*)pixels + j*pitch);
+        const Real py = top + Real(j)*pixelSize;
+
+        for(int i = 0; i < width; ++i)
+        {
+            const Real px = left + Real(i)*pixelSize;
+
+            Real x,y,cx,cy;
+            Formula::start(px,py,jx,jy,x,y,cx,cy);
+
+            int it = -1;
+            double magnitudeSqr = to_double(x*x + y*y);
+            while(it <= maxIt && magnitudeSqr <= 4.0)
+            {
+                it++;
+                Formula::step(x,y,cx,cy);
+                magnitudeSqr = to_double(x*x + y*y);
+            }
+
+            row[i] = Coloring::color(it,maxIt,magnitudeSqr);
+            iterations += it + 1;
+        }
+    }
+    return iterations;
+}
+
+enum FractalType
+{
+    FRACTAL_MANDELBROT,
+    FRACTAL_JULIA,
+    FRACTAL_BURNING_SHIP,
+    FRACTAL_MULTIBROT3,
+    FRACTAL_MULTIBROT4,
+    FRACTAL_TYPE_COUNT
+};
+
+enum FractalPrecision
+{
+    PRECISION_FLOAT,
+    PRECISION_DOUBLE,
+    PRECISION_DOUBLE_DOUBLE,
+    FRACTAL_PRECISION_COUNT
+};
+
+enum FractalColoring
+{
+    COLORING_BANDED,
+    COLORING_SMOOTH,
+    FRACTAL_COLORING_COUNT
+};
+
+extern const char *FRACTAL_TYPE_NAMES[FRACTAL_TYPE_COUNT];
+extern const char *FRACTAL_PRECISION_NAMES[FRACTAL_PRECISION_COUNT];
+extern const char *FRACTAL_COLORING_NAMES[FRACTAL_COLORING_COUNT];
+
+//Returns the compiled kernel for a combination
+FractalKernel get_fractal_kernel(FractalType type, FractalPrecision precision, FractalColoring coloring);
+
+//Returns a kernel that writes escape counts (see IterationColoring) instead of colors
+FractalKernel get_iteration_kernel(FractalType type, FractalPrecision precision);
+
+//Returns a kernel that writes escape values for a FractalPalette (see EscapeColoring)
+FractalKernel get_escape_kernel(FractalType type, FractalPrecision precision);
+
+#endif // FRACTAL_H
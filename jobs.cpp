@@ -0,0 +1,217 @@
+#include "jobs.h"
+#include <SDL2/SDL.h>
+#include <vector>
+
+static std::vector<SDL_Thread*> workers;
+static SDL_mutex *lock = NULL;
+static SDL_cond *workReady = NULL;
+static SDL_cond *workDone = NULL;
+
+//Held by a caller of jobs_parallel_for for the whole loop, there is one job slot
+static SDL_mutex *callerLock = NULL;
+
+//The loop currently being run, guarded by lock
+static JobFunction jobFunction = NULL;
+static void *jobData = NULL;
+static int jobCount = 0;
+static int generation = 0;
+static int busyWorkers = 0;
+static bool quitting = false;
+
+//Next index to hand out, taken without the lock
+static SDL_atomic_t nextIndex;
+
+static void run_indices(JobFunction function, void *data, int count)
+{
+    while(true)
+    {
+        int index = SDL_AtomicAdd(&nextIndex,1);
+        if(index >= count)
+            break;
+        function(data,index);
+    }
+}
+
+static int worker_main(void *unused)
+{
+    int seen = 0;
+    SDL_LockMutex(lock);
+    while(true)
+    {
+        while(!quitting && generation == seen)
+        {
+            SDL_CondWait(workReady,lock);
+        }
+        if(quitting)
+            break;
+
+        seen = generation;
+        JobFunction function = jobFunction;
+        void *data = jobData;
+        int count = jobCount;
+        busyWorkers++;
+        SDL_UnlockMutex(lock);
+
+        run_indices(function,data,count);
+
+        SDL_LockMutex(lock);
+        busyWorkers--;
+        if(busyWorkers == 0)
+            SDL_CondBroadcast(workDone);
+    }
+    SDL_UnlockMutex(lock);
+    return 0;
+}
+
+void jobs_init(int threads)
+{
+    if(lock != NULL)
+        return;
+
+    if(threads <= 0)
+        threads = SDL_GetCPUCount();
+
+    lock = SDL_CreateMutex();
+    callerLock = SDL_CreateMutex();
+    workReady = SDL_CreateCond();
+    workDone = SDL_CreateCond();
+    quitting = false;
+    SDL_AtomicSet(&nextIndex,0);
+
+    //The caller of jobs_parallel_for is one of the threads
+    for(int i = 1; i < threads; ++i)
+    {
+        workers.push_back(SDL_CreateThread(worker_main,"worker",NULL));
+    }
+}
+
+void jobs_quit()
+{
+    if(lock == NULL)
+        return;
+
+    SDL_LockMutex(lock);
+    quitting = true;
+    SDL_CondBroadcast(workReady);
+    SDL_UnlockMutex(lock);
+
+    for(unsigned int i = 0; i < workers.size(); ++i)
+    {
+        SDL_WaitThread(workers[i],NULL);
+    }
+    workers.clear();
+
+    SDL_DestroyCond(workDone);
+    SDL_DestroyCond(workReady);
+    SDL_DestroyMutex(lock);
+    SDL_DestroyMutex(callerLock);
+    lock = NULL;
+    callerLock = NULL;
+}
+
+int jobs_thread_count()
+{
+    return workers.size() + 1;
+}
+
+void jobs_parallel_for(JobFunction function, void *data, int count)
+{
+    if(lock == NULL || workers.empty() || count <= 1)
+    {
+        for(int i = 0; i < count; ++i)
+            function(data,i);
+        return;
+    }
+
+    //With --threaded the render and simulation threads both run loops, the
+    //second one waits here rather than overwrite the loop in progress
+    SDL_LockMutex(callerLock);
+    SDL_LockMutex(lock);
+    //A worker still leaving the previous loop must not pick indices from this one
+    while(busyWorkers > 0)
+    {
+        SDL_CondWait(workDone,lock);
+    }
+    jobFunction = function;
+    jobData = data;
+    jobCount = count;
+    SDL_AtomicSet(&nextIndex,0);
+    generation++;
+    SDL_CondBroadcast(workReady);
+    SDL_UnlockMutex(lock);
+
+    run_indices(function,data,count);
+
+    SDL_LockMutex(lock);
+    while(busyWorkers > 0)
+    {
+        SDL_CondWait(workDone,lock);
+    }
+    SDL_UnlockMutex(lock);
+    SDL_UnlockMutex(callerLock);
+}
+
+BackgroundTask::BackgroundTask()
+{
+    thread = NULL;
+    function = NULL;
+    data = NULL;
+    SDL_AtomicSet(&done,0);
+    SDL_AtomicSet(&stop,0);
+}
+
+BackgroundTask::~BackgroundTask()
+{
+    cancel();
+}
+
+int BackgroundTask::thread_main(void *task)
+{
+    BackgroundTask *background = (BackgroundTask*)task;
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_LOW);
+    background->function(background->data,0);
+    SDL_AtomicSet(&background->done,1);
+    return 0;
+}
+
+void BackgroundTask::start(JobFunction function, void *data)
+{
+    if(thread != NULL)
+        return;
+
+    this->function = function;
+    this->data = data;
+    SDL_AtomicSet(&done,0);
+    SDL_AtomicSet(&stop,0);
+    thread = SDL_CreateThread(thread_main,"background",this);
+}
+
+void BackgroundTask::cancel()
+{
+    SDL_AtomicSet(&stop,1);
+    wait();
+}
+
+void BackgroundTask::wait()
+{
+    if(thread == NULL)
+        return;
+
+    SDL_WaitThread(thread,NULL);
+    thread = NULL;
+}
+
+bool BackgroundTask::running()
+{
+    return thread != NULL && !SDL_AtomicGet(&done);
+}
+
+bool BackgroundTask::finished()
+{
+    return SDL_AtomicGet(&done) && !SDL_AtomicGet(&stop);
+}
+
+bool BackgroundTask::cancelled()
+{
+    return SDL_AtomicGet(&stop) != 0;
+}
@@ -0,0 +1,53 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <SDL2/SDL.h>
+
+//A pool of worker threads, one per core, that split loops between them
+
+typedef void (*JobFunction)(void *data, int index);
+
+//Starts the workers, threads <= 0 means one per core
+void jobs_init(int threads);
+void jobs_quit();
+
+//Number of threads that run a parallel_for, including the caller
+int jobs_thread_count();
+
+//Calls function(data,i) for every i in [0,count) and returns when all are done.
+//The calling thread works too, so this is safe to call before jobs_init().
+//Calls from different threads take turns; a job must not start a loop of its own.
+void jobs_parallel_for(JobFunction function, void *data, int count);
+
+//Work started speculatively on its own low priority thread. The function
+//should check cancelled() now and then and return early when it is set.
+class BackgroundTask
+{
+    public:
+        BackgroundTask();
+        ~BackgroundTask();
+
+        //Does nothing if the task is already running
+        void start(JobFunction function, void *data);
+
+        //Asks the function to stop and waits for it
+        void cancel();
+
+        //Waits for the function to return
+        void wait();
+
+        bool running();
+        bool finished();
+        bool cancelled();
+
+    private:
+        static int thread_main(void *task);
+
+        SDL_Thread *thread;
+        JobFunction function;
+        void *data;
+        SDL_atomic_t done;
+        SDL_atomic_t stop;
+};
+
+#endif // JOBS_H
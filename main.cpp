@@ -8,7 +8,23 @@
 #include <ctime>
 #include <cmath>
 #include "vec2d.h"
+#include "memtrack.h"
+#include "alloctrack.h"
+#include "assetpack.h"
+#include "resolution.h"
+#include "fractal.h"
+#include "palette.h"
+#include "jobs.h"
+#include "snapshot.h"
+#include "resample.h"
+#include "compositor.h"
+#include "netrender.h"
+#include "task.h"
+#include "capture.h"
+#include "buddhabrot.h"
+#include <map>
 #include <cstdlib>
+#include <cstring>
 
 SDL_Window *window = NULL;
 SDL_Renderer *renderer = NULL;
@@ -17,6 +33,35 @@ SDL_Renderer *renderer = NULL;
 const int SCREEN_WIDTH = 1280;
 const int SCREEN_HEIGHT = 1024;
 
+//Screens draw here at resolution.scale, then it is stretched to the window
+SDL_Texture *sceneTarget = NULL;
+ResolutionController resolution;
+
+//Render scale the screens compute and record their frames for. The render
+//thread owns resolution; with --threaded it publishes the scale into
+//publishedScale after every frame and the simulation copies it here at the
+//start of a tick, so a tick and its snapshot use one value. Otherwise the
+//main loop copies it after every frame.
+float tickScale = 1.0f;
+SDL_atomic_t publishedScale;
+
+//Scale the frame between begin_scene() and end_scene() is drawn at
+float sceneScale = 1.0f;
+
+//Set with --compositor: frames are blended on the CPU instead of by the renderer,
+//for machines where SDL only has its software renderer (forced with --software)
+bool useCompositor = false;
+bool softwareRenderer = false;
+Compositor *compositor = NULL;
+
+//What the compositor draws at end_scene(), the frame recorded since begin_scene()
+//or the snapshot handed to draw_snapshot()
+FrameSnapshot compositorFrame;
+const FrameSnapshot *compositorSource = NULL;
+
+//Set with --capture, records every frame end_scene() finishes
+FrameCapture *frameCapture = NULL;
+
 SDL_Texture *hatchTexture = NULL;
 SDL_Texture *buttonOut = NULL;
 SDL_Texture *buttonIn = NULL;
@@ -39,9 +84,103 @@ SDL_Texture *cppTexture;
 
 TTF_Font *berbas = NULL;
 
+//Set while --pack runs, every image and label loaded is added to it
+PackWriter *packWriter = NULL;
+
+
+//------------------ Threading  -------------------------
+
+//Set with --threaded: a simulation thread runs the screens at a fixed tick
+//and the main thread only pumps events and draws the snapshots it publishes
+bool threaded = false;
+SDL_threadID renderThread = 0;
+
+//Set while draw() is recorded into a snapshot instead of drawn, see render_texture
+thread_local FrameSnapshot *recording = NULL;
+
+//Bumped by every render call, snapshots recorded before it may use freed textures
+SDL_atomic_t resourceEpoch;
+
+SDL_mutex *renderCallLock = NULL;
+SDL_cond *renderCallDone = NULL;
+void (*pendingCall)(void *data) = NULL;
+void *pendingData = NULL;
+const char *pendingScreen = NULL;
+const char *pendingExempt = NULL;
+
+bool on_render_thread()
+{
+    return !threaded || SDL_ThreadID() == renderThread;
+}
+
+//The render scale in 1/65536ths, see tickScale
+void publish_scale(float scale)
+{
+    SDL_AtomicSet(&publishedScale,(int)(scale*65536.0f + 0.5f));
+}
+
+float published_scale()
+{
+    return SDL_AtomicGet(&publishedScale)/65536.0f;
+}
+
+//Runs function on the thread that owns the renderer and waits for it to finish
+void render_call_function(void (*function)(void *data), void *data)
+{
+    if(on_render_thread())
+    {
+        function(data);
+        return;
+    }
+    SDL_LockMutex(renderCallLock);
+    pendingCall = function;
+    pendingData = data;
+    pendingScreen = mem_get_screen();
+    pendingExempt = alloc_get_exempt();
+    while(pendingCall != NULL)
+    {
+        SDL_CondWait(renderCallDone,renderCallLock);
+    }
+    SDL_UnlockMutex(renderCallLock);
+}
+
+template<class Function>
+void call_function(void *function)
+{
+    (*(Function*)function)();
+}
+
+//Anything that creates, changes or frees textures from update() or draw() goes through here
+template<class Function>
+void render_call(Function function)
+{
+    render_call_function(call_function<Function>,&function);
+}
+
+//Called by the render thread between frames
+void run_render_calls()
+{
+    SDL_LockMutex(renderCallLock);
+    if(pendingCall != NULL)
+    {
+        MemScope scope(pendingScreen);
+        AllocExempt exempt(pendingExempt);
+        pendingCall(pendingData);
+        SDL_AtomicAdd(&resourceEpoch,1);
+        pendingCall = NULL;
+        SDL_CondBroadcast(renderCallDone);
+    }
+    SDL_UnlockMutex(renderCallLock);
+}
+
+void forget_composited(SDL_Texture *texture)
+{
+    if(compositor != NULL)
+        compositor->forget(texture);
+}
 
 //Initializes SDL2, Creates a window
-bool init()
+bool init(bool windowed)
 {
     SDL_Init(SDL_INIT_VIDEO);
 
@@ -49,19 +188,248 @@ bool init()
 
     TTF_Init();
 
-    window = SDL_CreateWindow("OpenGl", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT,SDL_WINDOW_FULLSCREEN);
-    renderer = SDL_CreateRenderer(window,-1,SDL_RENDERER_ACCELERATED);
+    jobs_init(0);
+
+    renderThread = SDL_ThreadID();
+    renderCallLock = SDL_CreateMutex();
+    renderCallDone = SDL_CreateCond();
+
+    window = SDL_CreateWindow("OpenGl", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT,windowed ? SDL_WINDOW_RESIZABLE : SDL_WINDOW_FULLSCREEN);
 
     if(window == NULL)
     {
         printf("Failed to create window.\n");
         return false;
     }
+
+    renderer = SDL_CreateRenderer(window,-1,(softwareRenderer ? SDL_RENDERER_SOFTWARE : SDL_RENDERER_ACCELERATED) | SDL_RENDERER_TARGETTEXTURE);
+
+    if(renderer == NULL)
+    {
+        printf("Failed to create renderer.\n");
+        return false;
+    }
+
+    //Layout is in SCREEN_WIDTH x SCREEN_HEIGHT units whatever the window size
+    SDL_RenderSetLogicalSize(renderer,SCREEN_WIDTH,SCREEN_HEIGHT);
+
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY,"1");
+    if(SDL_RenderTargetSupported(renderer))
+    {
+        sceneTarget = mem_track_texture(SDL_CreateTexture(renderer,SDL_PIXELFORMAT_ARGB8888,SDL_TEXTUREACCESS_TARGET,SCREEN_WIDTH,SCREEN_HEIGHT),"scene target");
+    }
+    if(sceneTarget == NULL)
+    {
+        printf("Render targets unavailable, dynamic resolution disabled\n");
+        resolution.enabled = false;
+    }
+
+    if(useCompositor)
+    {
+        compositor = new Compositor(renderer,SCREEN_WIDTH,SCREEN_HEIGHT);
+        mem_set_texture_destroy_hook(forget_composited);
+    }
+
+    return true;
+}
+
+//Shuts down everything init() started
+void quit()
+{
+    mem_destroy_texture(sceneTarget);
+    delete compositor;
+    compositor = NULL;
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+
+    jobs_quit();
+
+    SDL_DestroyCond(renderCallDone);
+    SDL_DestroyMutex(renderCallLock);
+
+    IMG_Quit();
+    TTF_Quit();
+    SDL_Quit();
+}
+
+//------------------ Images  -------------------------
+
+//Smaller copies of a loaded image, each half the size of the one before, used
+//when it is drawn well below its stored size (the render scale shrinks everything)
+std::map<SDL_Texture*, std::vector<SDL_Texture*> > mipChains;
+
+//An image too large for one texture, split into a grid of tiles drawn side by side
+struct TiledTexture
+{
+    int width;
+    int height;
+    int tileSize;
+    int columns;
+    std::vector<SDL_Texture*> tiles;
+};
+
+//Keyed by the first tile, which load_texture() returns as the image's handle
+std::map<SDL_Texture*, TiledTexture> tiledTextures;
+
+//Set with --max-texture-size, otherwise the renderer's limit
+int maxTextureSize = 0;
+
+//Smallest mip level drawn
+const int MIP_MIN_SIZE = 16;
+
+//Pixels per layout unit an image can end up drawn at
+float image_scale()
+{
+    if(sceneTarget != NULL)
+        return 1.0f;
+
+    int outputWidth,outputHeight;
+    SDL_GetRendererOutputSize(renderer,&outputWidth,&outputHeight);
+    float scale = fmaxf((float)outputWidth/SCREEN_WIDTH,(float)outputHeight/SCREEN_HEIGHT);
+    return scale > 1.0f ? scale : 1.0f;
+}
+
+int max_texture_size()
+{
+    if(maxTextureSize > 0)
+        return maxTextureSize;
+
+    SDL_RendererInfo info;
+    if(SDL_GetRendererInfo(renderer,&info) != 0 || info.max_texture_width <= 0)
+        return 16384;
+    return info.max_texture_width < info.max_texture_height ? info.max_texture_width : info.max_texture_height;
+}
+
+//Uploads width x height pixels starting at pixels, tracked under owner
+SDL_Texture *create_static_texture(const void *pixels, int pitch, int width, int height, const std::string &owner)
+{
+    SDL_Texture *texture = SDL_CreateTexture(renderer,PACK_PIXEL_FORMAT,SDL_TEXTUREACCESS_STATIC,width,height);
+    if(texture == NULL)
+    {
+        return NULL;
+    }
+    SDL_UpdateTexture(texture,NULL,pixels,pitch);
+    SDL_SetTextureBlendMode(texture,SDL_BLENDMODE_BLEND);
+    if(compositor != NULL)
+        compositor->update(texture,pixels,pitch,width,height);
+    return mem_track_texture(texture,owner.c_str());
+}
+
+//SDL_CreateTextureFromSurface, tracked under owner
+SDL_Texture *texture_from_surface(SDL_Surface *surface, const char *owner)
+{
+    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer,surface);
+    if(texture != NULL && compositor != NULL)
+        compositor->update(texture,surface);
+    return mem_track_texture(texture,owner);
+}
+
+//Turns an ARGB8888 surface into the texture an image is drawn with: shrunk to
+//its largest draw size, split into tiles past the renderer's limit and given
+//a mip chain if asked for. Returns the handle render_texture() takes.
+SDL_Texture *create_image(SDL_Surface *surface, const char *fileName, int drawWidth, int drawHeight, bool mips)
+{
+    SDL_Surface *resampled = NULL;
+    if(drawWidth > 0 && drawHeight > 0)
+    {
+        float scale = image_scale();
+        int width = (int)ceilf(drawWidth*scale);
+        int height = (int)ceilf(drawHeight*scale);
+        if(width > surface->w)
+            width = surface->w;
+        if(height > surface->h)
+            height = surface->h;
+        if(width < surface->w || height < surface->h)
+        {
+            resampled = resample_surface(surface,width,height);
+            if(resampled != NULL)
+                surface = resampled;
+        }
+    }
+
+    SDL_Texture *texture = NULL;
+    int limit = max_texture_size();
+    SDL_LockSurface(surface);
+    if(surface->w > limit || surface->h > limit)
+    {
+        TiledTexture tiled;
+        tiled.width = surface->w;
+        tiled.height = surface->h;
+        tiled.tileSize = limit;
+        tiled.columns = (surface->w + limit - 1)/limit;
+        for(int y = 0; y < surface->h; y += limit)
+        {
+            for(int x = 0; x < surface->w; x += limit)
+            {
+                int w = surface->w - x < limit ? surface->w - x : limit;
+                int h = surface->h - y < limit ? surface->h - y : limit;
+                char owner[32];
+                sprintf(owner," tile %d,%d",x/limit,y/limit);
+                tiled.tiles.push_back(create_static_texture((Uint8*)surface->pixels + y*surface->pitch + x*4,surface->pitch,w,h,fileName + std::string(owner)));
+            }
+        }
+        texture = tiled.tiles[0];
+        if(texture != NULL)
+            tiledTextures[texture] = tiled;
+    }
+    else
+    {
+        texture = create_static_texture(surface->pixels,surface->pitch,surface->w,surface->h,fileName);
+    }
+    SDL_UnlockSurface(surface);
+
+    if(mips && texture != NULL && tiledTextures.count(texture) == 0)
+    {
+        std::vector<SDL_Texture*> &chain = mipChains[texture];
+        SDL_Surface *level = surface;
+        while(level->w/2 >= MIP_MIN_SIZE && level->h/2 >= MIP_MIN_SIZE)
+        {
+            SDL_Surface *half = resample_surface(level,level->w/2,level->h/2);
+            if(level != surface)
+                SDL_FreeSurface(level);
+            level = half;
+            if(level == NULL)
+                break;
+
+            char owner[16];
+            sprintf(owner," mip %d",(int)chain.size()+1);
+            chain.push_back(create_static_texture(level->pixels,level->pitch,level->w,level->h,fileName + std::string(owner)));
+        }
+        if(level != surface)
+            SDL_FreeSurface(level);
+    }
+
+    SDL_FreeSurface(resampled);
+    return texture;
 }
 
-SDL_Texture *load_texture(const char* fileName)
+//Loads an image and stores it at the largest size it is drawn at, in layout
+//units (0 keeps the file's size). With mips it also gets a mip chain.
+SDL_Texture *load_texture(const char* fileName, int drawWidth = 0, int drawHeight = 0, bool mips = false)
 {
-    SDL_Texture *texture = IMG_LoadTexture(renderer,fileName);
+    SDL_Surface *surface = NULL;
+    int w,h,pitch;
+    const void *packed = pack_is_open() ? pack_find(fileName,&w,&h,&pitch) : NULL;
+    if(packed != NULL)
+    {
+        //Wraps the mapping, nothing is copied until the texture is created
+        surface = SDL_CreateRGBSurfaceWithFormatFrom((void*)packed,w,h,32,pitch,PACK_PIXEL_FORMAT);
+    }
+    else
+    {
+        SDL_Surface *loaded = IMG_Load(fileName);
+        if(packWriter != NULL)
+            packWriter->add(fileName,loaded);
+        if(loaded != NULL)
+            surface = SDL_ConvertSurfaceFormat(loaded,PACK_PIXEL_FORMAT,0);
+        SDL_FreeSurface(loaded);
+    }
+
+    SDL_Texture *texture = NULL;
+    if(surface != NULL)
+        texture = create_image(surface,fileName,drawWidth,drawHeight,mips);
+    SDL_FreeSurface(surface);
+
     if(texture == NULL)
     {
         printf("Could not load %s\n",fileName);
@@ -69,6 +437,78 @@ SDL_Texture *load_texture(const char* fileName)
     return texture;
 }
 
+//Frees an image from load_texture() along with its tiles or mip chain
+void free_texture(SDL_Texture *texture)
+{
+    std::map<SDL_Texture*, TiledTexture>::iterator tiled = tiledTextures.find(texture);
+    if(tiled != tiledTextures.end())
+    {
+        for(unsigned int i = 0; i < tiled->second.tiles.size(); ++i)
+        {
+            mem_destroy_texture(tiled->second.tiles[i]);
+        }
+        tiledTextures.erase(tiled);
+        return;
+    }
+
+    std::map<SDL_Texture*, std::vector<SDL_Texture*> >::iterator chain = mipChains.find(texture);
+    if(chain != mipChains.end())
+    {
+        for(unsigned int i = 0; i < chain->second.size(); ++i)
+        {
+            mem_destroy_texture(chain->second[i]);
+        }
+        mipChains.erase(chain);
+    }
+    mem_destroy_texture(texture);
+}
+
+//The smallest mip level still at least as large as the pixels it covers
+SDL_Texture *pick_mip(SDL_Texture *texture, float w, float h)
+{
+    std::map<SDL_Texture*, std::vector<SDL_Texture*> >::iterator chain = mipChains.find(texture);
+    if(chain == mipChains.end())
+        return texture;
+
+    //Recorded frames are computed for tickScale, the render thread draws at sceneScale
+    float scale = sceneTarget == NULL ? image_scale() : on_render_thread() ? sceneScale : tickScale;
+    int width,height;
+    SDL_QueryTexture(texture,NULL,NULL,&width,&height);
+
+    SDL_Texture *picked = texture;
+    for(unsigned int i = 0; i < chain->second.size(); ++i)
+    {
+        width /= 2;
+        height /= 2;
+        if(width < w*scale || height < h*scale || chain->second[i] == NULL)
+            break;
+        picked = chain->second[i];
+    }
+    return picked;
+}
+
+void render_texture_part(SDL_Texture *texture, const SDL_Rect *source, float x, float y, float w, float h);
+
+//Draws every tile of a tiled image over the rectangle, edges rounded the same way on both sides of a seam
+void render_tiles(const TiledTexture &tiled, float x, float y, float w, float h)
+{
+    for(unsigned int i = 0; i < tiled.tiles.size(); ++i)
+    {
+        int column = i % tiled.columns;
+        int row = i / tiled.columns;
+        int tileLeft = column*tiled.tileSize;
+        int tileTop = row*tiled.tileSize;
+        int tileRight = tileLeft + tiled.tileSize < tiled.width ? tileLeft + tiled.tileSize : tiled.width;
+        int tileBottom = tileTop + tiled.tileSize < tiled.height ? tileTop + tiled.tileSize : tiled.height;
+
+        float left = floorf(x + tileLeft*w/tiled.width);
+        float top = floorf(y + tileTop*h/tiled.height);
+        float right = floorf(x + tileRight*w/tiled.width);
+        float bottom = floorf(y + tileBottom*h/tiled.height);
+        render_texture_part(tiled.tiles[i],NULL,left,top,right-left,bottom-top);
+    }
+}
+
 void render_texture(SDL_Texture *texture, float x, float y, float w, float h)
 {
     if(texture == NULL)
@@ -76,19 +516,211 @@ void render_texture(SDL_Texture *texture, float x, float y, float w, float h)
         printf("Texture is NULL\n");
         return;
     }
+
+    std::map<SDL_Texture*, TiledTexture>::iterator tiled = tiledTextures.find(texture);
+    if(tiled != tiledTextures.end())
+    {
+        render_tiles(tiled->second,x,y,w,h);
+        return;
+    }
+    texture = pick_mip(texture,w,h);
+
     SDL_Rect destination;
     destination.x = x;
     destination.y = y;
     destination.w = w;
     destination.h = h;
+    if(recording != NULL)
+    {
+        recording->add(texture,NULL,destination);
+        return;
+    }
     SDL_RenderCopy(renderer,texture,NULL,&destination);
 }
 
+//Draws only the source rectangle of the texture
+void render_texture_part(SDL_Texture *texture, const SDL_Rect *source, float x, float y, float w, float h)
+{
+    if(texture == NULL)
+    {
+        printf("Texture is NULL\n");
+        return;
+    }
+    SDL_Rect destination;
+    destination.x = x;
+    destination.y = y;
+    destination.w = w;
+    destination.h = h;
+    if(recording != NULL)
+    {
+        recording->add(texture,source,destination);
+        return;
+    }
+    SDL_RenderCopy(renderer,texture,source,&destination);
+}
+
+//Like render_texture_part(), but keeps the fraction of the destination so
+//slow scrolling moves smoothly instead of a whole pixel at a time
+void render_texture_subpixel(SDL_Texture *texture, const SDL_Rect *source, float x, float y, float w, float h)
+{
+    SDL_FRect destination;
+    destination.x = x;
+    destination.y = y;
+    destination.w = w;
+    destination.h = h;
+    if(recording != NULL)
+    {
+        recording->add(texture,source,destination);
+        return;
+    }
+    SDL_RenderCopyF(renderer,texture,source,&destination);
+}
+
+//Copies the newest pixels published to stream into texture, on the render thread
+void upload_stream(SDL_Texture *texture, StreamingImage *stream)
+{
+    int width,height;
+    const Uint32 *pixels = stream->acquire(&width,&height);
+    if(pixels == NULL || width <= 0 || height <= 0)
+        return;
+    SDL_Rect area = {0,0,width,height};
+    SDL_UpdateTexture(texture,&area,pixels,stream->pitch());
+    if(compositor != NULL)
+        compositor->update(texture,pixels,stream->pitch(),width,height);
+}
+
+//Draws part of a streaming texture, uploading what its stream published first.
+//With --threaded that happens when the render thread draws the snapshot.
+void render_stream(SDL_Texture *texture, StreamingImage *stream, const SDL_Rect *source, float x, float y, float w, float h)
+{
+    if(texture == NULL)
+    {
+        printf("Texture is NULL\n");
+        return;
+    }
+    if(on_render_thread())
+        upload_stream(texture,stream);
+    render_texture_part(texture,source,x,y,w,h);
+    if(recording != NULL && !on_render_thread())
+        recording->commands.back().stream = stream;
+}
+
+//Draws a snapshot the simulation thread recorded
+void draw_snapshot(const FrameSnapshot *snapshot)
+{
+    for(unsigned int i = 0; i < snapshot->commands.size(); ++i)
+    {
+        if(snapshot->commands[i].stream != NULL)
+            upload_stream(snapshot->commands[i].texture,snapshot->commands[i].stream);
+    }
+    if(compositor != NULL && useCompositor)
+    {
+        compositorSource = snapshot;
+        return;
+    }
+    for(unsigned int i = 0; i < snapshot->commands.size(); ++i)
+    {
+        const DrawCommand &command = snapshot->commands[i];
+        SDL_RenderCopyF(renderer,command.texture,command.wholeTexture ? NULL : &command.source,&command.destination);
+    }
+}
+
+//Mouse position in layout units, matching SDL_RenderSetLogicalSize's letterboxing
+Uint32 get_mouse_state(int *x, int *y)
+{
+    int mouseX,mouseY,windowWidth,windowHeight;
+    Uint32 buttons = SDL_GetMouseState(&mouseX,&mouseY);
+    SDL_GetWindowSize(window,&windowWidth,&windowHeight);
+
+    float scale = fminf((float)windowWidth/SCREEN_WIDTH,(float)windowHeight/SCREEN_HEIGHT);
+    if(scale <= 0.0f)
+        scale = 1.0f;
+
+    if(x != NULL)
+        *x = (mouseX - (windowWidth - SCREEN_WIDTH*scale)/2)/scale;
+    if(y != NULL)
+        *y = (mouseY - (windowHeight - SCREEN_HEIGHT*scale)/2)/scale;
+    return buttons;
+}
+
+//Starts drawing a frame into the scene target at scale, the one its content was computed for
+void begin_scene(float scale)
+{
+    sceneScale = scale;
+    if(compositor != NULL && useCompositor)
+    {
+        compositorFrame.clear();
+        compositorSource = &compositorFrame;
+        recording = &compositorFrame;
+        SDL_RenderClear(renderer);
+        return;
+    }
+    if(sceneTarget != NULL)
+    {
+        SDL_SetRenderTarget(renderer,sceneTarget);
+        SDL_RenderSetScale(renderer,sceneScale,sceneScale);
+    }
+    SDL_RenderClear(renderer);
+}
+
+//Stretches the part of the scene target that was drawn over the whole window
+void end_scene()
+{
+    if(compositor != NULL && useCompositor)
+    {
+        recording = NULL;
+
+        SDL_Color color;
+        SDL_GetRenderDrawColor(renderer,&color.r,&color.g,&color.b,&color.a);
+        compositor->draw(*compositorSource,sceneScale,color);
+        compositorSource = NULL;
+    }
+    else if(sceneTarget != NULL)
+    {
+        SDL_Rect drawn;
+        drawn.x = 0;
+        drawn.y = 0;
+        drawn.w = (int)(SCREEN_WIDTH*sceneScale + 0.5f);
+        drawn.h = (int)(SCREEN_HEIGHT*sceneScale + 0.5f);
+
+        SDL_SetRenderTarget(renderer,NULL);
+        SDL_RenderClear(renderer);
+        SDL_RenderCopy(renderer,sceneTarget,&drawn,NULL);
+    }
+
+    //Before the overlay is drawn, so recordings of equal runs match
+    if(frameCapture != NULL)
+        frameCapture->capture();
+}
+
+//Labels are looked up in the asset pack first, so only text missing from it is rasterized
 SDL_Texture *render_text(const std::string &message, TTF_Font *font, SDL_Color color)
 {
+    if(!on_render_thread())
+    {
+        SDL_Texture *texture = NULL;
+        render_call([&]{texture = render_text(message,font,color);});
+        return texture;
+    }
+
+    if(pack_is_open())
+    {
+        int w,h,pitch;
+        const void *pixels = pack_find(pack_text_key(message,color),&w,&h,&pitch);
+        if(pixels != NULL)
+        {
+            return create_static_texture(pixels,pitch,w,h,message);
+        }
+    }
+
     SDL_Surface *surface = TTF_RenderText_Blended(font,message.c_str(),color);
 
-    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer,surface);
+    if(packWriter != NULL)
+    {
+        packWriter->add(pack_text_key(message,color),surface);
+    }
+
+    SDL_Texture *texture = texture_from_surface(surface,message.c_str());
 
     SDL_FreeSurface(surface);
 
@@ -102,6 +734,23 @@ public:
     bool finished;
     Process *next;
 
+    Process()
+    {
+        finished = false;
+        next = NULL;
+    };
+
+    virtual ~Process()
+    {
+
+    };
+
+    //Name the screen's memory is accounted under
+    virtual const char *name()
+    {
+        return "Process";
+    };
+
     virtual void init()
     {
 
@@ -121,7 +770,309 @@ public:
     {
     };
 
-};
+    //Extra "key": value pairs for the benchmark JSON, each one starting with a comma
+    virtual void write_stats(FILE *file)
+    {
+
+    };
+
+    //Called every frame while the mouse is over a button leading here. Does one
+    //small piece of what init() and the first update() would otherwise do when
+    //the button is clicked, returns true while there is more to do.
+    virtual bool prewarm_step()
+    {
+        return false;
+    };
+
+    //Frees whatever prewarm_step() made once the mouse leaves without clicking
+    virtual void cancel_prewarm()
+    {
+
+    };
+
+    //Setup spread over frames instead of done in the constructor, see task.h.
+    //Screens override load() and call start_loading() at the end of their
+    //constructor; draw() has to cope with whatever is not loaded yet.
+    Task loading;
+
+    virtual Task load()
+    {
+        co_return;
+    };
+
+    void start_loading()
+    {
+        loading = load();
+    };
+
+    //For callers that need everything loaded before going on
+    void finish_loading()
+    {
+        loading.finish();
+    };
+
+    //render_text() accounted to this screen, load() runs outside the constructor's MemScope
+    SDL_Texture *load_label(const std::string &message, TTF_Font *font, SDL_Color color)
+    {
+        MemScope scope(name());
+        return render_text(message,font,color);
+    };
+
+};
+
+//Like render_texture(), for labels that may still be loading
+void render_label(SDL_Texture *texture, float x, float y, float w, float h)
+{
+    if(texture != NULL)
+        render_texture(texture,x,y,w,h);
+}
+
+//------------------ Scroll strips  -------------------------
+
+//Set with --no-scroll-strips to draw scrolling screens one texture at a time
+bool useScrollStrips = true;
+
+//Bumped when the renderer throws away what was drawn into its render targets
+SDL_atomic_t renderTargetsLost;
+
+//Scrolling content whose layout never changes, drawn once into render target
+//tiles laid end to end along its longer side. Each frame then copies the
+//visible part of one or two tiles instead of every texture in the content.
+struct ScrollStrip
+{
+    //Layout rectangle the content covers before it is scrolled
+    float x;
+    float y;
+    int width;
+    int height;
+
+    //Pixels per layout unit the tiles hold
+    float scale;
+
+    //Tiles follow each other along x if horizontal, otherwise along y, each tileLength layout units long
+    bool horizontal;
+    int tileLength;
+    std::vector<SDL_Texture*> tiles;
+
+    //renderTargetsLost when the tiles were drawn, -1 before the first try
+    int generation;
+
+    ScrollStrip()
+    {
+        x = 0.0f;
+        y = 0.0f;
+        width = 0;
+        height = 0;
+        scale = 1.0f;
+        horizontal = true;
+        tileLength = 0;
+        generation = -1;
+    };
+};
+
+void free_scroll_strip(ScrollStrip *strip)
+{
+    for(unsigned int i = 0; i < strip->tiles.size(); ++i)
+    {
+        mem_destroy_texture(strip->tiles[i]);
+    }
+    strip->tiles.clear();
+}
+
+//True if the strip should be drawn (again) before it can be used
+bool scroll_strip_stale(const ScrollStrip &strip)
+{
+    return useScrollStrips && strip.generation != SDL_AtomicGet(&renderTargetsLost);
+}
+
+bool scroll_strip_ready(const ScrollStrip &strip)
+{
+    return useScrollStrips && !strip.tiles.empty() && !scroll_strip_stale(strip);
+}
+
+//Draws the content into new tiles. drawContent(dx,dy) draws it with every
+//position moved by dx,dy; the strip's top left corner lands on 0,0. Leaves
+//the strip empty if render targets are unavailable, so the screen keeps
+//drawing the content itself.
+template<class Function>
+void build_scroll_strip(ScrollStrip *strip, float x, float y, int width, int height, Function drawContent)
+{
+    render_call([&]
+    {
+        free_scroll_strip(strip);
+        strip->x = x;
+        strip->y = y;
+        strip->width = width;
+        strip->height = height;
+        strip->scale = image_scale();
+        strip->horizontal = width >= height;
+        strip->generation = SDL_AtomicGet(&renderTargetsLost);
+        if(!SDL_RenderTargetSupported(renderer))
+            return;
+
+        int length = strip->horizontal ? width : height;
+        int breadth = strip->horizontal ? height : width;
+        int limit = (int)(max_texture_size()/strip->scale);
+        if(breadth > limit)
+        {
+            printf("Scroll strip %dx%d does not fit in a texture\n",width,height);
+            return;
+        }
+        strip->tileLength = length < limit ? length : limit;
+
+        SDL_Texture *previous = SDL_GetRenderTarget(renderer);
+        float previousScaleX,previousScaleY;
+        SDL_RenderGetScale(renderer,&previousScaleX,&previousScaleY);
+        SDL_Color color;
+        SDL_GetRenderDrawColor(renderer,&color.r,&color.g,&color.b,&color.a);
+
+        //pick_mip() goes by the render scale, the tiles are drawn at their own
+        float renderScale = sceneScale;
+        if(sceneTarget != NULL)
+            sceneScale = strip->scale;
+
+        std::vector<Uint32> pixels;
+        for(int start = 0; start < length; start += strip->tileLength)
+        {
+            int tileLength = length - start < strip->tileLength ? length - start : strip->tileLength;
+            int tileWidth = (int)ceilf((strip->horizontal ? tileLength : width)*strip->scale);
+            int tileHeight = (int)ceilf((strip->horizontal ? height : tileLength)*strip->scale);
+
+            SDL_Texture *tile = mem_track_texture(SDL_CreateTexture(renderer,SDL_PIXELFORMAT_ARGB8888,SDL_TEXTUREACCESS_TARGET,tileWidth,tileHeight),"scroll strip");
+            if(tile == NULL || SDL_SetRenderTarget(renderer,tile) != 0)
+            {
+                printf("Failed to create scroll strip tile: %s\n",SDL_GetError());
+                mem_destroy_texture(tile);
+                free_scroll_strip(strip);
+                break;
+            }
+            strip->tiles.push_back(tile);
+
+            //Cleared to the screen's background and copied without blending,
+            //so edges blend against the same color they would have on screen
+            SDL_SetTextureBlendMode(tile,SDL_BLENDMODE_NONE);
+            SDL_SetRenderDrawColor(renderer,color.r,color.g,color.b,255);
+            SDL_RenderClear(renderer);
+            SDL_RenderSetScale(renderer,strip->scale,strip->scale);
+            if(strip->horizontal)
+                drawContent(-x - start,-y);
+            else
+                drawContent(-x,-y - start);
+
+            if(compositor != NULL)
+            {
+                SDL_RenderSetScale(renderer,1.0f,1.0f);
+                pixels.resize(tileWidth*tileHeight);
+                if(SDL_RenderReadPixels(renderer,NULL,SDL_PIXELFORMAT_ARGB8888,&pixels[0],tileWidth*4) == 0)
+                    compositor->update(tile,&pixels[0],tileWidth*4,tileWidth,tileHeight);
+            }
+        }
+
+        sceneScale = renderScale;
+        SDL_SetRenderTarget(renderer,previous);
+        if(previous != NULL)
+            SDL_RenderSetScale(renderer,previousScaleX,previousScaleY);
+        SDL_SetRenderDrawColor(renderer,color.r,color.g,color.b,color.a);
+    });
+}
+
+//Draws the visible part of the strip scrolled by scrollX,scrollY, clipped to
+//the screen at whole pixels of the tiles but placed at the exact offset
+void render_scroll_strip(const ScrollStrip &strip, float scrollX, float scrollY)
+{
+    float extent = strip.horizontal ? SCREEN_WIDTH : SCREEN_HEIGHT;
+    float origin = strip.horizontal ? strip.x - scrollX : strip.y - scrollY;
+    for(unsigned int i = 0; i < strip.tiles.size(); ++i)
+    {
+        float tileStart = origin + (float)i*strip.tileLength;
+        float tileLength = strip.horizontal ? strip.width : strip.height;
+        tileLength -= (float)i*strip.tileLength;
+        if(tileLength > strip.tileLength)
+            tileLength = strip.tileLength;
+
+        float visibleStart = tileStart > 0.0f ? tileStart : 0.0f;
+        float visibleEnd = tileStart + tileLength < extent ? tileStart + tileLength : extent;
+        if(visibleEnd <= visibleStart)
+            continue;
+
+        int tileWidth,tileHeight;
+        SDL_QueryTexture(strip.tiles[i],NULL,NULL,&tileWidth,&tileHeight);
+        int pixels = strip.horizontal ? tileWidth : tileHeight;
+        int first = (int)floorf((visibleStart - tileStart)*strip.scale);
+        int last = (int)ceilf((visibleEnd - tileStart)*strip.scale);
+        if(last > pixels)
+            last = pixels;
+
+        SDL_Rect source;
+        float start = tileStart + first/strip.scale;
+        float length = (last - first)/strip.scale;
+        if(strip.horizontal)
+        {
+            source.x = first;
+            source.y = 0;
+            source.w = last - first;
+            source.h = tileHeight;
+            render_texture_subpixel(strip.tiles[i],&source,start,strip.y - scrollY,length,strip.height);
+        }
+        else
+        {
+            source.x = 0;
+            source.y = first;
+            source.w = tileWidth;
+            source.h = last - first;
+            render_texture_subpixel(strip.tiles[i],&source,strip.x - scrollX,start,strip.width,length);
+        }
+    }
+}
+
+//Share of the frame budget tasks are resumed for, the rest is left to update() and drawing
+const float TASK_SLICE_SHARE = 0.25f;
+
+//Resumes loading and other tasks for this frame's slice, then updates the screen
+void update_process(Process *process, float dt)
+{
+    float frameMs = resolution.targetMs > 0.0f ? resolution.targetMs : 1000.0f/60.0f;
+    tasks_run(frameMs*TASK_SLICE_SHARE);
+    process->update(dt);
+}
+
+//------------------ Transitions  -------------------------
+
+//Cleared with --no-prewarm
+bool prewarmEnabled = true;
+
+//Set by the last button clicked, read once the next screen is on screen
+Uint64 transitionClick = 0;
+bool transitionPrewarmed = false;
+
+//Click to first present of the new screen, index 1 is prewarmed
+int transitionCount[2] = {0,0};
+double transitionTotalMs[2] = {0.0,0.0};
+double transitionWorstMs[2] = {0.0,0.0};
+
+void report_transition(const char *screen, Uint64 click, bool prewarmed)
+{
+    double ms = (SDL_GetPerformanceCounter()-click)*1000.0/SDL_GetPerformanceFrequency();
+    printf("Transition to %s took %.1f ms (%s)\n",screen,ms,prewarmed ? "prewarmed" : "cold");
+
+    transitionCount[prewarmed]++;
+    transitionTotalMs[prewarmed] += ms;
+    if(ms > transitionWorstMs[prewarmed])
+        transitionWorstMs[prewarmed] = ms;
+}
+
+void transition_report(FILE *file)
+{
+    const char *kinds[2] = {"cold","prewarmed"};
+    for(int i = 0; i < 2; ++i)
+    {
+        if(transitionCount[i] > 0)
+        {
+            fprintf(file,"%d %s transitions: %.1f ms avg, %.1f ms worst\n",transitionCount[i],kinds[i],
+                    transitionTotalMs[i]/transitionCount[i],transitionWorstMs[i]);
+        }
+    }
+}
 
 class ProcessButton
 {
@@ -135,9 +1086,16 @@ public:
     float width;
     float height;
 
+    //prewarm() has started on next, and finished with it
+    bool prewarming;
+    bool prewarmed;
+
     ProcessButton()
     {
-
+        next = NULL;
+        pressed = false;
+        prewarming = false;
+        prewarmed = false;
     };
 
     ProcessButton(Process *next, SDL_Texture *textureOut, SDL_Texture *textureIn, float x, float y, float width, float height)
@@ -150,17 +1108,23 @@ public:
         this->y = y;
         this->width = width;
         this->height = height;
+        this->prewarming = false;
+        this->prewarmed = false;
     };
 
-    bool handle_events(SDL_Event *event, Process **processNext)
+    bool hovered()
     {
-
         int mouseX = 0,mouseY = 0;
-        SDL_GetMouseState(&mouseX,&mouseY);
+        get_mouse_state(&mouseX,&mouseY);
 
-        if((mouseX-(x+width/2))*(mouseX-(x+width/2))+(mouseY-(y+height/2))*(mouseY-(y+height/2))<(width/2)*(width/2))
+        return (mouseX-(x+width/2))*(mouseX-(x+width/2))+(mouseY-(y+height/2))*(mouseY-(y+height/2))<(width/2)*(width/2);
+    }
+
+    bool handle_events(SDL_Event *event, Process **processNext)
+    {
+        if(hovered())
         {
-            if(SDL_GetMouseState(NULL,NULL) & SDL_BUTTON(SDL_BUTTON_LEFT))
+            if(get_mouse_state(NULL,NULL) & SDL_BUTTON(SDL_BUTTON_LEFT))
             {
                 pressed = true;
             }
@@ -169,6 +1133,8 @@ public:
                 if(event->button.button == SDL_BUTTON_LEFT)
                 {
                     *processNext = next;
+                    transitionClick = SDL_GetPerformanceCounter();
+                    transitionPrewarmed = prewarmed;
                     return true;
                 }
             }
@@ -180,6 +1146,28 @@ public:
         return false;
     }
 
+    //Called from the owning screen's update(), gets next ready while the mouse is over the button
+    void prewarm()
+    {
+        if(next == NULL || !prewarmEnabled)
+            return;
+
+        if(hovered())
+        {
+            if(!prewarmed)
+            {
+                prewarming = true;
+                prewarmed = !next->prewarm_step();
+            }
+        }
+        else if(prewarming)
+        {
+            next->cancel_prewarm();
+            prewarming = false;
+            prewarmed = false;
+        }
+    }
+
     void draw()
     {
         if(pressed)
@@ -210,6 +1198,8 @@ public:
     ProcessButton academics;
     ProcessButton about;
     ProcessButton mandelbrot;
+    ProcessButton julia;
+    ProcessButton buddhabrot;
     ProcessButton exit;
 
     SDL_Texture *aboutMeTexture;
@@ -217,12 +1207,16 @@ public:
     SDL_Texture *academicsTexture;
     SDL_Texture *aboutTexture;
     SDL_Texture *mandelbrotTexture;
+    SDL_Texture *juliaTexture;
+    SDL_Texture *buddhabrotTexture;
     SDL_Texture *exitTexture;
 
     Process *aboutMeProcess;
     Process *interestsProcess;
     Process *academicsProcess;
     Process *mandelbrotProcess;
+    Process *juliaProcess;
+    Process *buddhabrotProcess;
     Process *aboutProcess;
 
     TTF_Font *font;
@@ -241,7 +1235,21 @@ public:
     );
 
 
+    ~IntroAnimation();
+
+    const char *name()
+    {
+        return "IntroAnimation";
+    };
+
     void init();
+    Task load();
+
+    //Creates the first screen still missing, returns false if there was none
+    bool create_child();
+
+    bool prewarm_step();
+    void cancel_prewarm();
 
     void handle_events(SDL_Event *event)
     {
@@ -250,7 +1258,9 @@ public:
         || academics.handle_events(event,&next)
         || exit.handle_events(event,&next)
         || about.handle_events(event,&next)
-        || mandelbrot.handle_events(event,&next);
+        || mandelbrot.handle_events(event,&next)
+        || julia.handle_events(event,&next)
+        || buddhabrot.handle_events(event,&next);
     }
 
     void update(float dt)
@@ -264,6 +1274,14 @@ public:
             hatchVelocity = vec2d(0.0f,0.0f);
 
         }
+
+        aboutMe.prewarm();
+        interests.prewarm();
+        academics.prewarm();
+        about.prewarm();
+        mandelbrot.prewarm();
+        julia.prewarm();
+        buddhabrot.prewarm();
     }
 
     void draw()
@@ -277,29 +1295,66 @@ public:
         int gHatchHeight;
         SDL_QueryTexture(geraldHatch,NULL,NULL,&gHatchWidth,&gHatchHeight);
 
-        render_texture(geraldHatch,SCREEN_WIDTH/2-(SCREEN_WIDTH-20)/2,200,SCREEN_WIDTH-20,128);
+        render_label(geraldHatch,SCREEN_WIDTH/2-(SCREEN_WIDTH-20)/2,200,SCREEN_WIDTH-20,128);
 
         aboutMe.draw();
-        render_texture(aboutMeTexture,aboutMe.x+aboutMe.width+5,aboutMe.y,280,aboutMe.height);
+        render_label(aboutMeTexture,aboutMe.x+aboutMe.width+5,aboutMe.y,280,aboutMe.height);
 
         interests.draw();
-        render_texture(interestsTexture,interests.x+interests.width+5,interests.y,280,interests.height);
+        render_label(interestsTexture,interests.x+interests.width+5,interests.y,280,interests.height);
 
         academics.draw();
-        render_texture(academicsTexture,academics.x+academics.width+5,academics.y,280,academics.height);
+        render_label(academicsTexture,academics.x+academics.width+5,academics.y,280,academics.height);
 
         about.draw();
-        render_texture(aboutTexture,about.x+about.width+5,about.y,200,about.height);
+        render_label(aboutTexture,about.x+about.width+5,about.y,200,about.height);
 
         mandelbrot.draw();
-        render_texture(mandelbrotTexture,mandelbrot.x+mandelbrot.width+5,mandelbrot.y,280,mandelbrot.height);
+        render_label(mandelbrotTexture,mandelbrot.x+mandelbrot.width+5,mandelbrot.y,280,mandelbrot.height);
+
+        julia.draw();
+        render_label(juliaTexture,julia.x+julia.width+5,julia.y,150,julia.height);
+
+        buddhabrot.draw();
+        render_label(buddhabrotTexture,buddhabrot.x+buddhabrot.width+5,buddhabrot.y,280,buddhabrot.height);
 
         exit.draw();
-        render_texture(exitTexture,exit.x+exit.width+5,exit.y,150,exit.height);
+        render_label(exitTexture,exit.x+exit.width+5,exit.y,150,exit.height);
     }
 
 };
 
+//The menu every screen's back button leads to
+Process *create_menu()
+{
+    return new IntroAnimation
+    (
+     vec2d(44.0f,-200.0f),
+     vec2d(1024,128),
+     10,
+     hatchTexture,
+     buttonOut,
+     buttonIn,
+     berbas
+    );
+}
+
+//prewarm_step() for screens whose only transition work is creating their back menu
+bool prewarm_menu(Process **menu)
+{
+    if(*menu == NULL)
+    {
+        render_call([&]{*menu = create_menu();});
+    }
+    return false;
+}
+
+void cancel_menu(Process **menu)
+{
+    render_call([&]{delete *menu;});
+    *menu = NULL;
+}
+
 class Interests : public Process
 {
 public:
@@ -318,25 +1373,29 @@ public:
     SDL_Texture *hText;
     SDL_Texture *sText;
 
+    ScrollStrip strip;
+
     float length;
 
     void init()
     {
         SDL_SetRenderDrawColor(renderer,255,255,255,255);
-        this->goBackProcess = new IntroAnimation
-        (
-         vec2d(44.0f,-200.0f),
-         vec2d(1024,128),
-         10,
-         hatchTexture,
-         buttonOut,
-         buttonIn,
-         berbas
-        );
+        if(goBackProcess == NULL)
+            goBackProcess = create_menu();
 
         this->goBack = ProcessButton(goBackProcess,buttonOut,buttonIn,SCREEN_WIDTH-400,SCREEN_HEIGHT-150,128,128);
     };
 
+    bool prewarm_step()
+    {
+        return prewarm_menu(&goBackProcess);
+    };
+
+    void cancel_prewarm()
+    {
+        cancel_menu(&goBackProcess);
+    };
+
     void handle_events(SDL_Event *event)
     {
         if(!finished)
@@ -352,56 +1411,94 @@ public:
             finished = true;
         }
 
+        //Once the labels are in, the content never changes
+        if(loading.done() && scroll_strip_stale(strip))
+            build_scroll_strip(&strip,200,10,2900,990,[&](float x, float y){draw_content(x,y);});
+
+        goBack.prewarm();
+    };
+
+    //Everything that scrolls, moved by x,y
+    void draw_content(float x, float y)
+    {
+        render_texture(alexTexture,1550.0f+x,300+y,300,300);
+        render_texture(napoleonTexture,1900.0f+x,50+y,400,473);
+        render_label(pText,200+x,10+y,700,100);
+        render_texture(codeTexture,200+x,160+y,494,640);
+        render_label(cText,800+x,500+y,500,100);
+        render_texture(aluTexture,900+x,10+y,500,400);
+        render_texture(cpuTexture,900+x,700+y,300,300);
+        render_label(hText,1500+x,100+y,300,100);
+        render_label(sText,2200+x,700+y,300,100);
+        render_texture(higgsTexture,2600+x,500+y,500,500);
+        render_texture(nuclearTexture,2500+x,10+y,470,400);
     };
 
     void draw()
     {
-        render_texture(alexTexture,1550.0f-scroll,300,300,300);
-        render_texture(napoleonTexture,1900.0-scroll,50,400,473);
-        render_texture(pText,200-scroll,10,700,100);
-        render_texture(codeTexture,200-scroll,160,494,640);
-        render_texture(cText,800-scroll,500,500,100);
-        render_texture(aluTexture,900-scroll,10,500,400);
-        render_texture(cpuTexture,900-scroll,700,300,300);
-        render_texture(hText,1500-scroll,100,300,100);
-        render_texture(sText,2200-scroll,700,300,100);
-        render_texture(higgsTexture,2600-scroll,500,500,500);
-        render_texture(nuclearTexture,2500-scroll,10,470,400);
+        if(scroll_strip_ready(strip))
+            render_scroll_strip(strip,scroll,0.0f);
+        else
+            draw_content(-scroll,0.0f);
         goBack.draw();
-        render_texture(goBackTexture,goBack.x+goBack.width + 5,goBack.y,200,goBack.height);
+        render_label(goBackTexture,goBack.x+goBack.width + 5,goBack.y,200,goBack.height);
+
 
+    };
 
+    const char *name()
+    {
+        return "Interests";
     };
 
     ~Interests()
     {
-    SDL_DestroyTexture(goBackTexture);
+    if(goBackProcess != next)
+        delete goBackProcess;
 
-    SDL_DestroyTexture(pText);
-    SDL_DestroyTexture(cText);
-    SDL_DestroyTexture(hText);
-    SDL_DestroyTexture(sText);
+    mem_destroy_texture(goBackTexture);
+
+    mem_destroy_texture(pText);
+    mem_destroy_texture(cText);
+    mem_destroy_texture(hText);
+    mem_destroy_texture(sText);
+    free_scroll_strip(&strip);
     }
 
     Interests()
     {
+        MemScope scope(name());
         scroll = 0.0f;
         finished = false;
+        goBackProcess = NULL;
         this->goBack = ProcessButton(goBackProcess,buttonOut,buttonIn,SCREEN_WIDTH-400,SCREEN_HEIGHT-150,128,128);
 
-        SDL_Color hatchBlue = {1,91,144,100};
-        goBackTexture = render_text("Back",berbas,hatchBlue);
-
-        pText = render_text("Programming... Obviously",berbas,hatchBlue);
-        cText = render_text("Anything Computers",berbas,hatchBlue);
-        hText = render_text("History",berbas,hatchBlue);
-        sText = render_text("Science",berbas,hatchBlue);
-
+        goBackTexture = NULL;
+        pText = NULL;
+        cText = NULL;
+        hText = NULL;
+        sText = NULL;
 
         velocity = 70.0f;
 
         length = 2000.0f;
 
+        start_loading();
+    };
+
+    //The labels scroll in from the right, so there is time to render them
+    Task load()
+    {
+        SDL_Color hatchBlue = {1,91,144,100};
+        goBackTexture = load_label("Back",berbas,hatchBlue);
+        co_await frame_slice();
+        pText = load_label("Programming... Obviously",berbas,hatchBlue);
+        co_await frame_slice();
+        cText = load_label("Anything Computers",berbas,hatchBlue);
+        co_await frame_slice();
+        hText = load_label("History",berbas,hatchBlue);
+        co_await frame_slice();
+        sText = load_label("Science",berbas,hatchBlue);
     };
 
 };
@@ -428,30 +1525,32 @@ public:
     void init()
     {
         SDL_SetRenderDrawColor(renderer,255,255,255,255);
-        this->goBackProcess = new IntroAnimation
-        (
-         vec2d(44.0f,-200.0f),
-         vec2d(1024,128),
-         10,
-         hatchTexture,
-         buttonOut,
-         buttonIn,
-         berbas
-        );
+        if(goBackProcess == NULL)
+            goBackProcess = create_menu();
 
         this->goBack = ProcessButton(goBackProcess,buttonOut,buttonIn,SCREEN_WIDTH-400,SCREEN_HEIGHT-150,128,128);
 
     };
 
+    bool prewarm_step()
+    {
+        return prewarm_menu(&goBackProcess);
+    };
+
+    void cancel_prewarm()
+    {
+        cancel_menu(&goBackProcess);
+    };
+
     void draw()
     {
         goBack.draw();
-        render_texture(goBackTexture,goBack.x+goBack.width + 5,goBack.y,200,goBack.height);
+        render_label(goBackTexture,goBack.x+goBack.width + 5,goBack.y,200,goBack.height);
         render_texture(kaiTexture,kaiPosition.x,kaiPosition.y,kaiDimensions.x,kaiDimensions.y);
-        render_texture(nameTexture,10,340,500,100);
-        render_texture(ageTexture,10,450,200,100);
-        render_texture(schoolTexture,10,560,600,100);
-        render_texture(languagesTexture,10,670,700,100);
+        render_label(nameTexture,10,340,500,100);
+        render_label(ageTexture,10,450,200,100);
+        render_label(schoolTexture,10,560,600,100);
+        render_label(languagesTexture,10,670,700,100);
 
     };
 
@@ -460,14 +1559,27 @@ public:
         finished = goBack.handle_events(event,&next);
     }
 
+    void update(float dt)
+    {
+        goBack.prewarm();
+    };
+
+    const char *name()
+    {
+        return "AboutMe";
+    };
+
     ~AboutMe()
     {
-    SDL_DestroyTexture(goBackTexture);
+    if(goBackProcess != next)
+        delete goBackProcess;
+
+    mem_destroy_texture(goBackTexture);
 
-    SDL_DestroyTexture(nameTexture);
-    SDL_DestroyTexture(ageTexture);
-    SDL_DestroyTexture(schoolTexture);
-    SDL_DestroyTexture(languagesTexture);
+    mem_destroy_texture(nameTexture);
+    mem_destroy_texture(ageTexture);
+    mem_destroy_texture(schoolTexture);
+    mem_destroy_texture(languagesTexture);
     }
 
     AboutMe
@@ -480,18 +1592,35 @@ public:
         TTF_Font *font
     )
     {
+        MemScope scope(name());
+        goBackProcess = NULL;
         this->kaiPosition = kaiPosition;
         this->kaiDimensions = kaiDimensions;
 
-        SDL_Color hatchBlue = {1,91,144,100};
-        goBackTexture = render_text("Back",font,hatchBlue);
+        this->font = font;
 
-        nameTexture = render_text("Name:  Kai  Rusch",font,hatchBlue);
-        ageTexture = render_text("Age:  17",font,hatchBlue);
-        schoolTexture = render_text("School:  Aurora  High  School",font,hatchBlue);
-        languagesTexture = render_text("Speaks:  German,  English,  French",font,hatchBlue);
+        goBackTexture = NULL;
+        nameTexture = NULL;
+        ageTexture = NULL;
+        schoolTexture = NULL;
+        languagesTexture = NULL;
 
         finished = false;
+        start_loading();
+    };
+
+    Task load()
+    {
+        SDL_Color hatchBlue = {1,91,144,100};
+        goBackTexture = load_label("Back",font,hatchBlue);
+        co_await frame_slice();
+        nameTexture = load_label("Name:  Kai  Rusch",font,hatchBlue);
+        co_await frame_slice();
+        ageTexture = load_label("Age:  17",font,hatchBlue);
+        co_await frame_slice();
+        schoolTexture = load_label("School:  Aurora  High  School",font,hatchBlue);
+        co_await frame_slice();
+        languagesTexture = load_label("Speaks:  German,  English,  French",font,hatchBlue);
     };
 
 };
@@ -511,6 +1640,8 @@ public:
 
     SDL_Texture *aText;
 
+    ScrollStrip strip;
+
     float height;
 
     float velocity;
@@ -518,20 +1649,22 @@ public:
     void init()
     {
         SDL_SetRenderDrawColor(renderer,255,255,255,255);
-        this->goBackProcess = new IntroAnimation
-        (
-         vec2d(44.0f,-200.0f),
-         vec2d(1024,128),
-         10,
-         hatchTexture,
-         buttonOut,
-         buttonIn,
-         berbas
-        );
+        if(goBackProcess == NULL)
+            goBackProcess = create_menu();
 
         this->goBack = ProcessButton(goBackProcess,buttonOut,buttonIn,SCREEN_WIDTH-400,SCREEN_HEIGHT-150,128,128);
     };
 
+    bool prewarm_step()
+    {
+        return prewarm_menu(&goBackProcess);
+    };
+
+    void cancel_prewarm()
+    {
+        cancel_menu(&goBackProcess);
+    };
+
     void handle_events(SDL_Event *event)
     {
         if(!finished)
@@ -546,45 +1679,81 @@ public:
             next = goBackProcess;
             finished = true;
       }
+
+      if(loading.done() && scroll_strip_stale(strip))
+            build_scroll_strip(&strip,110,600,1150,3150,[&](float x, float y){draw_content(x,y);});
+
+      goBack.prewarm();
     };
 
-    void draw()
+    //Everything that scrolls, moved by x,y
+    void draw_content(float x, float y)
     {
+        render_texture(waterlooTexture,200+x,800+y,450,250);
+        render_texture(queenTexture,670+x,800+y,450,250);
+        render_label(sText,390+x,600+y,400,100);
+        render_label(eText,270+x,1100+y,700,100);
+        render_label(aText,320+x,1400+y,600,100);
+        render_texture(awardsTexture,110+x,1700+y,1150,2050);
+    };
 
-        render_texture(waterlooTexture,200,800-scroll,450,250);
-        render_texture(queenTexture,670,800-scroll,450,250);
-        render_texture(sText,390,600-scroll,400,100);
-        render_texture(eText,270,1100-scroll,700,100);
-        render_texture(aText,320,1400-scroll,600,100);
-        render_texture(awardsTexture,110,1700-scroll,1150,2050);
+    void draw()
+    {
+        if(scroll_strip_ready(strip))
+            render_scroll_strip(strip,0.0f,scroll);
+        else
+            draw_content(0.0f,-scroll);
 
         goBack.draw();
-        render_texture(goBackTexture,goBack.x+goBack.width + 5,goBack.y,200,goBack.height);
+        render_label(goBackTexture,goBack.x+goBack.width + 5,goBack.y,200,goBack.height);
+    };
+
+    const char *name()
+    {
+        return "Academics";
     };
 
     ~Academics()
     {
-        SDL_DestroyTexture(sText);
-        SDL_DestroyTexture(eText);
-        SDL_DestroyTexture(aText);
+        if(goBackProcess != next)
+            delete goBackProcess;
+
+        mem_destroy_texture(goBackTexture);
+        mem_destroy_texture(sText);
+        mem_destroy_texture(eText);
+        mem_destroy_texture(aText);
+        free_scroll_strip(&strip);
     }
 
     Academics()
     {
+        MemScope scope(name());
         scroll = 0.0f;
         finished = false;
+        goBackProcess = NULL;
         this->goBack = ProcessButton(goBackProcess,buttonOut,buttonIn,SCREEN_WIDTH-400,SCREEN_HEIGHT-150,128,128);
 
-        SDL_Color hatchBlue = {1,91,144,100};
-        goBackTexture = render_text("Back",berbas,hatchBlue);
-
-        sText = render_text("Plan  to  study  at:",berbas,hatchBlue);
-        eText = render_text("Program:  Software  Engineering",berbas,hatchBlue);
-        aText = render_text("Academic  Awards:",berbas,hatchBlue);
+        goBackTexture = NULL;
+        sText = NULL;
+        eText = NULL;
+        aText = NULL;
 
         velocity = 150.0f;
         height = 3000.0f;
 
+        start_loading();
+    };
+
+    Task load()
+    {
+        SDL_Color hatchBlue = {1,91,144,100};
+        goBackTexture = load_label("Back",berbas,hatchBlue);
+        co_await frame_slice();
+        sText = load_label("Plan  to  study  at:",berbas,hatchBlue);
+        co_await frame_slice();
+        eText = load_label("Program:  Software  Engineering",berbas,hatchBlue);
+        co_await frame_slice();
+        aText = load_label("Academic  Awards:",berbas,hatchBlue);
     };
 };
 
@@ -601,26 +1770,33 @@ public:
     void init()
     {
         SDL_SetRenderDrawColor(renderer,255,255,255,255);
-        this->goBackProcess = new IntroAnimation
-        (
-         vec2d(44.0f,-200.0f),
-         vec2d(1024,128),
-         10,
-         hatchTexture,
-         buttonOut,
-         buttonIn,
-         berbas
-        );
+        if(goBackProcess == NULL)
+            goBackProcess = create_menu();
 
         this->goBack = ProcessButton(goBackProcess,buttonOut,buttonIn,SCREEN_WIDTH-400,SCREEN_HEIGHT-150,128,128);
     };
 
+    bool prewarm_step()
+    {
+        return prewarm_menu(&goBackProcess);
+    };
+
+    void cancel_prewarm()
+    {
+        cancel_menu(&goBackProcess);
+    };
+
     void handle_events(SDL_Event *event)
     {
         if(!finished)
             finished = goBack.handle_events(event,&next);
     };
 
+    void update(float dt)
+    {
+        goBack.prewarm();
+    };
+
     void draw()
     {
 
@@ -629,234 +1805,2691 @@ public:
         render_texture(mingwTexture,620,320,229,60);
         render_texture(cbTexture,890,300,128,128);
         render_texture(cppTexture,100,300,180,97);
-        render_texture(aTexture,130,80,900,150);
+        render_label(aTexture,130,80,900,150);
+
+        goBack.draw();
+        render_label(goBackTexture,goBack.x+goBack.width + 5,goBack.y,200,goBack.height);
+    };
+
+    const char *name()
+    {
+        return "About";
+    };
+
+    ~About()
+    {
+        if(goBackProcess != next)
+            delete goBackProcess;
+
+        mem_destroy_texture(goBackTexture);
+        mem_destroy_texture(aTexture);
+    }
+
+    About()
+    {
+        MemScope scope(name());
+        finished = false;
+        goBackProcess = NULL;
+        this->goBack = ProcessButton(goBackProcess,buttonOut,buttonIn,SCREEN_WIDTH-400,SCREEN_HEIGHT-150,128,128);
+
+        goBackTexture = NULL;
+        aTexture = NULL;
+        start_loading();
+    };
+
+    Task load()
+    {
+        SDL_Color hatchBlue = {1,91,144,100};
+        goBackTexture = load_label("Back",berbas,hatchBlue);
+        co_await frame_slice();
+        aTexture = load_label("This  program  was  made  with:",berbas,hatchBlue);
+    };
+
+};
+
+//Set with --aa-samples: most samples an edge pixel of the Mandelbrot viewer
+//gets, below 4 turns antialiasing off
+int antialiasSamples = 16;
+
+//Set with --aa-delta: difference in escape count that makes a pixel an edge,
+//0 only refines the edge of the set (see antialias_rows())
+int antialiasDelta = 4;
+
+class Mandelbrot : public Process
+{
+public:
+
+    ProcessButton goBack;
+
+    Process *goBackProcess;
+    SDL_Texture *goBackTexture;
+
+    //Streaming, filled from stream when drawn
+    SDL_Texture *mandelTexture;
+
+    //The palette colors the grid here, allocated once the screen is shown
+    StreamingImage *stream;
+
+    //Escape values of the grid (see EscapeColoring), so the colors can
+    //change without running the kernel again
+    SDL_Surface *escapes;
+
+    int frames;
+    int maxIt;
+
+    //Side of the square the last pass computed, follows tickScale
+    int computedSize;
+
+    //Kernel the viewer uses, 1-5 pick the formula and P the precision
+    FractalType type;
+    FractalPrecision precision;
+    bool kernelChanged;
+
+    //C cycles the scheme and space turns palette cycling on and off, both
+    //only recolor the grid. Cycling moves CYCLE_TURNS of the ramp a second.
+    static constexpr double CYCLE_TURNS = 0.1;
+    FractalPalette palette;
+    PaletteScheme scheme;
+    bool cycling;
+    bool paletteChanged;
+    int recolors;
+    double recolorTotalMs;
+
+    double juliaX;
+    double juliaY;
+
+    SDL_Texture *kernelTexture;
+
+    //First pass computed into escapes while the button leading here is hovered
+    BackgroundTask firstPass;
+    int prewarmSize;
+
+    //Full recomputes run as a task over as many frames as they need
+    static const int PASS_ROWS = 16;
+    Task pass;
+    int passSize;
+
+    //The grid is centered on (viewX,viewY) and zoom 1 shows 4 units across
+    double viewX;
+    double viewY;
+    double zoom;
+
+    //Navigation asked for since the last update: arrows pan by PAN_STEP
+    //pixels of the full size grid, +/- and the wheel zoom by 2x
+    static const int PAN_STEP = 64;
+    int panX;
+    int panY;
+    int zoomSteps;
+
+    //Samples still on the grid after a step are moved instead of recomputed,
+    //this holds them in between and the new samples of a zoom
+    std::vector<Uint32> scratch;
+
+    int navigationSteps;
+    double reusedTotal;
+    SDL_Texture *reuseTexture;
+
+    //Edge pixels of a finished grid are supersampled into smoothed by a second
+    //task, up to antialiasSamples each. A toggles it.
+    bool antialias;
+    bool antialiasChanged;
+    SDL_Surface *smoothed;
+    bool refining;
+    bool refined;
+    SDL_Texture *antialiasTexture;
+
+    //Time spent in the last full pass and the last refinement, inside their slices
+    double passMs;
+    double refineMs;
+    int refinements;
+    double refinedTotal;
+    double overheadTotal;
+
+    void update_kernel_label()
+    {
+        MemScope scope(name());
+        std::string label = std::string(FRACTAL_TYPE_NAMES[type]) + "  " + FRACTAL_PRECISION_NAMES[precision] + "  " + PALETTE_SCHEME_NAMES[scheme] + (cycling ? "  cycling" : "");
+        render_call([&]
+        {
+            mem_destroy_texture(kernelTexture);
+            SDL_Color grey = {128,128,128,255};
+            kernelTexture = render_text(label,berbas,grey);
+        });
+    }
+
+    FractalView view_for(int size)
+    {
+        FractalView view;
+        view.centerX = viewX;
+        view.centerY = viewY;
+        view.pixelSize = 4.0/(size*zoom);
+        view.juliaX = juliaX;
+        view.juliaY = juliaY;
+        view.maxIt = maxIt;
+        return view;
+    }
+
+    //Runs on the background thread, a few rows at a time so a cancel is noticed quickly
+    static void first_pass(void *data, int index)
+    {
+        Mandelbrot *mandelbrot = (Mandelbrot*)data;
+        int size = mandelbrot->prewarmSize;
+        FractalView view = mandelbrot->view_for(size);
+        view.maxIt = 0;
+        FractalKernel kernel = get_escape_kernel(mandelbrot->type,mandelbrot->precision);
+
+        for(int row = 0; row < size && !mandelbrot->firstPass.cancelled(); row += 32)
+        {
+            int rowEnd = row + 32 < size ? row + 32 : size;
+            kernel(view,(Uint32*)mandelbrot->escapes->pixels,mandelbrot->escapes->pitch,size,size,row,rowEnd);
+        }
+    }
+
+    //Computes the samples at (x + a*step, y + b*step) for a < columns and b < rows
+    void compute_lattice(FractalKernel kernel, int size, int x, int y, int columns, int rows, int step)
+    {
+        if(columns <= 0 || rows <= 0)
+            return;
+
+        //Same pixel grid as the whole view, step times as coarse
+        FractalView view = view_for(size);
+        FractalView lattice = view;
+        lattice.pixelSize = view.pixelSize*step;
+        lattice.centerX = view.centerX + (x + (columns/2)*step - size/2)*view.pixelSize;
+        lattice.centerY = view.centerY + (y + (rows/2)*step - size/2)*view.pixelSize;
+
+        Uint8 *origin = (Uint8*)escapes->pixels + y*escapes->pitch + x*4;
+        if(step == 1)
+        {
+            kernel(lattice,(Uint32*)origin,escapes->pitch,columns,rows,0,rows);
+            return;
+        }
+
+        kernel(lattice,&scratch[0],columns*4,columns,rows,0,rows);
+        for(int b = 0; b < rows; ++b)
+        {
+            Uint32 *row = (Uint32*)(origin + b*step*escapes->pitch);
+            for(int a = 0; a < columns; ++a)
+                row[a*step] = scratch[b*columns + a];
+        }
+    }
+
+    //Shifts the samples still on screen and computes the strips uncovered, returns how many were kept
+    int pan(FractalKernel kernel, int size, int dx, int dy)
+    {
+        if(abs(dx) >= size || abs(dy) >= size)
+        {
+            compute_lattice(kernel,size,0,0,size,size,1);
+            return 0;
+        }
+
+        int keptWidth = size - abs(dx);
+        int keptHeight = size - abs(dy);
+        int fromX = dx > 0 ? dx : 0;
+        int fromY = dy > 0 ? dy : 0;
+        int toX = dx > 0 ? 0 : -dx;
+        int toY = dy > 0 ? 0 : -dy;
+
+        //Rows in the order that never overwrites one still to be moved
+        Uint8 *pixels = (Uint8*)escapes->pixels;
+        for(int i = 0; i < keptHeight; ++i)
+        {
+            int row = dy > 0 ? i : keptHeight - 1 - i;
+            memmove(pixels + (toY + row)*escapes->pitch + toX*4,pixels + (fromY + row)*escapes->pitch + fromX*4,keptWidth*4);
+        }
+
+        compute_lattice(kernel,size,0,dy > 0 ? keptHeight : 0,size,abs(dy),1);
+        compute_lattice(kernel,size,dx > 0 ? keptWidth : 0,toY,abs(dx),keptHeight,1);
+        return keptWidth*keptHeight;
+    }
+
+    //Copies count x count samples, every step-th from (x,y), into scratch
+    void keep_samples(int x, int y, int count, int step)
+    {
+        for(int b = 0; b < count; ++b)
+        {
+            const Uint32 *row = (const Uint32*)((Uint8*)escapes->pixels + (y + b*step)*escapes->pitch) + x;
+            for(int a = 0; a < count; ++a)
+                scratch[b*count + a] = row[a*step];
+        }
+    }
+
+    //Writes the samples keep_samples() took to every step-th pixel from (x,y)
+    void place_samples(int x, int y, int count, int step)
+    {
+        for(int b = 0; b < count; ++b)
+        {
+            Uint32 *row = (Uint32*)((Uint8*)escapes->pixels + (y + b*step)*escapes->pitch) + x;
+            for(int a = 0; a < count; ++a)
+                row[a*step] = scratch[b*count + a];
+        }
+    }
+
+    //After zoom has doubled: every old sample from the middle quarter lands on
+    //every other pixel, the three interleaved lattices between them are new
+    int zoom_in(FractalKernel kernel, int size)
+    {
+        int half = size/2;
+        int even = half % 2;
+        int odd = 1 - even;
+        int kept = (size - even + 1)/2;
+
+        keep_samples((half + even)/2,(half + even)/2,kept,1);
+        place_samples(even,even,kept,2);
+
+        int oddCount = (size - odd + 1)/2;
+        compute_lattice(kernel,size,odd,even,oddCount,kept,2);
+        compute_lattice(kernel,size,even,odd,kept,oddCount,2);
+        compute_lattice(kernel,size,odd,odd,oddCount,oddCount,2);
+        return kept*kept;
+    }
+
+    //After zoom has halved: every other old sample packs into the middle
+    //quarter, the border around it is new
+    int zoom_out(FractalKernel kernel, int size)
+    {
+        int half = size/2;
+        int first = (half + 1)/2;
+        int kept = (size - 1 + half)/2 - first + 1;
+
+        keep_samples(2*first - half,2*first - half,kept,2);
+        place_samples(first,first,kept,1);
+
+        int last = first + kept;
+        compute_lattice(kernel,size,0,0,size,first,1);
+        compute_lattice(kernel,size,0,last,size,size - last,1);
+        compute_lattice(kernel,size,0,first,first,kept,1);
+        compute_lattice(kernel,size,last,first,size - last,kept,1);
+        return kept*kept;
+    }
+
+    //Applies one zoom step or all the panning asked for. With reuse the grid
+    //is brought up to date from the samples it already has and the fraction
+    //reused is returned, otherwise only the view moves.
+    float navigate(int size, bool reuse)
+    {
+        FractalKernel kernel = get_escape_kernel(type,precision);
+        int kept = 0;
+
+        SDL_LockSurface(escapes);
+        if(zoomSteps != 0)
+        {
+            bool in = zoomSteps > 0;
+            zoomSteps += in ? -1 : 1;
+            zoom *= in ? 2.0 : 0.5;
+            if(reuse)
+                kept = in ? zoom_in(kernel,size) : zoom_out(kernel,size);
+        }
+        else
+        {
+            double pixelSize = view_for(size).pixelSize;
+            viewX += panX*pixelSize;
+            viewY += panY*pixelSize;
+            if(reuse)
+                kept = pan(kernel,size,panX,panY);
+            panX = 0;
+            panY = 0;
+        }
+        SDL_UnlockSurface(escapes);
+
+        return (float)kept/((float)size*size);
+    }
+
+    void update_reuse_label(float reused)
+    {
+        MemScope scope(name());
+        char label[64];
+        sprintf(label,"Reused %.1f%% of samples",reused*100.0f);
+        render_call([&]
+        {
+            mem_destroy_texture(reuseTexture);
+            SDL_Color grey = {128,128,128,255};
+            reuseTexture = render_text(label,berbas,grey);
+        });
+    }
+
+    void init()
+    {
+        SDL_SetRenderDrawColor(renderer,0,0,0,255);
+        if(goBackProcess == NULL)
+            goBackProcess = create_menu();
+        if(stream == NULL)
+            stream = new StreamingImage(1024,1024);
+
+        this->goBack = ProcessButton(goBackProcess,buttonOut,buttonIn,SCREEN_WIDTH-400,SCREEN_HEIGHT-150,128,128);
+    };
+
+    bool prewarm_step()
+    {
+        if(goBackProcess == NULL)
+        {
+            prewarm_menu(&goBackProcess);
+            return true;
+        }
+        if(!firstPass.running() && !firstPass.finished())
+        {
+            firstPass.wait();
+            prewarmSize = (int)(1024*tickScale + 0.5f);
+            firstPass.start(first_pass,this);
+        }
+        return firstPass.running();
+    };
+
+    void cancel_prewarm()
+    {
+        firstPass.cancel();
+        cancel_menu(&goBackProcess);
+    };
+
+    void handle_events(SDL_Event *event)
+    {
+        if(!finished)
+            finished = goBack.handle_events(event,&next);
+
+        if(event->type == SDL_KEYUP)
+        {
+            SDL_Keycode key = event->key.keysym.sym;
+            if(key >= SDLK_1 && key < SDLK_1 + (int)FRACTAL_TYPE_COUNT)
+            {
+                type = (FractalType)(key - SDLK_1);
+                kernelChanged = true;
+            }
+            else if(key == SDLK_p)
+            {
+                precision = (FractalPrecision)((precision + 1) % FRACTAL_PRECISION_COUNT);
+                kernelChanged = true;
+            }
+            else if(key == SDLK_c)
+            {
+                scheme = (PaletteScheme)((scheme + 1) % PALETTE_SCHEME_COUNT);
+                paletteChanged = true;
+            }
+            else if(key == SDLK_SPACE)
+            {
+                cycling = !cycling;
+                paletteChanged = true;
+            }
+            else if(key == SDLK_a && antialiasSamples >= 4)
+            {
+                antialias = !antialias;
+                antialiasChanged = true;
+            }
+        }
+
+        //On key down so holding a key repeats
+        if(event->type == SDL_KEYDOWN)
+        {
+            int step = (int)(PAN_STEP*tickScale + 0.5f);
+            switch(event->key.keysym.sym)
+            {
+                case SDLK_LEFT: panX -= step; break;
+                case SDLK_RIGHT: panX += step; break;
+                case SDLK_UP: panY -= step; break;
+                case SDLK_DOWN: panY += step; break;
+                case SDLK_PLUS: case SDLK_EQUALS: zoomSteps++; break;
+                case SDLK_MINUS: zoomSteps--; break;
+            }
+        }
+        if(event->type == SDL_MOUSEWHEEL)
+        {
+            zoomSteps += event->wheel.y;
+        }
+    };
+
+    void update(float dt)
+    {
+        goBack.prewarm();
+
+        int size = (int)(1024*tickScale + 0.5f);
+
+        if(maxIt < 0)
+        {
+            //A first pass still running when the button was clicked is thrown away
+            if(firstPass.running())
+                firstPass.cancel();
+            firstPass.wait();
+
+            if(firstPass.finished() && prewarmSize == size)
+            {
+                maxIt = 0;
+                computedSize = size;
+                recolor(size,true);
+                passSize = size;
+                frames = 0;
+                return;
+            }
+        }
+
+        bool ramp = frames >= 3000 && maxIt <= 20;
+        bool rescaled = maxIt >= 0 && (size != passSize || kernelChanged);
+        bool navigating = maxIt >= 0 && (panX != 0 || panY != 0 || zoomSteps != 0);
+
+        //Samples can only be reused from a finished grid, a refinement is simply dropped
+        bool restart = navigating && !pass.done() && !refining;
+        bool recompute = ramp || rescaled || restart;
+
+        //A refinement is colored with the palette as it was, so any change drops it
+        bool showGrid = paletteChanged || cycling || (antialiasChanged && !antialias);
+        if(refining && (navigating || recompute || showGrid))
+        {
+            pass.cancel();
+            refining = false;
+        }
+        if(antialiasChanged || paletteChanged)
+            refined = false;
+        if(paletteChanged)
+            update_kernel_label();
+        antialiasChanged = false;
+        paletteChanged = false;
+        if(cycling)
+            palette.offset += CYCLE_TURNS*dt;
+
+        if(navigating)
+        {
+            //Nothing to reuse if the whole grid is about to be recomputed
+            float reused = navigate(size,!recompute);
+            if(!recompute)
+            {
+                navigationSteps++;
+                reusedTotal += reused;
+                update_reuse_label(reused);
+                recolor(size,true);
+                showGrid = false;
+            }
+            refined = false;
+        }
+
+        if(recompute)
+        {
+            if(ramp && !rescaled)
+                maxIt++;
+
+            if(kernelChanged)
+                update_kernel_label();
+            kernelChanged = false;
+
+            //Replaces a pass still running
+            pass = compute_pass(size);
+            passSize = size;
+            frames = 0;
+            refined = false;
+        }
+        else if(pass.done() && maxIt >= 0)
+        {
+            if(showGrid)
+                recolor(computedSize,false);
+            if(antialias && !refined && !cycling)
+            {
+                pass = antialias_pass(size);
+                refining = true;
+            }
+        }
+    };
+
+    //Colors the size x size grid into the texture. The count table is only
+    //rebuilt when the grid changed, cycling just moves the palette's offset.
+    void recolor(int size, bool gridChanged)
+    {
+        Uint64 start = SDL_GetPerformanceCounter();
+        if(gridChanged || palette.scheme != scheme || palette.maxIt != maxIt)
+            palette.prepare(scheme,maxIt,(const Uint32*)escapes->pixels,escapes->pitch,size,size);
+
+        palette.colorize((const Uint32*)escapes->pixels,escapes->pitch,stream->back(),stream->pitch(),size,size);
+        stream->publish(size,size);
+        recolors++;
+        recolorTotalMs += (SDL_GetPerformanceCounter()-start)*1000.0/SDL_GetPerformanceFrequency();
+    }
+
+    //Copies size x size colors into the stream
+    void show(SDL_Surface *colors, int size)
+    {
+        Uint32 *pixels = stream->back();
+        int pitch = stream->pitch();
+        for(int y = 0; y < size; ++y)
+            memcpy((Uint8*)pixels + y*pitch,(const Uint8*)colors->pixels + y*colors->pitch,size*4);
+        stream->publish(size,size);
+    }
+
+    //Recomputes the grid PASS_ROWS rows at a time, as many per frame as the
+    //slice allows. The last finished grid stays on screen until it is done.
+    Task compute_pass(int size)
+    {
+        FractalView view = view_for(size);
+        FractalKernel kernel = get_escape_kernel(type,precision);
+        double ms = 0.0;
+        for(int row = 0; row < size; row += PASS_ROWS)
+        {
+            Uint64 start = SDL_GetPerformanceCounter();
+            SDL_LockSurface(escapes);
+            kernel(view,(Uint32*)escapes->pixels,escapes->pitch,size,size,row,row + PASS_ROWS < size ? row + PASS_ROWS : size);
+            SDL_UnlockSurface(escapes);
+            ms += (SDL_GetPerformanceCounter()-start)*1000.0/SDL_GetPerformanceFrequency();
+            co_await frame_slice();
+        }
+
+        computedSize = size;
+        recolor(size,true);
+        passMs = ms;
+    };
+
+    //Supersamples the edges of the finished grid into smoothed the same way,
+    //in the palette's current colors. The grid itself stays as it is so
+    //navigation can still reuse it and the palette can still change.
+    Task antialias_pass(int size)
+    {
+        FractalView view = view_for(size);
+        FractalKernel kernel = get_escape_kernel(type,precision);
+        AntialiasStats stats = {0,0,0,0};
+        double ms = 0.0;
+        for(int row = 0; row < size; row += PASS_ROWS)
+        {
+            Uint64 start = SDL_GetPerformanceCounter();
+            SDL_LockSurface(escapes);
+            SDL_LockSurface(smoothed);
+            antialias_rows(kernel,view,palette,(const Uint32*)escapes->pixels,escapes->pitch,(Uint32*)smoothed->pixels,smoothed->pitch,
+                           size,size,row,row + PASS_ROWS < size ? row + PASS_ROWS : size,antialiasSamples,antialiasDelta,&stats);
+            SDL_UnlockSurface(smoothed);
+            SDL_UnlockSurface(escapes);
+            ms += (SDL_GetPerformanceCounter()-start)*1000.0/SDL_GetPerformanceFrequency();
+            co_await frame_slice();
+        }
+
+        show(smoothed,size);
+        refining = false;
+        refined = true;
+
+        //Uniform supersampling would take antialiasSamples samples for every pixel
+        double refinedShare = (double)stats.refined/((double)size*size);
+        double samplesPerPixel = 1.0 + (double)stats.samples/((double)size*size);
+        refineMs = ms;
+        refinements++;
+        refinedTotal += refinedShare;
+        overheadTotal += passMs > 0.0 ? refineMs/passMs : 0.0;
+        printf("Mandelbrot antialiasing refined %.1f%% of pixels, %.1f%% over budget, %.2f samples a pixel, %.2f ms on a %.2f ms pass\n",
+               refinedShare*100.0,stats.skipped*100.0/((double)size*size),samplesPerPixel,refineMs,passMs);
+        update_antialias_label(refinedShare,samplesPerPixel);
+    };
+
+    void update_antialias_label(double refinedShare, double samplesPerPixel)
+    {
+        MemScope scope(name());
+        char label[160];
+        sprintf(label,"Antialiased %.1f%% of pixels:  %.2f samples a pixel,  +%.0f%% time  (uniform: %d,  +%.0f%%)",
+                refinedShare*100.0,samplesPerPixel,passMs > 0.0 ? refineMs/passMs*100.0 : 0.0,antialiasSamples,(antialiasSamples - 1)*100.0);
+        render_call([&]
+        {
+            mem_destroy_texture(antialiasTexture);
+            SDL_Color grey = {128,128,128,255};
+            antialiasTexture = render_text(label,berbas,grey);
+        });
+    }
+
+    void draw()
+    {
+        frames++;
+        SDL_Rect computed = {0,0,computedSize,computedSize};
+        render_stream(mandelTexture,stream,&computed,128,0,1024,1024);
+
+        int w,h;
+        SDL_QueryTexture(kernelTexture,NULL,NULL,&w,&h);
+        render_texture(kernelTexture,10,10,w/3.0f,h/3.0f);
+        if(reuseTexture != NULL)
+        {
+            SDL_QueryTexture(reuseTexture,NULL,NULL,&w,&h);
+            render_texture(reuseTexture,10,10 + h/3.0f,w/3.0f,h/3.0f);
+        }
+        if(antialiasTexture != NULL && antialias)
+        {
+            SDL_QueryTexture(antialiasTexture,NULL,NULL,&w,&h);
+            render_texture(antialiasTexture,10,10 + 2*h/3.0f,w/3.0f,h/3.0f);
+        }
+
+        goBack.draw();
+        render_texture(goBackTexture,goBack.x+goBack.width + 5,goBack.y,200,goBack.height);
+    };
+
+    const char *name()
+    {
+        return "Mandelbrot";
+    };
+
+    void write_stats(FILE *file)
+    {
+        fprintf(file,", \"navigation_steps\": %d, \"avg_reused_fraction\": %.3f",navigationSteps,navigationSteps > 0 ? reusedTotal/navigationSteps : 0.0);
+        fprintf(file,", \"recolors\": %d, \"avg_recolor_ms\": %.3f, \"palette_kernel\": \"%s\"",
+                recolors,recolors > 0 ? recolorTotalMs/recolors : 0.0,palette.kernel_name());
+        fprintf(file,", \"antialias_passes\": %d, \"avg_refined_fraction\": %.3f, \"avg_antialias_overhead\": %.3f",
+                refinements,refinements > 0 ? refinedTotal/refinements : 0.0,refinements > 0 ? overheadTotal/refinements : 0.0);
+    }
+
+    ~Mandelbrot()
+    {
+        firstPass.cancel();
+        pass.cancel();
+
+        if(goBackProcess != next)
+            delete goBackProcess;
+
+        mem_destroy_texture(goBackTexture);
+        mem_destroy_texture(mandelTexture);
+        mem_destroy_texture(kernelTexture);
+        mem_destroy_texture(reuseTexture);
+        mem_destroy_texture(antialiasTexture);
+        mem_free_surface(escapes);
+        mem_free_surface(smoothed);
+        delete stream;
+
+    }
+
+    Mandelbrot()
+    {
+        MemScope scope(name());
+        finished = false;
+        goBackProcess = NULL;
+        this->goBack = ProcessButton(goBackProcess,buttonOut,buttonIn,SCREEN_WIDTH-400,SCREEN_HEIGHT-150,128,128);
+
+        SDL_Color hatchBlue = {1,91,144,100};
+        goBackTexture = render_text("Back",berbas,hatchBlue);
+
+        escapes = mem_track_surface(SDL_CreateRGBSurfaceWithFormat(0,1024,1024,32,SDL_PIXELFORMAT_ARGB8888),"mandelbrot escapes");
+
+        //Black until the first pass is colored
+        mandelTexture = mem_track_texture(SDL_CreateTexture(renderer,SDL_PIXELFORMAT_ARGB8888,SDL_TEXTUREACCESS_STREAMING,1024,1024),"mandelbrot texture");
+        void *locked = NULL;
+        int pitch = 0;
+        if(SDL_LockTexture(mandelTexture,NULL,&locked,&pitch) == 0)
+        {
+            memset(locked,0,pitch*1024);
+            if(compositor != NULL)
+                compositor->update(mandelTexture,locked,pitch,1024,1024);
+            SDL_UnlockTexture(mandelTexture);
+        }
+        stream = NULL;
+
+        frames = 4000;
+        maxIt = -1;
+        computedSize = 1024;
+        passSize = 1024;
+
+        type = FRACTAL_MANDELBROT;
+        precision = PRECISION_FLOAT;
+        kernelChanged = false;
+        scheme = PALETTE_BANDED;
+        cycling = false;
+        paletteChanged = false;
+        recolors = 0;
+        recolorTotalMs = 0.0;
+        juliaX = -0.8;
+        juliaY = 0.156;
+
+        prewarmSize = 0;
+
+        viewX = 0.0;
+        viewY = 0.0;
+        zoom = 1.0;
+        panX = 0;
+        panY = 0;
+        zoomSteps = 0;
+        scratch.resize((1024/2 + 1)*(1024/2 + 1));
+        navigationSteps = 0;
+        reusedTotal = 0.0;
+        reuseTexture = NULL;
+
+        antialias = antialiasSamples >= 4;
+        antialiasChanged = false;
+        smoothed = mem_track_surface(SDL_CreateRGBSurfaceWithFormat(0,1024,1024,32,SDL_PIXELFORMAT_ARGB8888),"mandelbrot antialiased");
+        refining = false;
+        refined = false;
+        antialiasTexture = NULL;
+        passMs = 0.0;
+        refineMs = 0.0;
+        refinements = 0;
+        refinedTotal = 0.0;
+        overheadTotal = 0.0;
+
+        kernelTexture = NULL;
+        update_kernel_label();
+
+    };
+
+};
+
+//Animated Julia set, recomputed in parallel every frame straight into a streaming texture
+class JuliaSet : public Process
+{
+public:
+
+    ProcessButton goBack;
+
+    Process *goBackProcess;
+    SDL_Texture *goBackTexture;
+
+    SDL_Texture *juliaTexture;
+    SDL_Texture *statsTexture;
+
+    //Frames are computed here and uploaded when drawn, allocated once the screen is shown
+    StreamingImage *stream;
+
+    //c follows a circle unless the mouse is held down over the image, space toggles the circle
+    double cx;
+    double cy;
+    float pathTime;
+    bool pathPaused;
+
+    //Adjusted every frame so the compute stays inside its share of the frame budget
+    int maxIt;
+    float computeMs;
+
+    int computedSize;
+    bool frameShown;
+
+    //One band per job, each writes its iteration count into bandIterations
+    static const int BANDS = 64;
+    FractalView view;
+    FractalKernel kernel;
+    Uint32 *pixels;
+    int pitch;
+    Uint64 bandIterations[BANDS];
+
+    Uint64 statsStart;
+    int statsFrames;
+    Uint64 statsIterations;
+
+    int totalFrames;
+    Uint64 totalIterations;
+    double totalComputeMs;
+
+    static void render_band(void *data, int index)
+    {
+        JuliaSet *julia = (JuliaSet*)data;
+        int size = julia->computedSize;
+        int rowStart = size*index/BANDS;
+        int rowEnd = size*(index+1)/BANDS;
+        julia->bandIterations[index] = julia->kernel(julia->view,julia->pixels,julia->pitch,size,size,rowStart,rowEnd);
+    }
+
+    void init()
+    {
+        SDL_SetRenderDrawColor(renderer,0,0,0,255);
+        if(goBackProcess == NULL)
+            goBackProcess = create_menu();
+
+        this->goBack = ProcessButton(goBackProcess,buttonOut,buttonIn,SCREEN_WIDTH-400,SCREEN_HEIGHT-150,128,128);
+        if(stream == NULL)
+            stream = new StreamingImage(1024,1024);
+    };
+
+    bool prewarm_step()
+    {
+        return prewarm_menu(&goBackProcess);
+    };
+
+    void cancel_prewarm()
+    {
+        cancel_menu(&goBackProcess);
+    };
+
+    void handle_events(SDL_Event *event)
+    {
+        if(!finished)
+            finished = goBack.handle_events(event,&next);
+
+        if(event->type == SDL_KEYUP && event->key.keysym.sym == SDLK_SPACE)
+        {
+            pathPaused = !pathPaused;
+        }
+    };
+
+    void update(float dt)
+    {
+        goBack.prewarm();
+
+        pathTime += dt;
+        if(!frameShown)
+            return;
+
+        int mouseX,mouseY;
+        if((get_mouse_state(&mouseX,&mouseY) & SDL_BUTTON(SDL_BUTTON_LEFT)) && mouseX >= 128 && mouseX < 128+1024)
+        {
+            cx = (mouseX-128-512)/256.0;
+            cy = (mouseY-512)/256.0;
+        }
+        else if(!pathPaused)
+        {
+            cx = 0.7885*cos(pathTime*0.3);
+            cy = 0.7885*sin(pathTime*0.3);
+        }
+
+        Uint64 start = SDL_GetPerformanceCounter();
+
+        computedSize = (int)(1024*tickScale + 0.5f);
+        view.centerX = 0.0;
+        view.centerY = 0.0;
+        view.pixelSize = 4.0/computedSize;
+        view.juliaX = cx;
+        view.juliaY = cy;
+        view.maxIt = maxIt;
+
+        pixels = stream->back();
+        pitch = stream->pitch();
+        jobs_parallel_for(render_band,this,BANDS);
+        stream->publish(computedSize,computedSize);
+
+        Uint64 iterations = 0;
+        for(int i = 0; i < BANDS; ++i)
+            iterations += bandIterations[i];
+
+        computeMs = (SDL_GetPerformanceCounter()-start)*1000.0f/SDL_GetPerformanceFrequency();
+
+        //Compute gets 60% of the frame, the rest is upload and drawing
+        float budget = resolution.targetMs*0.6f;
+        if(computeMs > budget && maxIt > 16)
+            maxIt = maxIt*0.85f;
+        else if(computeMs < budget*0.7f && maxIt < 2000)
+            maxIt = maxIt*1.1f + 1;
+
+        statsFrames++;
+        statsIterations += iterations;
+        totalFrames++;
+        totalIterations += iterations;
+        totalComputeMs += computeMs;
+        frameShown = false;
+    };
+
+    void update_stats_label(float seconds)
+    {
+        MemScope scope(name());
+        AllocExempt exempt("stats label");
+        char line[160];
+        sprintf(line,"%.0f fps   %.1f M iterations/s   max  %d iterations",statsFrames/seconds,statsIterations/(seconds*1000000.0),maxIt);
+        render_call([&]
+        {
+            mem_destroy_texture(statsTexture);
+            SDL_Color grey = {128,128,128,255};
+            statsTexture = render_text(line,berbas,grey);
+        });
+    }
+
+    void draw()
+    {
+        frameShown = true;
+
+        Uint64 now = SDL_GetPerformanceCounter();
+        float seconds = (float)(now - statsStart)/SDL_GetPerformanceFrequency();
+        if(seconds >= 0.5f)
+        {
+            update_stats_label(seconds);
+            statsStart = now;
+            statsFrames = 0;
+            statsIterations = 0;
+        }
+
+        SDL_Rect computed = {0,0,computedSize,computedSize};
+        render_stream(juliaTexture,stream,&computed,128,0,1024,1024);
+
+        if(statsTexture != NULL)
+        {
+            int w,h;
+            SDL_QueryTexture(statsTexture,NULL,NULL,&w,&h);
+            render_texture(statsTexture,10,10,w/3.0f,h/3.0f);
+        }
+
+        goBack.draw();
+        render_texture(goBackTexture,goBack.x+goBack.width + 5,goBack.y,200,goBack.height);
+    };
+
+    const char *name()
+    {
+        return "JuliaSet";
+    };
+
+    void write_stats(FILE *file)
+    {
+        fprintf(file,", \"computed_frames\": %d, \"iterations\": %llu, \"avg_compute_ms\": %.3f, \"iterations_per_s\": %.0f, \"final_max_iterations\": %d",
+                totalFrames,(unsigned long long)totalIterations,totalFrames > 0 ? totalComputeMs/totalFrames : 0.0,
+                totalComputeMs > 0.0 ? totalIterations/(totalComputeMs/1000.0) : 0.0,maxIt);
+    }
+
+    ~JuliaSet()
+    {
+        if(goBackProcess != next)
+            delete goBackProcess;
+
+        mem_destroy_texture(goBackTexture);
+        mem_destroy_texture(juliaTexture);
+        mem_destroy_texture(statsTexture);
+        delete stream;
+    }
+
+    JuliaSet()
+    {
+        MemScope scope(name());
+        finished = false;
+        goBackProcess = NULL;
+        this->goBack = ProcessButton(goBackProcess,buttonOut,buttonIn,SCREEN_WIDTH-400,SCREEN_HEIGHT-150,128,128);
+
+        SDL_Color hatchBlue = {1,91,144,100};
+        goBackTexture = render_text("Back",berbas,hatchBlue);
+
+        juliaTexture = mem_track_texture(SDL_CreateTexture(renderer,SDL_PIXELFORMAT_ARGB8888,SDL_TEXTUREACCESS_STREAMING,1024,1024),"julia texture");
+        if(compositor != NULL)
+            compositor->update(juliaTexture,NULL,0,0,0);
+        statsTexture = NULL;
+        stream = NULL;
+
+        kernel = get_fractal_kernel(FRACTAL_JULIA,PRECISION_FLOAT,COLORING_SMOOTH);
+
+        cx = 0.7885;
+        cy = 0.0;
+        pathTime = 0.0f;
+        pathPaused = false;
+
+        maxIt = 64;
+        computeMs = 0.0f;
+        computedSize = 1024;
+        frameShown = true;
+
+        statsStart = SDL_GetPerformanceCounter();
+        statsFrames = 0;
+        statsIterations = 0;
+        totalFrames = 0;
+        totalIterations = 0;
+        totalComputeMs = 0.0;
+    };
+
+};
+
+class Buddhabrot : public Process
+{
+public:
+
+    ProcessButton goBack;
+
+    Process *goBackProcess;
+    SDL_Texture *goBackTexture;
+
+    SDL_Texture *densityTexture;
+    SDL_Texture *statsTexture;
+
+    BuddhabrotDensity density;
+
+    //The image is colored here and uploaded when drawn, allocated once the screen is shown
+    StreamingImage *stream;
+
+    //Low resolution escape-time map the samples are drawn from, built a few rows a frame
+    static const int MAP_SIZE = 512;
+    static const int MAP_ROWS = 16;
+    int mapRow;
+
+    //The private buffers are merged and the image redrawn this often
+    static const int MERGE_MS = 250;
+
+    //Adjusted every frame so sampling stays inside its share of the frame budget
+    int samplesPerThread;
+    float sampleMs;
+    Uint64 lastMerge;
+    bool frameShown;
+
+    Uint64 statsStart;
+    Uint64 statsSamples;
+    Uint64 statsHits;
+
+    int totalFrames;
+    double totalSampleMs;
+    double totalMergeMs;
+
+    void init()
+    {
+        SDL_SetRenderDrawColor(renderer,0,0,0,255);
+        if(goBackProcess == NULL)
+            goBackProcess = create_menu();
+        if(stream == NULL)
+            stream = new StreamingImage(density.size,density.size);
+
+        this->goBack = ProcessButton(goBackProcess,buttonOut,buttonIn,SCREEN_WIDTH-400,SCREEN_HEIGHT-150,128,128);
+    };
+
+    bool prewarm_step()
+    {
+        return prewarm_menu(&goBackProcess);
+    };
+
+    void cancel_prewarm()
+    {
+        cancel_menu(&goBackProcess);
+    };
+
+    void handle_events(SDL_Event *event)
+    {
+        if(!finished)
+            finished = goBack.handle_events(event,&next);
+    };
+
+    //Only the label, menus create their children ahead of time and most are never shown
+    Task load()
+    {
+        SDL_Color hatchBlue = {1,91,144,100};
+        goBackTexture = load_label("Back",berbas,hatchBlue);
+        co_return;
+    };
+
+    void update(float dt)
+    {
+        goBack.prewarm();
+        if(!frameShown)
+            return;
+
+        //The sampling map is built once the screen is shown, MAP_ROWS rows a frame
+        if(!density.map_ready())
+        {
+            density.build_map_rows(MAP_SIZE,mapRow,mapRow + MAP_ROWS);
+            mapRow += MAP_ROWS;
+            frameShown = false;
+            return;
+        }
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        Uint64 samples = density.samples;
+        Uint64 hits = density.hits;
+        density.sample(samplesPerThread);
+        sampleMs = (SDL_GetPerformanceCounter()-start)*1000.0f/SDL_GetPerformanceFrequency();
+
+        //Same share of the frame as the Julia screen's compute
+        float budget = resolution.targetMs*0.6f;
+        if(sampleMs > budget && samplesPerThread > 16)
+            samplesPerThread = samplesPerThread*0.85f;
+        else if(sampleMs < budget*0.7f && samplesPerThread < 1000000)
+            samplesPerThread = samplesPerThread*1.1f + 1;
+
+        statsSamples += density.samples - samples;
+        statsHits += density.hits - hits;
+        totalFrames++;
+        totalSampleMs += sampleMs;
+
+        Uint64 now = SDL_GetPerformanceCounter();
+        if((now - lastMerge)*1000 >= MERGE_MS*SDL_GetPerformanceFrequency() || density.merges == 0)
+        {
+            merge();
+            lastMerge = now;
+        }
+        frameShown = false;
+    };
+
+    //Adds up the threads' buffers and redraws the image from the total so far
+    void merge()
+    {
+        Uint64 start = SDL_GetPerformanceCounter();
+        density.merge();
+        density.colorize(stream->back(),stream->pitch());
+        stream->publish(density.size,density.size);
+        totalMergeMs += (SDL_GetPerformanceCounter()-start)*1000.0/SDL_GetPerformanceFrequency();
+    }
+
+    void update_stats_label(float seconds)
+    {
+        MemScope scope(name());
+        AllocExempt exempt("stats label");
+        char line[200];
+        if(density.map_ready())
+        {
+            //Cells the map leaves out would almost never be counted, so sampling the
+            //whole square would count this share times the map's coverage
+            double counted = density.samples > 0 ? (double)density.orbits/density.samples : 0.0;
+            sprintf(line,"%.2f M samples/s   %.1f M orbit points/s   %.1f%% counted, %.1f%% uniformly   %.0f M samples",
+                    statsSamples/(seconds*1000000.0),statsHits/(seconds*1000000.0),counted*100.0,counted*density.mapCoverage*100.0,density.samples/1000000.0);
+        }
+        else
+        {
+            sprintf(line,"Building the sampling map");
+        }
+        render_call([&]
+        {
+            mem_destroy_texture(statsTexture);
+            SDL_Color grey = {128,128,128,255};
+            statsTexture = render_text(line,berbas,grey);
+        });
+    }
+
+    void draw()
+    {
+        frameShown = true;
+
+        Uint64 now = SDL_GetPerformanceCounter();
+        float seconds = (float)(now - statsStart)/SDL_GetPerformanceFrequency();
+        if(seconds >= 0.5f)
+        {
+            update_stats_label(seconds);
+            statsStart = now;
+            statsSamples = 0;
+            statsHits = 0;
+        }
+
+        //Nothing was written to the texture before the first merge
+        if(density.merges > 0)
+            render_stream(densityTexture,stream,NULL,128,0,1024,1024);
+
+        if(statsTexture != NULL)
+        {
+            int w,h;
+            SDL_QueryTexture(statsTexture,NULL,NULL,&w,&h);
+            render_texture(statsTexture,10,10,w/3.0f,h/3.0f);
+        }
+
+        goBack.draw();
+        render_label(goBackTexture,goBack.x+goBack.width + 5,goBack.y,200,goBack.height);
+    };
+
+    const char *name()
+    {
+        return "Buddhabrot";
+    };
+
+    void write_stats(FILE *file)
+    {
+        fprintf(file,", \"samples\": %llu, \"counted_orbits\": %llu, \"orbit_points\": %llu, \"iterations\": %llu, \"avg_sample_ms\": %.3f, \"samples_per_s\": %.0f, \"merges\": %d, \"avg_merge_ms\": %.3f, \"map_coverage\": %.4f",
+                (unsigned long long)density.samples,(unsigned long long)density.orbits,(unsigned long long)density.hits,(unsigned long long)density.iterations,
+                totalFrames > 0 ? totalSampleMs/totalFrames : 0.0,totalSampleMs > 0.0 ? density.samples/(totalSampleMs/1000.0) : 0.0,
+                density.merges,density.merges > 0 ? totalMergeMs/density.merges : 0.0,density.mapCoverage);
+    }
+
+    ~Buddhabrot()
+    {
+        if(goBackProcess != next)
+            delete goBackProcess;
+
+        mem_destroy_texture(goBackTexture);
+        mem_destroy_texture(densityTexture);
+        mem_destroy_texture(statsTexture);
+        delete stream;
+    }
+
+    Buddhabrot() : density(1024,-0.4,0.0,3.2,20,1000)
+    {
+        MemScope scope(name());
+        finished = false;
+        goBackProcess = NULL;
+        this->goBack = ProcessButton(goBackProcess,buttonOut,buttonIn,SCREEN_WIDTH-400,SCREEN_HEIGHT-150,128,128);
+
+        goBackTexture = NULL;
+        densityTexture = mem_track_texture(SDL_CreateTexture(renderer,SDL_PIXELFORMAT_ARGB8888,SDL_TEXTUREACCESS_STREAMING,density.size,density.size),"buddhabrot texture");
+        if(compositor != NULL)
+            compositor->update(densityTexture,NULL,0,0,0);
+        statsTexture = NULL;
+        stream = NULL;
+
+        mapRow = 0;
+        samplesPerThread = 256;
+        sampleMs = 0.0f;
+        lastMerge = SDL_GetPerformanceCounter();
+        frameShown = true;
+
+        statsStart = SDL_GetPerformanceCounter();
+        statsSamples = 0;
+        statsHits = 0;
+        totalFrames = 0;
+        totalSampleMs = 0.0;
+        totalMergeMs = 0.0;
+
+        start_loading();
+    };
+
+};
+
+//------------------ Constructors  -------------------------
+
+IntroAnimation::IntroAnimation
+(
+        vec2d hatchPosition,
+        vec2d hatchSize,
+        float hatchEndHeight,
+        SDL_Texture *hatchTexture,
+
+        SDL_Texture *buttonOut,
+        SDL_Texture *buttonIn,
+
+        TTF_Font *font
+)
+    {
+        MemScope scope(name());
+        this->next = NULL;
+        finished = false;
+        this->aboutMeProcess = NULL;
+        this->interestsProcess = NULL;
+        this->academicsProcess = NULL;
+        this->mandelbrotProcess = NULL;
+        this->juliaProcess = NULL;
+        this->buddhabrotProcess = NULL;
+        this->aboutProcess = NULL;
+        this->hatchPosition = hatchPosition;
+        this->hatchSize = hatchSize;
+        this->hatchEndHeight = hatchEndHeight;
+
+        this->font = font;
+
+        geraldHatch = NULL;
+        aboutMeTexture = NULL;
+        interestsTexture = NULL;
+        academicsTexture = NULL;
+        exitTexture = NULL;
+        aboutTexture = NULL;
+        mandelbrotTexture = NULL;
+        juliaTexture = NULL;
+        buddhabrotTexture = NULL;
+        start_loading();
+    }
+
+//One label per slice check, the buttons work before their labels show
+Task IntroAnimation::load()
+{
+    SDL_Color hatchBlue = {1,91,144,100};
+
+    geraldHatch = load_label("Dr. Gerald G. Hatch Scholarship",font,hatchBlue);
+    co_await frame_slice();
+    aboutMeTexture = load_label("About Me",berbas,hatchBlue);
+    co_await frame_slice();
+    interestsTexture = load_label("Interests",berbas,hatchBlue);
+    co_await frame_slice();
+    academicsTexture = load_label("Academics",berbas,hatchBlue);
+    co_await frame_slice();
+    exitTexture = load_label("Exit",berbas,hatchBlue);
+    co_await frame_slice();
+    aboutTexture = load_label("About",berbas,hatchBlue);
+    co_await frame_slice();
+    mandelbrotTexture = load_label("Mandelbrot",berbas,hatchBlue);
+    co_await frame_slice();
+    juliaTexture = load_label("Julia",berbas,hatchBlue);
+    co_await frame_slice();
+    buddhabrotTexture = load_label("Buddhabrot",berbas,hatchBlue);
+}
+
+IntroAnimation::~IntroAnimation()
+{
+    //Only the screen that was picked lives on, the others were never shown
+    Process *children[] = {aboutMeProcess,interestsProcess,academicsProcess,mandelbrotProcess,juliaProcess,buddhabrotProcess,aboutProcess};
+    for(int i = 0; i < 7; ++i)
+    {
+        if(children[i] != next)
+            delete children[i];
+    }
+
+    mem_destroy_texture(geraldHatch);
+    mem_destroy_texture(aboutMeTexture);
+    mem_destroy_texture(interestsTexture);
+    mem_destroy_texture(academicsTexture);
+    mem_destroy_texture(exitTexture);
+    mem_destroy_texture(aboutTexture);
+    mem_destroy_texture(mandelbrotTexture);
+    mem_destroy_texture(juliaTexture);
+    mem_destroy_texture(buddhabrotTexture);
+}
+
+bool IntroAnimation::create_child()
+{
+    if(interestsProcess == NULL)
+        interestsProcess = new Interests();
+    else if(academicsProcess == NULL)
+        academicsProcess = new Academics();
+    else if(aboutMeProcess == NULL)
+        aboutMeProcess = new AboutMe(kaiTexture,vec2d(10,10),vec2d(240,320),buttonOut,buttonIn,berbas);
+    else if(aboutProcess == NULL)
+        aboutProcess = new About();
+    else if(mandelbrotProcess == NULL)
+        mandelbrotProcess = new Mandelbrot;
+    else if(juliaProcess == NULL)
+        juliaProcess = new JuliaSet;
+    else if(buddhabrotProcess == NULL)
+        buddhabrotProcess = new Buddhabrot;
+    else
+        return false;
+    return true;
+}
+
+//One screen per frame, so hovering a back button never costs a whole init()
+bool IntroAnimation::prewarm_step()
+{
+    bool created = false;
+    render_call([&]{created = create_child();});
+    return created;
+}
+
+void IntroAnimation::cancel_prewarm()
+{
+    render_call([&]
+    {
+        delete aboutMeProcess;
+        delete interestsProcess;
+        delete academicsProcess;
+        delete mandelbrotProcess;
+        delete juliaProcess;
+        delete buddhabrotProcess;
+        delete aboutProcess;
+    });
+    aboutMeProcess = NULL;
+    interestsProcess = NULL;
+    academicsProcess = NULL;
+    mandelbrotProcess = NULL;
+    juliaProcess = NULL;
+    buddhabrotProcess = NULL;
+    aboutProcess = NULL;
+}
+
+void IntroAnimation::init()
+{
+    SDL_SetRenderDrawColor(renderer,255,255,255,255);
+    while(create_child())
+    {
+
+    }
+
+    this->aboutMe = ProcessButton(aboutMeProcess,buttonOut,buttonIn,10,370,128,128);
+    this->interests = ProcessButton(interestsProcess,buttonOut,buttonIn,436,370,128,128);
+    this->academics = ProcessButton(academicsProcess,buttonOut,buttonIn,10,706,128,128);
+    this->exit = ProcessButton(NULL,buttonOut,buttonIn,862,706,128,128);
+    this->about = ProcessButton(aboutProcess,buttonOut,buttonIn,862,370,128,128);
+    this->mandelbrot = ProcessButton(mandelbrotProcess,buttonOut,buttonIn,436,706,128,128);
+    this->julia = ProcessButton(juliaProcess,buttonOut,buttonIn,436,870,128,128);
+    this->buddhabrot = ProcessButton(buddhabrotProcess,buttonOut,buttonIn,10,870,128,128);
+}
+
+//------------------ Profiling  -------------------------
+
+//Frame time and memory statistics drawn over the current screen, toggled with F3
+class ProfilerOverlay
+{
+public:
+
+    bool visible;
+
+    float elapsed;
+    int frames;
+    float frameTime;
+    float worstFrame;
+
+    //Heap allocations over the current half second, and per frame over the last one
+    Uint64 allocations;
+    Uint64 allocatedBytes;
+    float frameAllocations;
+    float frameAllocatedBytes;
+
+    std::vector<SDL_Texture*> lines;
+
+    ProfilerOverlay()
+    {
+        visible = false;
+        elapsed = 0.0f;
+        frames = 0;
+        frameTime = 0.0f;
+        worstFrame = 0.0f;
+        allocations = 0;
+        allocatedBytes = 0;
+        frameAllocations = 0.0f;
+        frameAllocatedBytes = 0.0f;
+    };
+
+    ~ProfilerOverlay()
+    {
+        clear();
+    };
+
+    void clear()
+    {
+        for(unsigned int i = 0; i < lines.size(); ++i)
+        {
+            mem_destroy_texture(lines[i]);
+        }
+        lines.clear();
+    }
+
+    void handle_events(SDL_Event *event)
+    {
+        if(event->type == SDL_KEYUP && event->key.keysym.sym == SDLK_F3)
+        {
+            visible = !visible;
+            if(!visible)
+                clear();
+        }
+    }
+
+    //Called once per presented frame before alloc_begin_frame(), text is only re-rendered twice a second
+    void frame(float dt, Process *process)
+    {
+        elapsed += dt;
+        frames++;
+        if(dt > worstFrame)
+            worstFrame = dt;
+
+        AllocCounts counts = alloc_frame_counts();
+        allocations += counts.allocations;
+        allocatedBytes += counts.bytes;
+
+        if(elapsed >= 0.5f)
+        {
+            frameTime = elapsed/frames;
+            frameAllocations = (float)allocations/frames;
+            frameAllocatedBytes = (float)allocatedBytes/frames;
+            if(visible)
+                rebuild(process);
+            elapsed = 0.0f;
+            frames = 0;
+            worstFrame = 0.0f;
+            allocations = 0;
+            allocatedBytes = 0;
+        }
+    }
+
+    void rebuild(Process *process)
+    {
+        MemScope scope("Overlay");
+        AllocExempt exempt("overlay");
+        clear();
+
+        SDL_Color grey = {128,128,128,255};
+        char line[160];
+
+        sprintf(line,"Frame:  %.2f ms  (%.0f fps,  worst  %.2f ms)",frameTime*1000.0f,1.0f/frameTime,worstFrame*1000.0f);
+        lines.push_back(render_text(line,berbas,grey));
+
+        sprintf(line,"Textures:  %.1f MB  (peak  %.1f MB,  budget  %.0f MB)",mem_current_bytes()/1048576.0,mem_peak_bytes()/1048576.0,mem_get_budget()/1048576.0);
+        lines.push_back(render_text(line,berbas,grey));
+
+        sprintf(line,"%s:  %.1f MB  (peak  %.1f MB)",process->name(),mem_screen_bytes(process->name())/1048576.0,mem_screen_peak_bytes(process->name())/1048576.0);
+        lines.push_back(render_text(line,berbas,grey));
+
+        sprintf(line,"Render  scale:  %.2f  (average  %.2f ms,  target  %.2f ms)",resolution.scale,resolution.averageMs,resolution.targetMs);
+        lines.push_back(render_text(line,berbas,grey));
+
+        if(alloc_tracking_enabled())
+            sprintf(line,"Heap:  %.1f  allocations  (%.1f KB)  per  frame",frameAllocations,frameAllocatedBytes/1024.0f);
+        else
+            sprintf(line,"Heap:  not  tracked  in  this  build");
+        lines.push_back(render_text(line,berbas,grey));
+    }
+
+    void draw()
+    {
+        if(!visible)
+            return;
+
+        for(unsigned int i = 0; i < lines.size(); ++i)
+        {
+            int w,h;
+            SDL_QueryTexture(lines[i],NULL,NULL,&w,&h);
+            render_texture(lines[i],10,10+i*28,w/4.0f,h/4.0f);
+        }
+    }
+
+};
+
+//Sizes are the largest each image is drawn at. The photos get mip chains
+//because the render scale draws them smaller still.
+void load_assets()
+{
+    hatchTexture = load_texture("assets/hatch_logo.png",1024,128);
+    buttonOut = load_texture("assets/button_out.png",128,128);
+    buttonIn = load_texture("assets/button_in.png",128,128);
+    kaiTexture = load_texture("assets/terriblePhoto.jpg",240,320,true);
+    alexTexture = load_texture("assets/Alexander_The_Great.jpg",300,300,true);
+    napoleonTexture = load_texture("assets/Napoleon_Alps.jpg",400,473,true);
+    codeTexture = load_texture("assets/code.png",494,640,true);
+    aluTexture = load_texture("assets/ALU.png",500,400,true);
+    cpuTexture = load_texture("assets/cpu.jpg",300,300,true);
+    higgsTexture = load_texture("assets/higgs.jpg",500,500,true);
+    nuclearTexture = load_texture("assets/reactor.jpg",470,400,true);
+    waterlooTexture = load_texture("assets/waterloo.png",450,250,true);
+    queenTexture = load_texture("assets/queen.png",450,250,true);
+    awardsTexture = load_texture("assets/awards.png",1150,2050);
+    sdlTexture = load_texture("assets/sdl.png",179,99);
+    gccTexture = load_texture("assets/gcc.gif",109,130);
+    cbTexture = load_texture("assets/codeblocks.png",128,128);
+    mingwTexture = load_texture("assets/mingw.png",229,60);
+    cppTexture = load_texture("assets/cpp.jpg",180,97);
+
+    berbas = TTF_OpenFont("assets/berbas.ttf",96);
+}
+
+void free_assets()
+{
+    TTF_CloseFont(berbas);
+
+    free_texture(buttonIn);
+    free_texture(buttonOut);
+    free_texture(hatchTexture);
+    free_texture(kaiTexture);
+    free_texture(alexTexture);
+    free_texture(napoleonTexture);
+    free_texture(codeTexture);
+    free_texture(aluTexture);
+    free_texture(cpuTexture);
+    free_texture(higgsTexture);
+    free_texture(nuclearTexture);
+    free_texture(waterlooTexture);
+    free_texture(queenTexture);
+    free_texture(awardsTexture);
+    free_texture(sdlTexture);
+    free_texture(gccTexture);
+    free_texture(cbTexture);
+    free_texture(mingwTexture);
+    free_texture(cppTexture);
+}
+
+const int BENCHMARK_SCREENS = 8;
+
+//Creates one of the screens reachable from the menu
+Process *create_screen(int index)
+{
+    switch(index)
+    {
+        case 0: return new IntroAnimation(vec2d(44.0f,-1000.0f),vec2d(1024,128),10,hatchTexture,buttonOut,buttonIn,berbas);
+        case 1: return new Interests();
+        case 2: return new AboutMe(kaiTexture,vec2d(10,10),vec2d(240,320),buttonOut,buttonIn,berbas);
+        case 3: return new Academics();
+        case 4: return new About();
+        case 5: return new Mandelbrot;
+        case 6: return new JuliaSet;
+        case 7: return new Buddhabrot;
+    }
+    return NULL;
+}
+
+const char *PACK_PATH = "assets/assets.pack";
+
+//Loads every asset and renders every label into an asset pack
+int write_pack(const char *path)
+{
+    packWriter = new PackWriter();
+
+    load_assets();
+    for(int i = 0; i < BENCHMARK_SCREENS; ++i)
+    {
+        Process *process = create_screen(i);
+        process->init();
+        process->finish_loading();
+        delete process;
+    }
+    free_assets();
+
+    bool written = packWriter->write(path);
+    delete packWriter;
+    packWriter = NULL;
+    return written ? 0 : -1;
+}
+
+//Time from nothing loaded to the menu ready to draw, in milliseconds
+double measure_startup(bool usePack)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    if(usePack)
+        pack_open(PACK_PATH);
+    load_assets();
+    Process *process = create_screen(0);
+    process->init();
+    process->finish_loading();
+
+    double ms = (SDL_GetPerformanceCounter()-start)*1000.0/SDL_GetPerformanceFrequency();
+
+    delete process;
+    free_assets();
+    pack_close();
+    return ms;
+}
+
+//Times every fractal kernel instantiation on the same view
+void benchmark_kernels(FILE *file)
+{
+    const int size = 512;
+    std::vector<Uint32> pixels(size*size);
+
+    FractalView view;
+    view.centerX = 0.0;
+    view.centerY = 0.0;
+    view.pixelSize = 4.0/size;
+    view.juliaX = -0.8;
+    view.juliaY = 0.156;
+    view.maxIt = 64;
+
+    fprintf(file,"  \"kernel_size\": %d,\n  \"kernel_max_iterations\": %d,\n  \"kernels\": [\n",size,view.maxIt);
+
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    for(int t = 0; t < FRACTAL_TYPE_COUNT; ++t)
+    {
+        for(int p = 0; p < FRACTAL_PRECISION_COUNT; ++p)
+        {
+            for(int c = 0; c < FRACTAL_COLORING_COUNT; ++c)
+            {
+                FractalKernel kernel = get_fractal_kernel((FractalType)t,(FractalPrecision)p,(FractalColoring)c);
+
+                Uint64 start = SDL_GetPerformanceCounter();
+                Uint64 iterations = kernel(view,&pixels[0],size*4,size,size,0,size);
+                double ms = (SDL_GetPerformanceCounter()-start)*1000.0/frequency;
+
+                bool last = t+1 == FRACTAL_TYPE_COUNT && p+1 == FRACTAL_PRECISION_COUNT && c+1 == FRACTAL_COLORING_COUNT;
+                fprintf(file,"    {\"formula\": \"%s\", \"precision\": \"%s\", \"coloring\": \"%s\", \"ms\": %.3f, \"mpixels_per_s\": %.2f, \"iterations\": %llu, \"giterations_per_s\": %.3f}%s\n",
+                        FRACTAL_TYPE_NAMES[t],FRACTAL_PRECISION_NAMES[p],FRACTAL_COLORING_NAMES[c],ms,size*size/(ms*1000.0),
+                        (unsigned long long)iterations,iterations/(ms*1000000.0),last ? "" : ",");
+                printf("%-14s %-14s %-8s %8.3f ms\n",FRACTAL_TYPE_NAMES[t],FRACTAL_PRECISION_NAMES[p],FRACTAL_COLORING_NAMES[c],ms);
+            }
+        }
+    }
+
+    fprintf(file,"  ],\n");
+}
+
+//One update and one presented draw, as the benchmarks run them
+void run_frame(Process *process, float dt)
+{
+    update_process(process,dt);
+    begin_scene(tickScale);
+    process->draw();
+    end_scene();
+    SDL_RenderPresent(renderer);
+}
+
+//Runs every screen past its first frames and fails if any later frame allocates
+int run_alloc_test(int frames)
+{
+    const int warmupFrames = 120;
+    const float dt = 1.0f/60.0f;
+    bool failed = false;
+
+    pack_open(PACK_PATH);
+    load_assets();
+
+    for(int i = 0; i < BENCHMARK_SCREENS; ++i)
+    {
+        Process *process = create_screen(i);
+        process->init();
+
+        for(int frame = 0; frame < warmupFrames && !process->finished; ++frame)
+        {
+            run_frame(process,dt);
+        }
+
+        alloc_clear_sites();
+        alloc_set_recording(true);
+        alloc_begin_frame();
+
+        Uint64 allocations = 0;
+        Uint64 bytes = 0;
+        Uint64 exempt = 0;
+        int allocatingFrames = 0;
+        int frame = 0;
+        for(; frame < frames && !process->finished; ++frame)
+        {
+            run_frame(process,dt);
+
+            AllocCounts counts = alloc_frame_counts();
+            alloc_begin_frame();
+            allocations += counts.allocations;
+            bytes += counts.bytes;
+            exempt += counts.exempt;
+            if(counts.allocations > 0)
+                allocatingFrames++;
+        }
+        alloc_set_recording(false);
+
+        printf("%-16s %-4s %llu allocations (%.1f KB) in %d of %d frames, %llu exempt\n",process->name(),allocations > 0 ? "FAIL" : "ok",
+               (unsigned long long)allocations,bytes/1024.0,allocatingFrames,frame,(unsigned long long)exempt);
+        if(allocations > 0 || exempt > 0)
+            alloc_report(stdout,10);
+        if(allocations > 0)
+            failed = true;
+
+        delete process;
+    }
+
+    free_assets();
+    pack_close();
+
+    printf(failed ? "Steady-state frames allocated\n" : "No steady-state allocations\n");
+    return failed ? 1 : 0;
+}
+
+//Time from a click to the first present of every screen, cold and after prewarming
+void benchmark_transitions(FILE *file)
+{
+    fprintf(file,"  \"transitions\": [\n");
+
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    for(int i = 0; i < BENCHMARK_SCREENS; ++i)
+    {
+        double ms[2];
+        int steps = 0;
+        const char *name = "";
+        for(int prewarmed = 0; prewarmed < 2; ++prewarmed)
+        {
+            Process *process = create_screen(i);
+            name = process->name();
+
+            //As if the mouse rested on the button until all the work was done
+            while(prewarmed && process->prewarm_step())
+            {
+                steps++;
+                SDL_Delay(1);
+            }
+
+            Uint64 start = SDL_GetPerformanceCounter();
+
+            process->init();
+            update_process(process,1.0f/60.0f);
+            begin_scene(tickScale);
+            process->draw();
+            end_scene();
+            SDL_RenderPresent(renderer);
+
+            ms[prewarmed] = (SDL_GetPerformanceCounter()-start)*1000.0/frequency;
+            delete process;
+        }
+
+        fprintf(file,"    {\"name\": \"%s\", \"cold_ms\": %.3f, \"prewarmed_ms\": %.3f, \"prewarm_steps\": %d}%s\n",
+                name,ms[0],ms[1],steps,i+1 < BENCHMARK_SCREENS ? "," : "");
+        printf("%-16s %8.3f ms cold %8.3f ms prewarmed\n",name,ms[0],ms[1]);
+    }
+
+    fprintf(file,"  ],\n");
+}
+
+//A fixed walk through the Mandelbrot viewer, each step updated from the samples
+//already computed and then recomputed from scratch for comparison
+void benchmark_navigation(FILE *file)
+{
+    Mandelbrot *mandelbrot = new Mandelbrot;
+    mandelbrot->init();
+    mandelbrot->update(1.0f/60.0f);
+    mandelbrot->pass.finish();
+
+    //Enough iterations for the compute to dominate
+    int size = mandelbrot->computedSize;
+    mandelbrot->precision = PRECISION_DOUBLE;
+    mandelbrot->maxIt = 256;
+    mandelbrot->viewX = -0.75;
+    FractalKernel kernel = get_escape_kernel(mandelbrot->type,mandelbrot->precision);
+    kernel(mandelbrot->view_for(size),(Uint32*)mandelbrot->escapes->pixels,mandelbrot->escapes->pitch,size,size,0,size);
+
+    const char *names[] = {"pan right","pan down","pan left and up","zoom in","zoom in","pan right","zoom out"};
+    const int steps[][3] = {{64,0,0},{0,64,0},{-32,-32,0},{0,0,1},{0,0,1},{128,0,0},{0,0,-1}};
+    const int stepCount = sizeof(steps)/sizeof(steps[0]);
+
+    fprintf(file,"  \"navigation\": [\n");
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    for(int i = 0; i < stepCount; ++i)
+    {
+        mandelbrot->panX = steps[i][0];
+        mandelbrot->panY = steps[i][1];
+        mandelbrot->zoomSteps = steps[i][2];
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        float reused = mandelbrot->navigate(size,true);
+        double reuseMs = (SDL_GetPerformanceCounter()-start)*1000.0/frequency;
+
+        start = SDL_GetPerformanceCounter();
+        kernel(mandelbrot->view_for(size),(Uint32*)mandelbrot->escapes->pixels,mandelbrot->escapes->pitch,size,size,0,size);
+        double fullMs = (SDL_GetPerformanceCounter()-start)*1000.0/frequency;
+
+        fprintf(file,"    {\"step\": \"%s\", \"reused_fraction\": %.3f, \"reuse_ms\": %.3f, \"full_ms\": %.3f}%s\n",
+                names[i],reused,reuseMs,fullMs,i+1 < stepCount ? "," : "");
+        printf("%-16s %5.1f%% reused %8.3f ms, %8.3f ms recomputed\n",names[i],reused*100.0f,reuseMs,fullMs);
+    }
+    fprintf(file,"  ],\n");
+
+    delete mandelbrot;
+}
+
+//Edge-only supersampling against one sample a pixel and against supersampling
+//every pixel, on the home view and on a zoom into the seahorse valley
+void benchmark_antialiasing(FILE *file)
+{
+    const int size = 512;
+    int maxSamples = antialiasSamples >= 4 ? antialiasSamples : 16;
+    int n = 2;
+    while((n + 1)*(n + 1) <= maxSamples && n < 64)
+        n++;
+
+    std::vector<Uint32> escapes(size*size);
+    std::vector<Uint32> pixels(size*size);
+    std::vector<Uint32> smoothed(size*size);
+    std::vector<Uint32> uniform((size_t)size*n*size*n);
+    FractalPalette palette;
+
+    const char *names[] = {"home","seahorse valley"};
+    const double views[][3] = {{-0.75,0.0,3.0},{-0.7436,0.1318,0.01}};
+    const int viewCount = sizeof(views)/sizeof(views[0]);
+
+    fprintf(file,"  \"antialiasing\": {\"size\": %d, \"max_samples\": %d, \"count_delta\": %d, \"budget\": %.2f, \"uniform_samples\": %d, \"views\": [\n",
+            size,maxSamples,antialiasDelta,ANTIALIAS_BUDGET,n*n);
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    for(int v = 0; v < viewCount; ++v)
+    {
+        for(int c = 0; c < PALETTE_SCHEME_COUNT; ++c)
+        {
+            FractalKernel kernel = get_escape_kernel(FRACTAL_MANDELBROT,PRECISION_DOUBLE);
+            FractalView view;
+            view.centerX = views[v][0];
+            view.centerY = views[v][1];
+            view.pixelSize = views[v][2]/size;
+            view.juliaX = 0.0;
+            view.juliaY = 0.0;
+            view.maxIt = 256;
+
+            Uint64 start = SDL_GetPerformanceCounter();
+            kernel(view,&escapes[0],size*4,size,size,0,size);
+            palette.prepare((PaletteScheme)c,view.maxIt,&escapes[0],size*4,size,size);
+            palette.colorize(&escapes[0],size*4,&pixels[0],size*4,size,size);
+            double singleMs = (SDL_GetPerformanceCounter()-start)*1000.0/frequency;
+
+            AntialiasStats stats = {0,0,0,0};
+            start = SDL_GetPerformanceCounter();
+            antialias_rows(kernel,view,palette,&escapes[0],size*4,&smoothed[0],size*4,size,size,0,size,maxSamples,antialiasDelta,&stats);
+            double adaptiveMs = (SDL_GetPerformanceCounter()-start)*1000.0/frequency;
+
+            //The same n x n points inside every pixel, then a box filter
+            FractalView fine = view;
+            fine.pixelSize = view.pixelSize/n;
+            fine.centerX = view.centerX - 0.5*view.pixelSize + 0.5*fine.pixelSize;
+            fine.centerY = view.centerY - 0.5*view.pixelSize + 0.5*fine.pixelSize;
+            start = SDL_GetPerformanceCounter();
+            kernel(fine,&uniform[0],size*n*4,size*n,size*n,0,size*n);
+            palette.colorize(&uniform[0],size*n*4,&uniform[0],size*n*4,size*n,size*n);
+            for(int y = 0; y < size; ++y)
+            {
+                for(int x = 0; x < size; ++x)
+                {
+                    Uint32 r = 0;
+                    Uint32 g = 0;
+                    Uint32 b = 0;
+                    for(int j = 0; j < n; ++j)
+                    {
+                        const Uint32 *sample = &uniform[((size_t)y*n + j)*size*n + x*n];
+                        for(int i = 0; i < n; ++i)
+                        {
+                            r += (sample[i] >> 16) & 0xFF;
+                            g += (sample[i] >> 8) & 0xFF;
+                            b += sample[i] & 0xFF;
+                        }
+                    }
+                    smoothed[y*size + x] = 0xFF000000 | (r/(n*n) << 16) | (g/(n*n) << 8) | b/(n*n);
+                }
+            }
+            double uniformMs = (SDL_GetPerformanceCounter()-start)*1000.0/frequency;
+
+            double refined = (double)stats.refined/(size*size);
+            double adaptiveOverhead = singleMs > 0.0 ? adaptiveMs/singleMs : 0.0;
+            double uniformOverhead = singleMs > 0.0 ? uniformMs/singleMs - 1.0 : 0.0;
+            bool last = v+1 == viewCount && c+1 == PALETTE_SCHEME_COUNT;
+            fprintf(file,"    {\"view\": \"%s\", \"palette\": \"%s\", \"refined_fraction\": %.4f, \"escalated_fraction\": %.4f, \"skipped_fraction\": %.4f, \"samples_per_pixel\": %.3f, "
+                    "\"single_ms\": %.3f, \"adaptive_ms\": %.3f, \"uniform_ms\": %.3f, \"adaptive_overhead\": %.3f, \"uniform_overhead\": %.3f}%s\n",
+                    names[v],PALETTE_SCHEME_NAMES[c],refined,(double)stats.escalated/(size*size),(double)stats.skipped/(size*size),1.0 + (double)stats.samples/(size*size),
+                    singleMs,adaptiveMs,uniformMs,adaptiveOverhead,uniformOverhead,last ? "" : ",");
+            printf("%-16s %-9s %5.1f%% refined, +%5.1f%% time, uniform %dx%d +%6.1f%%\n",
+                   names[v],PALETTE_SCHEME_NAMES[c],refined*100.0,adaptiveOverhead*100.0,n,n,uniformOverhead*100.0);
+        }
+    }
+    fprintf(file,"  ]},\n");
+}
+
+//Recoloring a stored grid in every scheme, per frame as palette cycling does
+//it, against computing the grid again
+void benchmark_palette(FILE *file)
+{
+    const int size = 1024;
+    const int frames = 30;
+    std::vector<Uint32> escapes(size*size);
+    std::vector<Uint32> pixels(size*size);
+    FractalPalette palette;
+
+    FractalView view;
+    view.centerX = -0.75;
+    view.centerY = 0.0;
+    view.pixelSize = 3.0/size;
+    view.juliaX = 0.0;
+    view.juliaY = 0.0;
+    view.maxIt = 256;
+
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 start = SDL_GetPerformanceCounter();
+    Uint64 iterations = get_escape_kernel(FRACTAL_MANDELBROT,PRECISION_DOUBLE)(view,&escapes[0],size*4,size,size,0,size);
+    double computeMs = (SDL_GetPerformanceCounter()-start)*1000.0/frequency;
+
+    fprintf(file,"  \"palette\": {\"size\": %d, \"kernel\": \"%s\", \"compute_ms\": %.3f, \"iterations\": %llu, \"schemes\": [\n",
+            size,palette.kernel_name(),computeMs,(unsigned long long)iterations);
+    printf("Palette %s, grid computed in %.3f ms\n",palette.kernel_name(),computeMs);
+    for(int c = 0; c < PALETTE_SCHEME_COUNT; ++c)
+    {
+        start = SDL_GetPerformanceCounter();
+        palette.prepare((PaletteScheme)c,view.maxIt,&escapes[0],size*4,size,size);
+        double prepareMs = (SDL_GetPerformanceCounter()-start)*1000.0/frequency;
+
+        start = SDL_GetPerformanceCounter();
+        for(int frame = 0; frame < frames; ++frame)
+        {
+            palette.offset = frame/60.0*0.1;
+            palette.colorize(&escapes[0],size*4,&pixels[0],size*4,size,size);
+        }
+        double colorizeMs = (SDL_GetPerformanceCounter()-start)*1000.0/frequency/frames;
+
+        fprintf(file,"    {\"scheme\": \"%s\", \"prepare_ms\": %.3f, \"colorize_ms\": %.3f, \"mpixels_per_s\": %.1f, \"speedup\": %.1f}%s\n",
+                PALETTE_SCHEME_NAMES[c],prepareMs,colorizeMs,size*size/(colorizeMs*1000.0),colorizeMs > 0.0 ? computeMs/colorizeMs : 0.0,
+                c+1 < PALETTE_SCHEME_COUNT ? "," : "");
+        printf("%-16s %8.3f ms prepare %8.3f ms a recolor, %6.1fx faster than computing\n",
+               PALETTE_SCHEME_NAMES[c],prepareMs,colorizeMs,colorizeMs > 0.0 ? computeMs/colorizeMs : 0.0);
+    }
+    fprintf(file,"  ]},\n");
+}
+
+//Average frame time of every screen drawn by the renderer and by the compositor
+void benchmark_compositor(FILE *file)
+{
+    if(compositor == NULL)
+    {
+        fprintf(file,"  \"compositor\": null,\n");
+        return;
+    }
+
+    const int frames = 120;
+    const float dt = 1.0f/60.0f;
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+
+    SDL_RendererInfo info;
+    SDL_GetRendererInfo(renderer,&info);
+    fprintf(file,"  \"compositor\": {\"renderer\": \"%s\", \"kernel\": \"%s\", \"screens\": [\n",info.name,compositor->kernel_name());
+
+    bool wasComposited = useCompositor;
+    for(int i = 0; i < BENCHMARK_SCREENS; ++i)
+    {
+        double ms[2] = {0.0,0.0};
+        const char *name = "";
+        for(int composited = 0; composited < 2; ++composited)
+        {
+            useCompositor = composited != 0;
+            Process *process = create_screen(i);
+            name = process->name();
+            process->init();
+
+            //Past the first frames, which load rather than draw
+            int frame = 0;
+            for(; frame < 10 && !process->finished; ++frame)
+                run_frame(process,dt);
+
+            Uint64 start = SDL_GetPerformanceCounter();
+            for(frame = 0; frame < frames && !process->finished; ++frame)
+                run_frame(process,dt);
+            if(frame > 0)
+                ms[composited] = (SDL_GetPerformanceCounter()-start)*1000.0/frequency/frame;
+
+            delete process;
+        }
+
+        fprintf(file,"    {\"name\": \"%s\", \"renderer_ms\": %.3f, \"compositor_ms\": %.3f}%s\n",
+                name,ms[0],ms[1],i+1 < BENCHMARK_SCREENS ? "," : "");
+        printf("%-16s %8.3f ms %s %8.3f ms compositor (%s)\n",name,ms[0],info.name,ms[1],compositor->kernel_name());
+    }
+    useCompositor = wasComposited;
+
+    fprintf(file,"  ]},\n");
+}
+
+//Stops --capture once everything queued is written and prints what was recorded
+CaptureStats finish_capture()
+{
+    CaptureStats stats;
+    SDL_zero(stats);
+    if(frameCapture == NULL)
+        return stats;
+
+    frameCapture->stop();
+    stats = frameCapture->stats();
+    delete frameCapture;
+    frameCapture = NULL;
+
+    int readFrames = stats.captured > 0 ? stats.captured : 1;
+    int written = stats.written > 0 ? stats.written : 1;
+    printf("Captured %d frames, wrote %d (%.1f MB), dropped %d with the queue full and %d after a resize, waited for the encoder %d times (%.1f ms), queue peaked at %d\n",
+           stats.captured,stats.written,stats.bytes/1048576.0,stats.dropped,stats.resized,stats.waited,stats.waitMs,stats.maxQueued);
+    printf("Readback %.3f ms a frame on the draw thread, encoding %.3f ms a frame on the encoder thread, checksum %016llx\n",
+           stats.readbackMs/readFrames,stats.encodeMs/written,(unsigned long long)stats.checksum);
+    return stats;
+}
+
+//Runs every screen for a fixed number of frames and writes the timings as JSON
+int run_benchmark(const char *path)
+{
+    const int benchFrames = 300;
+    const float dt = 1.0f/60.0f;
+
+    FILE *file = fopen(path,"w");
+    if(file == NULL)
+    {
+        printf("Could not open %s\n",path);
+        return -1;
+    }
+
+    //The first load warms the file cache so both timed loads start equal
+    measure_startup(false);
+    double filesMs = measure_startup(false);
+    bool havePack = pack_open(PACK_PATH);
+    pack_close();
+    double packMs = havePack ? measure_startup(true) : 0.0;
+
+    printf("Startup from loose files %8.3f ms\n",filesMs);
+    if(havePack)
+        printf("Startup from asset pack  %8.3f ms\n",packMs);
+    else
+        printf("No asset pack at %s, run with --pack to create one\n",PACK_PATH);
+
+    char packValue[32] = "null";
+    if(havePack)
+        sprintf(packValue,"%.3f",packMs);
+    fprintf(file,"{\n  \"startup\": {\"files_ms\": %.3f, \"pack_ms\": %s},\n",filesMs,packValue);
+
+    if(havePack)
+        pack_open(PACK_PATH);
+    load_assets();
+
+    fprintf(file,"  \"render_scale\": %.2f,\n  \"frames_per_screen\": %d,\n  \"screens\": [\n",resolution.scale,benchFrames);
+
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+
+    for(int i = 0; i < BENCHMARK_SCREENS; ++i)
+    {
+        Process *process = create_screen(i);
+        process->init();
+
+        double total = 0.0;
+        double worst = 0.0;
+        int frames = 0;
+        for(; frames < benchFrames && !process->finished; ++frames)
+        {
+            Uint64 start = SDL_GetPerformanceCounter();
+
+            run_frame(process,dt);
+
+            double ms = (SDL_GetPerformanceCounter()-start)*1000.0/frequency;
+            total += ms;
+            if(ms > worst)
+                worst = ms;
+        }
+
+        fprintf(file,"    {\"name\": \"%s\", \"frames\": %d, \"avg_frame_ms\": %.3f, \"max_frame_ms\": %.3f, \"texture_bytes\": %lld, \"texture_peak_bytes\": %lld",
+                process->name(),frames,frames > 0 ? total/frames : 0.0,worst,
+                mem_screen_bytes(process->name()),mem_screen_peak_bytes(process->name()));
+        process->write_stats(file);
+        fprintf(file,"}%s\n",i+1 < BENCHMARK_SCREENS ? "," : "");
+
+        printf("%-16s %8.3f ms avg %8.3f ms max\n",process->name(),frames > 0 ? total/frames : 0.0,worst);
+
+        delete process;
+    }
+
+    fprintf(file,"  ],\n");
+
+    benchmark_kernels(file);
+    benchmark_transitions(file);
+    benchmark_navigation(file);
+    benchmark_antialiasing(file);
+    benchmark_palette(file);
+    benchmark_compositor(file);
+
+    //Frames of every benchmark above, the checksum tells whether two builds drew the same thing
+    if(frameCapture != NULL)
+    {
+        CaptureStats capture = finish_capture();
+        fprintf(file,"  \"capture\": {\"captured\": %d, \"written\": %d, \"dropped\": %d, \"waited\": %d, \"wait_ms\": %.3f, \"max_queued\": %d, \"readback_ms\": %.3f, \"encode_ms\": %.3f, \"bytes\": %llu, \"checksum\": \"%016llx\"},\n",
+                capture.captured,capture.written,capture.dropped,capture.waited,capture.waitMs,capture.maxQueued,
+                capture.captured > 0 ? capture.readbackMs/capture.captured : 0.0,capture.written > 0 ? capture.encodeMs/capture.written : 0.0,
+                (unsigned long long)capture.bytes,(unsigned long long)capture.checksum);
+    }
+
+    fprintf(file,"  \"memory\": ");
+    mem_write_json(file);
+    fprintf(file,"\n}\n");
+    fclose(file);
+
+    printf("Benchmark written to %s\n",path);
+    return 0;
+}
+
+//Renders one large Mandelbrot image across worker processes and saves it as a PNG.
+//With localWorkers > 0 that many workers are started on this machine first,
+//localOptions going to the first of them only.
+int run_distributed_render(const char *path, const RenderJob &job, std::vector<std::string> workers,
+                           int localWorkers, bool localTcp, const std::string &localOptions, const char *executable)
+{
+    if(localWorkers > 0)
+    {
+        //Split the cores between them rather than have every worker use all of them
+        int threads = SDL_GetCPUCount()/localWorkers;
+        char threadOption[32];
+        sprintf(threadOption,"--worker-threads %d",threads > 0 ? threads : 1);
+
+        std::vector<std::string> options(localWorkers,threadOption);
+        options[0] += " " + localOptions;
+        if(!render_spawn_local_workers(executable,localWorkers,localTcp,options,workers))
+        {
+            render_stop_local_workers();
+            return -1;
+        }
+    }
+    if(workers.empty())
+    {
+        printf("No workers, give some with --workers or start them with --local-workers\n");
+        return -1;
+    }
 
-        goBack.draw();
-        render_texture(goBackTexture,goBack.x+goBack.width + 5,goBack.y,200,goBack.height);
-    };
+    printf("Rendering %dx%d at %d iterations on %d workers\n",job.width,job.height,job.view.maxIt,(int)workers.size());
 
-    ~About()
+    std::vector<Uint32> iterations((size_t)job.width*job.height);
+    RenderStats stats;
+    bool rendered = render_distributed(job,workers,&iterations[0],&stats);
+    render_stop_local_workers();
+
+    Uint64 totalIterations = 0;
+    Uint64 rawBytes = 0;
+    Uint64 compressedBytes = 0;
+    double computeMs = 0.0;
+    for(unsigned int i = 0; i < stats.workers.size(); ++i)
     {
-        SDL_DestroyTexture(aTexture);
+        const RenderWorkerStats &worker = stats.workers[i];
+        printf("%-40s %5d tiles %4d copies %10.1f ms computing %8.1f MB sent as %6.1f MB%s\n",worker.address.c_str(),worker.tiles,worker.duplicates,
+               worker.computeMs,worker.rawBytes/1048576.0,worker.compressedBytes/1048576.0,
+               !worker.connected ? "  (unreachable)" : worker.failed ? "  (failed)" : "");
+        totalIterations += worker.iterations;
+        rawBytes += worker.rawBytes;
+        compressedBytes += worker.compressedBytes;
+        computeMs += worker.computeMs;
     }
+    printf("%d tiles, %d retried after a worker failed, %d copied to idle workers\n",stats.tiles,stats.retried,stats.speculative);
+    printf("%.1f ms wall, %.2f Mpixels/s, %.3f Giterations/s aggregate, %.1fx speedup over one worker's compute, iteration buffers compressed %.1f:1\n",
+           stats.wallMs,(double)job.width*job.height/(stats.wallMs*1000.0),totalIterations/(stats.wallMs*1000000.0),
+           computeMs/stats.wallMs,compressedBytes > 0 ? (double)rawBytes/compressedBytes : 0.0);
 
-    About()
+    if(!rendered)
+        return -1;
+
+    SDL_Surface *image = SDL_CreateRGBSurfaceWithFormat(0,job.width,job.height,32,SDL_PIXELFORMAT_ARGB8888);
+    if(image == NULL)
+        return -1;
+    for(int y = 0; y < job.height; ++y)
     {
-        finished = false;
-        this->goBack = ProcessButton(goBackProcess,buttonOut,buttonIn,SCREEN_WIDTH-400,SCREEN_HEIGHT-150,128,128);
+        Uint32 *row = (Uint32*)((Uint8*)image->pixels + y*image->pitch);
+        for(int x = 0; x < job.width; ++x)
+        {
+            row[x] = BandedColoring::color(iterations[(size_t)y*job.width + x],job.view.maxIt,0.0);
+        }
+    }
+    int result = IMG_SavePNG(image,path);
+    if(result != 0)
+        printf("Could not write %s: %s\n",path,SDL_GetError());
+    else
+        printf("Render written to %s\n",path);
+    SDL_FreeSurface(image);
+    return result;
+}
 
-        SDL_Color hatchBlue = {1,91,144,100};
-        goBackTexture = render_text("Back",berbas,hatchBlue);
-        aTexture = render_text("This  program  was  made  with:",berbas,hatchBlue);
+//Warnings are printed when a budget is crossed, nothing is refused
+void set_memory_budgets(long long globalMB)
+{
+    mem_set_budget(globalMB*1048576);
+    mem_set_screen_budget("Global",64*1048576);
+    mem_set_screen_budget("IntroAnimation",8*1048576);
+    mem_set_screen_budget("Interests",8*1048576);
+    mem_set_screen_budget("AboutMe",8*1048576);
+    mem_set_screen_budget("Academics",8*1048576);
+    mem_set_screen_budget("About",8*1048576);
+    //A prewarmed back menu holds a second viewer while the first is still showing
+    mem_set_screen_budget("Mandelbrot",20*1048576);
+    mem_set_screen_budget("JuliaSet",8*1048576);
+    mem_set_screen_budget("Buddhabrot",8*1048576);
+    mem_set_screen_budget("Overlay",2*1048576);
+}
 
-    };
+//Simulation ticks per second with --threaded
+const int TICK_RATE = 120;
 
+//State shared between the render thread and the simulation thread
+struct Simulation
+{
+    Process *process;
+    EventQueue events;
+    TripleBuffer snapshots;
+    Uint32 sequence;
+
+    //Cleared by the render thread to stop, set by the simulation thread once it has
+    SDL_atomic_t running;
+    SDL_atomic_t stopped;
 };
 
-class Mandelbrot : public Process
+//Handles events, updates at a fixed tick and records draw() into the next snapshot
+int simulation_main(void *data)
 {
-public:
+    Simulation *sim = (Simulation*)data;
 
-    ProcessButton goBack;
+    const float dt = 1.0f/TICK_RATE;
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 tickLength = frequency/TICK_RATE;
+    Uint64 nextTick = SDL_GetPerformanceCounter();
 
-    Process *goBackProcess;
-    SDL_Texture *goBackTexture;
+    //Click that led to the current screen, every snapshot carries it until the render thread has shown one
+    Uint64 click = 0;
+    bool prewarmed = false;
 
-    SDL_Texture *mandelTexture;
+    while(SDL_AtomicGet(&sim->running))
+    {
+        tickScale = published_scale();
+
+        SDL_Event event;
+        while(sim->events.pop(&event))
+        {
+            sim->process->handle_events(&event);
+        }
 
-    SDL_Surface *surface;
+        update_process(sim->process,dt);
 
-    int frames;
-    int maxIt;
+        if(sim->process->finished)
+        {
+            //Screens create and free textures when they change, so that happens on the render thread
+            render_call([&]
+            {
+                Process *completed = sim->process;
+                sim->process = completed->next;
+                delete(completed);
+                if(sim->process != NULL)
+                    sim->process->init();
+            });
+            if(sim->process == NULL)
+                break;
 
-    void put_pixel(SDL_Surface *surface, int x, int y, Uint32 pixel)
-    {
-        int bpp = surface->format->BytesPerPixel;
-        Uint8 *p = (Uint8 *)surface->pixels + y * surface->pitch + x * bpp;
-        *(Uint32 *)p = pixel;
-    }
+            click = transitionClick;
+            prewarmed = transitionPrewarmed;
+            transitionClick = 0;
+        }
 
-    void init()
-    {
-        SDL_SetRenderDrawColor(renderer,0,0,0,255);
-        this->goBackProcess = new IntroAnimation
-        (
-         vec2d(44.0f,-200.0f),
-         vec2d(1024,128),
-         10,
-         hatchTexture,
-         buttonOut,
-         buttonIn,
-         berbas
-        );
+        FrameSnapshot *snapshot = sim->snapshots.back();
+        snapshot->clear();
+        snapshot->epoch = SDL_AtomicGet(&resourceEpoch);
+        snapshot->sequence = ++sim->sequence;
+        snapshot->transitionClick = click;
+        snapshot->transitionPrewarmed = prewarmed;
+        snapshot->scale = tickScale;
 
-        this->goBack = ProcessButton(goBackProcess,buttonOut,buttonIn,SCREEN_WIDTH-400,SCREEN_HEIGHT-150,128,128);
-    };
+        recording = snapshot;
+        sim->process->draw();
+        recording = NULL;
 
-    void handle_events(SDL_Event *event)
-    {
-        if(!finished)
-            finished = goBack.handle_events(event,&next);
-    };
+        sim->snapshots.publish();
 
-    void update(float dt)
-    {
-        if(frames >= 3000 && maxIt <= 20)
+        nextTick += tickLength;
+        Uint64 now = SDL_GetPerformanceCounter();
+        if(now < nextTick)
+        {
+            SDL_Delay((nextTick - now)*1000/frequency);
+        }
+        else if(now - nextTick > tickLength*10)
         {
-            maxIt++;
+            //Too far behind to catch up, drop the missed ticks
+            nextTick = now;
+        }
+    }
 
-            for(int i = 0; i < 1024; ++i)
-            {
-                for(int j = 0; j < 1024; ++j)
-                {
-                    float x0 = ((float)i-512)/((float)1024/4.0f);
-                    float y0 = ((float)j-512)/((float)1024/4.0f);
+    SDL_AtomicSet(&sim->stopped,1);
+    return 0;
+}
 
-                    float x = 0;
-                    float y = 0;
+//Main loop for --threaded, returns the screen that was showing when it stopped
+Process *run_threaded(Process *process, ProfilerOverlay *overlay)
+{
+    Simulation *sim = new Simulation();
+    sim->process = process;
+    sim->sequence = 0;
+    SDL_AtomicSet(&sim->running,1);
+    SDL_AtomicSet(&sim->stopped,0);
+    publish_scale(resolution.scale);
 
-                    int it = -1;
-                    while(it <= maxIt && x*x + y*y <= 4.0f)
-                    {
-                        it++;
-                        float xTemp = x*x - y*y + x0;
-                        y = 2*x*y + y0;
-                        x = xTemp;
-                    }
+    SDL_Thread *thread = SDL_CreateThread(simulation_main,"simulation",sim);
 
-                    put_pixel(surface,i,j,SDL_MapRGB(surface->format,it*200,it*100,it*50));
+    Uint64 prevDraw = SDL_GetPerformanceCounter();
+    Uint64 reportedClick = 0;
 
+    while(!SDL_AtomicGet(&sim->stopped))
+    {
+        SDL_Event windowEvent;
+        while(SDL_PollEvent(&windowEvent))
+        {
+            if(windowEvent.type == SDL_QUIT)
+            {
+                SDL_AtomicSet(&sim->running,0);
+            }
+            if(windowEvent.type == SDL_RENDER_TARGETS_RESET)
+            {
+                SDL_AtomicAdd(&renderTargetsLost,1);
+            }
+            if(windowEvent.type == SDL_KEYUP)
+            {
+                if(windowEvent.key.keysym.sym == SDLK_ESCAPE)
+                {
+                    SDL_AtomicSet(&sim->running,0);
                 }
             }
 
-            SDL_DestroyTexture(mandelTexture);
-            mandelTexture = SDL_CreateTextureFromSurface(renderer,surface);
-
-            frames = 0;
+            overlay->handle_events(&windowEvent);
+            if(!sim->events.push(windowEvent))
+            {
+                printf("Event queue full, dropped an event\n");
+            }
         }
-    };
 
-    void draw()
-    {
-        frames++;
-        render_texture(mandelTexture,128,0,1024,1024);
-        goBack.draw();
-        render_texture(goBackTexture,goBack.x+goBack.width + 5,goBack.y,200,goBack.height);
-    };
+        //Keeps serving render calls after quitting so the simulation thread can finish its tick
+        run_render_calls();
 
-    ~Mandelbrot()
-    {
-        SDL_DestroyTexture(mandelTexture);
-        SDL_FreeSurface(surface);
+        FrameSnapshot *snapshot = sim->snapshots.acquire();
+        if(snapshot == NULL || snapshot->epoch != SDL_AtomicGet(&resourceEpoch))
+        {
+            SDL_Delay(1);
+            continue;
+        }
 
-    }
+        begin_scene(snapshot->scale);
 
-    Mandelbrot()
-    {
-        finished = false;
-        this->goBack = ProcessButton(goBackProcess,buttonOut,buttonIn,SCREEN_WIDTH-400,SCREEN_HEIGHT-150,128,128);
+        draw_snapshot(snapshot);
 
-        SDL_Color hatchBlue = {1,91,144,100};
-        goBackTexture = render_text("Back",berbas,hatchBlue);
+        end_scene();
 
-        surface = SDL_CreateRGBSurface(0,1024,1024,32,0,0,0,0);
+        overlay->draw();
 
-        mandelTexture = SDL_CreateTextureFromSurface(renderer,surface);
+        SDL_RenderPresent(renderer);
 
-        frames = 4000;
-        maxIt = -1;
+        if(snapshot->transitionClick != 0 && snapshot->transitionClick != reportedClick && sim->process != NULL)
+        {
+            report_transition(sim->process->name(),snapshot->transitionClick,snapshot->transitionPrewarmed);
+            reportedClick = snapshot->transitionClick;
+        }
 
-    };
+        Uint64 now = SDL_GetPerformanceCounter();
+        float frameTime = (float)(now - prevDraw)/SDL_GetPerformanceFrequency();
+        prevDraw = now;
 
-};
+        resolution.frame(frameTime*1000.0f);
+        publish_scale(resolution.scale);
+        if(sim->process != NULL)
+            overlay->frame(frameTime,sim->process);
+        alloc_begin_frame();
+    }
 
-//------------------ Constructors  -------------------------
+    SDL_WaitThread(thread,NULL);
 
-IntroAnimation::IntroAnimation
-(
-        vec2d hatchPosition,
-        vec2d hatchSize,
-        float hatchEndHeight,
-        SDL_Texture *hatchTexture,
+    process = sim->process;
+    delete sim;
+    return process;
+}
 
-        SDL_Texture *buttonOut,
-        SDL_Texture *buttonIn,
+int main(int argc, char *argv[])
+{
+    //Has to come before SDL allocates anything
+    alloc_hook_sdl();
+
+    const char *benchmarkPath = NULL;
+    int allocTestFrames = 0;
+    bool allocSites = false;
+    const char *packPath = NULL;
+    bool usePack = true;
+    bool windowed = false;
+    float targetMs = resolution.targetMs;
+    float scale = 1.0f;
+    long long budgetMB = 128;
+
+    const char *capturePath = NULL;
+    int captureQueue = 8;
+
+    const char *workerAddress = NULL;
+    int workerThreads = 0;
+    RenderWorkerOptions workerOptions = {0,0};
+    std::string workerTestOptions;
+    const char *renderPath = NULL;
+    std::vector<std::string> renderWorkers;
+    int localWorkers = 0;
+    bool localTcp = false;
+    RenderJob renderJob;
+    renderJob.type = FRACTAL_MANDELBROT;
+    renderJob.precision = PRECISION_DOUBLE;
+    renderJob.view.centerX = -0.75;
+    renderJob.view.centerY = 0.0;
+    renderJob.view.juliaX = 0.0;
+    renderJob.view.juliaY = 0.0;
+    renderJob.view.maxIt = 1000;
+    renderJob.width = 4096;
+    renderJob.height = 4096;
+    renderJob.tileSize = 256;
+    renderJob.timeoutMs = 30000;
+    double renderViewWidth = 3.0;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if(arg == "--benchmark")
+        {
+            benchmarkPath = (i+1 < argc && argv[i+1][0] != '-') ? argv[++i] : "benchmark.json";
+        }
+        else if(arg == "--capture" && i+1 < argc)
+        {
+            capturePath = argv[++i];
+        }
+        else if(arg == "--capture-queue" && i+1 < argc)
+        {
+            captureQueue = atoi(argv[++i]);
+        }
+        else if(arg == "--budget" && i+1 < argc)
+        {
+            budgetMB = atoll(argv[++i]);
+        }
+        else if(arg == "--pack")
+        {
+            packPath = (i+1 < argc && argv[i+1][0] != '-') ? argv[++i] : PACK_PATH;
+        }
+        else if(arg == "--no-pack")
+        {
+            usePack = false;
+        }
+        else if(arg == "--windowed")
+        {
+            windowed = true;
+        }
+        else if(arg == "--threaded")
+        {
+            threaded = true;
+        }
+        else if(arg == "--no-prewarm")
+        {
+            prewarmEnabled = false;
+        }
+        else if(arg == "--no-scroll-strips")
+        {
+            useScrollStrips = false;
+        }
+        else if(arg == "--alloc-test")
+        {
+            allocTestFrames = (i+1 < argc && argv[i+1][0] != '-') ? atoi(argv[++i]) : 300;
+        }
+        else if(arg == "--alloc-sites")
+        {
+            allocSites = true;
+        }
+        else if(arg == "--target-ms" && i+1 < argc)
+        {
+            targetMs = atof(argv[++i]);
+        }
+        else if(arg == "--scale" && i+1 < argc)
+        {
+            scale = atof(argv[++i]);
+        }
+        else if(arg == "--max-texture-size" && i+1 < argc)
+        {
+            maxTextureSize = atoi(argv[++i]);
+        }
+        else if(arg == "--aa-samples" && i+1 < argc)
+        {
+            antialiasSamples = atoi(argv[++i]);
+        }
+        else if(arg == "--aa-delta" && i+1 < argc)
+        {
+            antialiasDelta = atoi(argv[++i]);
+        }
+        else if(arg == "--render-worker" && i+1 < argc)
+        {
+            workerAddress = argv[++i];
+        }
+        else if(arg == "--worker-threads" && i+1 < argc)
+        {
+            workerThreads = atoi(argv[++i]);
+        }
+        else if(arg == "--worker-delay" && i+1 < argc)
+        {
+            workerOptions.delayMs = atoi(argv[++i]);
+            workerTestOptions += std::string(" --worker-delay ") + argv[i];
+        }
+        else if(arg == "--worker-fail-after" && i+1 < argc)
+        {
+            workerOptions.failAfter = atoi(argv[++i]);
+            workerTestOptions += std::string(" --worker-fail-after ") + argv[i];
+        }
+        else if(arg == "--distributed-render")
+        {
+            renderPath = (i+1 < argc && argv[i+1][0] != '-') ? argv[++i] : "render.png";
+        }
+        else if(arg == "--workers" && i+1 < argc)
+        {
+            std::string list = argv[++i];
+            size_t begin = 0;
+            while(begin <= list.size())
+            {
+                size_t end = list.find(',',begin);
+                if(end == std::string::npos)
+                    end = list.size();
+                if(end > begin)
+                    renderWorkers.push_back(list.substr(begin,end - begin));
+                begin = end + 1;
+            }
+        }
+        else if(arg == "--local-workers" && i+1 < argc)
+        {
+            localWorkers = atoi(argv[++i]);
+        }
+        else if(arg == "--local-tcp")
+        {
+            localTcp = true;
+        }
+        else if(arg == "--render-size" && i+1 < argc)
+        {
+            renderJob.width = renderJob.height = atoi(argv[++i]);
+        }
+        else if(arg == "--render-iterations" && i+1 < argc)
+        {
+            renderJob.view.maxIt = atoi(argv[++i]);
+        }
+        else if(arg == "--render-view" && i+1 < argc)
+        {
+            sscanf(argv[++i],"%lf,%lf,%lf",&renderJob.view.centerX,&renderJob.view.centerY,&renderViewWidth);
+        }
+        else if(arg == "--compositor")
+        {
+            useCompositor = true;
+        }
+        else if(arg == "--software")
+        {
+            softwareRenderer = true;
+        }
+    }
 
-        TTF_Font *font
-)
+    //Neither needs a window
+    if(workerAddress != NULL)
     {
-        this->next = NULL;
-        finished = false;
-        this->hatchPosition = hatchPosition;
-        this->hatchSize = hatchSize;
-        this->hatchEndHeight = hatchEndHeight;
+        jobs_init(workerThreads);
+        int result = render_worker(workerAddress,workerOptions);
+        jobs_quit();
+        return result;
+    }
 
-        this->font = font;
+    if(renderPath != NULL)
+    {
+        if(renderJob.width <= 0)
+            renderJob.width = renderJob.height = 4096;
+        renderJob.view.pixelSize = renderViewWidth/renderJob.width;
+        return run_distributed_render(renderPath,renderJob,renderWorkers,localWorkers,localTcp,workerTestOptions,argv[0]);
+    }
 
-        SDL_Color hatchBlue = {1,91,144,100};
+    if(!init(windowed))
+    {
+        return -1;
+    }
+
+    resolution.targetMs = targetMs;
+    if(sceneTarget != NULL && scale > 0.0f && scale <= 1.0f)
+    {
+        resolution.scale = scale;
+        resolution.minScale = scale < resolution.minScale ? scale : resolution.minScale;
+    }
+    tickScale = resolution.scale;
 
-        geraldHatch = render_text("Dr. Gerald G. Hatch Scholarship",font,hatchBlue);
+    set_memory_budgets(budgetMB);
 
-        aboutMeTexture = render_text("About Me",berbas,hatchBlue);
-        interestsTexture = render_text("Interests",berbas,hatchBlue);
-        academicsTexture = render_text("Academics",berbas,hatchBlue);
-        exitTexture = render_text("Exit",berbas,hatchBlue);
-        aboutTexture = render_text("About",berbas,hatchBlue);
-        mandelbrotTexture = render_text("Mandelbrot",berbas,hatchBlue);
+    SDL_SetRenderDrawColor(renderer,255,255,255,255);
 
+    if(packPath != NULL)
+    {
+        int result = write_pack(packPath);
+        quit();
+        return result;
     }
 
-void IntroAnimation::init()
-{
-    SDL_SetRenderDrawColor(renderer,255,255,255,255);
-    this->interestsProcess = new Interests();
-    this->academicsProcess = new Academics();
-    this->aboutMeProcess = new AboutMe(kaiTexture,vec2d(10,10),vec2d(240,320),buttonOut,buttonIn,berbas);
-    this->aboutProcess = new About();
-    this->mandelbrotProcess = new Mandelbrot;
+    if(capturePath != NULL)
+    {
+        //The benchmark's checksum has to cover every frame, so it waits for the encoder instead of dropping
+        frameCapture = new FrameCapture();
+        if(!frameCapture->start(renderer,capturePath,60,captureQueue,benchmarkPath != NULL))
+        {
+            delete frameCapture;
+            frameCapture = NULL;
+        }
+    }
 
-    this->aboutMe = ProcessButton(aboutMeProcess,buttonOut,buttonIn,10,370,128,128);
-    this->interests = ProcessButton(interestsProcess,buttonOut,buttonIn,436,370,128,128);
-    this->academics = ProcessButton(academicsProcess,buttonOut,buttonIn,10,706,128,128);
-    this->exit = ProcessButton(NULL,buttonOut,buttonIn,862,706,128,128);
-    this->about = ProcessButton(aboutProcess,buttonOut,buttonIn,862,370,128,128);
-    this->mandelbrot = ProcessButton(mandelbrotProcess,buttonOut,buttonIn,436,706,128,128);
-}
+    if(benchmarkPath != NULL)
+    {
+        //Frame times are only comparable at a fixed scale
+        resolution.enabled = false;
+        int result = run_benchmark(benchmarkPath);
+        free_assets();
+        pack_close();
+        quit();
+        return result;
+    }
 
-int main(int argc, char *argv[])
-{
-    if(!init())
+    if((allocTestFrames > 0 || allocSites) && !alloc_tracking_enabled())
     {
-        return -1;
+        printf("--alloc-test and --alloc-sites need a build with -DALLOC_TRACKING\n");
+        quit();
+        return 1;
     }
 
-    SDL_SetRenderDrawColor(renderer,255,255,255,255);
+    if(allocTestFrames > 0)
+    {
+        resolution.enabled = false;
+        int result = run_alloc_test(allocTestFrames);
+        finish_capture();
+        quit();
+        return result;
+    }
 
-    hatchTexture = load_texture("assets/hatch_logo.png");
-    buttonOut = load_texture("assets/button_out.png");
-    buttonIn = load_texture("assets/button_in.png");
-    kaiTexture = load_texture("assets/terriblePhoto.jpg");
-    alexTexture = load_texture("assets/Alexander_The_Great.jpg");
-    napoleonTexture = load_texture("assets/Napoleon_Alps.jpg");
-    codeTexture = load_texture("assets/code.png");
-    aluTexture = load_texture("assets/ALU.png");
-    cpuTexture = load_texture("assets/cpu.jpg");
-    higgsTexture = load_texture("assets/higgs.jpg");
-    nuclearTexture = load_texture("assets/reactor.jpg");
-    waterlooTexture = load_texture("assets/waterloo.png");
-    queenTexture = load_texture("assets/queen.png");
-    awardsTexture = load_texture("assets/awards.png");
-    sdlTexture = load_texture("assets/sdl.png");
-    gccTexture = load_texture("assets/gcc.gif");
-    cbTexture = load_texture("assets/codeblocks.png");
-    mingwTexture = load_texture("assets/mingw.png");
-    cppTexture = load_texture("assets/cpp.jpg");
+    alloc_set_recording(allocSites);
 
-    berbas = TTF_OpenFont("assets/berbas.ttf",96);
+    Uint64 startupStart = SDL_GetPerformanceCounter();
 
+    if(usePack && !pack_open(PACK_PATH))
+    {
+        printf("No asset pack, loading loose files\n");
+    }
+    load_assets();
 
     float dt = 0;
     float prevTime = 0.0f;
+    Uint64 prevDraw = SDL_GetPerformanceCounter();
 
 
     Process *process = NULL;
@@ -873,10 +4506,23 @@ int main(int argc, char *argv[])
 
     process->init();
 
+    printf("Startup took %.1f ms\n",(SDL_GetPerformanceCounter()-startupStart)*1000.0/SDL_GetPerformanceFrequency());
+
+    ProfilerOverlay *overlay = new ProfilerOverlay();
+
     int frames = 0;
 
+    //Click that led to the screen being shown, reported once it is presented
+    Uint64 shownClick = 0;
+    bool shownPrewarmed = false;
+
+    if(threaded)
+    {
+        process = run_threaded(process,overlay);
+    }
+
     SDL_Event windowEvent;
-    while(true)
+    while(!threaded)
     {
 
         if(SDL_PollEvent(&windowEvent))
@@ -885,6 +4531,10 @@ int main(int argc, char *argv[])
             {
                 break;
             }
+            if(windowEvent.type == SDL_RENDER_TARGETS_RESET)
+            {
+                SDL_AtomicAdd(&renderTargetsLost,1);
+            }
             if(windowEvent.type == SDL_KEYUP)
             {
                 if(windowEvent.key.keysym.sym == SDLK_ESCAPE)
@@ -893,6 +4543,7 @@ int main(int argc, char *argv[])
                 }
             }
 
+            overlay->handle_events(&windowEvent);
             process->handle_events(&windowEvent);
 
         }
@@ -901,7 +4552,7 @@ int main(int argc, char *argv[])
         dt = time - prevTime;
         prevTime = time;
 
-        process->update(dt);
+        update_process(process,dt);
 
 
         if(process->finished)
@@ -914,51 +4565,62 @@ int main(int argc, char *argv[])
             else
                 process->init();
 
+            shownClick = transitionClick;
+            shownPrewarmed = transitionPrewarmed;
+            transitionClick = 0;
         }
 
         frames++;
 
         if(frames >= 70)
         {
-            SDL_RenderClear(renderer);
+            begin_scene(tickScale);
 
             process->draw();
 
+            end_scene();
+
+            overlay->draw();
+
             SDL_RenderPresent(renderer);
 
+            if(shownClick != 0)
+            {
+                report_transition(process->name(),shownClick,shownPrewarmed);
+                shownClick = 0;
+            }
+
+            Uint64 now = SDL_GetPerformanceCounter();
+            float frameTime = (float)(now - prevDraw)/SDL_GetPerformanceFrequency();
+            prevDraw = now;
+
+            resolution.frame(frameTime*1000.0f);
+            tickScale = resolution.scale;
+            overlay->frame(frameTime,process);
+            alloc_begin_frame();
+
             frames = 0;
         }
 
     }
 
-    TTF_CloseFont(berbas);
+    delete overlay;
+    delete process;
 
-    SDL_DestroyTexture(buttonIn);
-    SDL_DestroyTexture(buttonOut);
-    SDL_DestroyTexture(hatchTexture);
-    SDL_DestroyTexture(kaiTexture);
-    SDL_DestroyTexture(buttonIn);
-    SDL_DestroyTexture(buttonOut);
-    SDL_DestroyTexture(alexTexture);
-    SDL_DestroyTexture(napoleonTexture);
-    SDL_DestroyTexture(codeTexture);
-    SDL_DestroyTexture(aluTexture);
-    SDL_DestroyTexture(cpuTexture);
-    SDL_DestroyTexture(higgsTexture);
-    SDL_DestroyTexture(nuclearTexture);
-    SDL_DestroyTexture(waterlooTexture);
-    SDL_DestroyTexture(queenTexture);
-    SDL_DestroyTexture(awardsTexture);
-    SDL_DestroyTexture(sdlTexture);
-    SDL_DestroyTexture(gccTexture);
-    SDL_DestroyTexture(cbTexture);
-    SDL_DestroyTexture(mingwTexture);
-    SDL_DestroyTexture(cppTexture);
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
+    free_assets();
+    pack_close();
 
-    IMG_Quit();
-    TTF_Quit();
-    SDL_Quit();
+    finish_capture();
+    mem_report(stdout);
+    transition_report(stdout);
+    if(allocSites)
+    {
+        AllocCounts counts = alloc_total_counts();
+        printf("Heap: %llu allocations (%.1f MB), %llu frees, %llu exempt\n",(unsigned long long)counts.allocations,
+               counts.bytes/1048576.0,(unsigned long long)counts.frees,(unsigned long long)counts.exempt);
+        alloc_report(stdout,20);
+    }
+
+    quit();
     return 0;
 }
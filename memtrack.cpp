@@ -0,0 +1,227 @@
+#include "memtrack.h"
+#include <map>
+#include <string>
+
+struct MemEntry
+{
+    std::string owner;
+    std::string screen;
+    long long bytes;
+    bool texture;
+};
+
+struct ScreenUsage
+{
+    long long current;
+    long long peak;
+    long long budget;
+
+    ScreenUsage() {current = 0; peak = 0; budget = 0;};
+};
+
+static std::map<const void*, MemEntry> entries;
+static std::map<std::string, ScreenUsage> screens;
+
+//Each thread charges to its own screen, with --threaded both threads allocate
+static thread_local const char *currentScreen = "Global";
+static SDL_SpinLock lock = 0;
+static long long currentBytes = 0;
+static long long peakBytes = 0;
+static long long budgetBytes = 0;
+static void (*destroyHook)(SDL_Texture *texture) = NULL;
+
+const char *mem_set_screen(const char *screen)
+{
+    const char *previous = currentScreen;
+    currentScreen = screen;
+    return previous;
+}
+
+const char *mem_get_screen()
+{
+    return currentScreen;
+}
+
+static void add_entry(const void *pointer, const char *owner, long long bytes, bool texture)
+{
+    SDL_AtomicLock(&lock);
+    MemEntry &entry = entries[pointer];
+    entry.owner = owner;
+    entry.screen = currentScreen;
+    entry.bytes = bytes;
+    entry.texture = texture;
+
+    if(budgetBytes > 0 && currentBytes <= budgetBytes && currentBytes + bytes > budgetBytes)
+    {
+        printf("Warning: memory budget of %.1f MB exceeded by %s (%s)\n",budgetBytes/1048576.0,owner,currentScreen);
+    }
+    currentBytes += bytes;
+    if(currentBytes > peakBytes)
+    {
+        peakBytes = currentBytes;
+    }
+
+    ScreenUsage &usage = screens[entry.screen];
+    if(usage.budget > 0 && usage.current <= usage.budget && usage.current + bytes > usage.budget)
+    {
+        printf("Warning: %s exceeded its budget of %.1f MB with %s\n",currentScreen,usage.budget/1048576.0,owner);
+    }
+    usage.current += bytes;
+    if(usage.current > usage.peak)
+    {
+        usage.peak = usage.current;
+    }
+    SDL_AtomicUnlock(&lock);
+}
+
+static bool remove_entry(const void *pointer)
+{
+    SDL_AtomicLock(&lock);
+    std::map<const void*, MemEntry>::iterator it = entries.find(pointer);
+    bool found = it != entries.end();
+    if(found)
+    {
+        currentBytes -= it->second.bytes;
+        screens[it->second.screen].current -= it->second.bytes;
+        entries.erase(it);
+    }
+    SDL_AtomicUnlock(&lock);
+    return found;
+}
+
+SDL_Texture *mem_track_texture(SDL_Texture *texture, const char *owner)
+{
+    if(texture == NULL)
+    {
+        return NULL;
+    }
+    Uint32 format;
+    int w,h;
+    SDL_QueryTexture(texture,&format,NULL,&w,&h);
+    add_entry(texture,owner,(long long)w*h*SDL_BYTESPERPIXEL(format),true);
+    return texture;
+}
+
+SDL_Surface *mem_track_surface(SDL_Surface *surface, const char *owner)
+{
+    if(surface == NULL)
+    {
+        return NULL;
+    }
+    add_entry(surface,owner,(long long)surface->pitch*surface->h,false);
+    return surface;
+}
+
+void mem_destroy_texture(SDL_Texture *texture)
+{
+    if(texture == NULL)
+    {
+        return;
+    }
+    if(!remove_entry(texture))
+    {
+        printf("Warning: destroying untracked texture %p\n",(void*)texture);
+    }
+    if(destroyHook != NULL)
+    {
+        destroyHook(texture);
+    }
+    SDL_DestroyTexture(texture);
+}
+
+void mem_set_texture_destroy_hook(void (*hook)(SDL_Texture *texture))
+{
+    destroyHook = hook;
+}
+
+void mem_free_surface(SDL_Surface *surface)
+{
+    if(surface == NULL)
+    {
+        return;
+    }
+    if(!remove_entry(surface))
+    {
+        printf("Warning: freeing untracked surface %p\n",(void*)surface);
+    }
+    SDL_FreeSurface(surface);
+}
+
+long long mem_current_bytes()
+{
+    return currentBytes;
+}
+
+long long mem_peak_bytes()
+{
+    return peakBytes;
+}
+
+long long mem_screen_bytes(const char *screen)
+{
+    SDL_AtomicLock(&lock);
+    std::map<std::string, ScreenUsage>::iterator it = screens.find(screen);
+    long long bytes = it == screens.end() ? 0 : it->second.current;
+    SDL_AtomicUnlock(&lock);
+    return bytes;
+}
+
+long long mem_screen_peak_bytes(const char *screen)
+{
+    SDL_AtomicLock(&lock);
+    std::map<std::string, ScreenUsage>::iterator it = screens.find(screen);
+    long long bytes = it == screens.end() ? 0 : it->second.peak;
+    SDL_AtomicUnlock(&lock);
+    return bytes;
+}
+
+void mem_set_budget(long long bytes)
+{
+    budgetBytes = bytes;
+}
+
+void mem_set_screen_budget(const char *screen, long long bytes)
+{
+    SDL_AtomicLock(&lock);
+    screens[screen].budget = bytes;
+    SDL_AtomicUnlock(&lock);
+}
+
+long long mem_get_budget()
+{
+    return budgetBytes;
+}
+
+void mem_report(FILE *file)
+{
+    SDL_AtomicLock(&lock);
+    fprintf(file,"Texture/surface memory: %.2f MB current, %.2f MB peak\n",currentBytes/1048576.0,peakBytes/1048576.0);
+    for(std::map<std::string, ScreenUsage>::iterator s = screens.begin(); s != screens.end(); ++s)
+    {
+        fprintf(file,"  %s: %.2f MB current, %.2f MB peak\n",s->first.c_str(),s->second.current/1048576.0,s->second.peak/1048576.0);
+        for(std::map<const void*, MemEntry>::iterator e = entries.begin(); e != entries.end(); ++e)
+        {
+            if(e->second.screen == s->first)
+            {
+                fprintf(file,"    %-8s %8.1f KB  %s\n",e->second.texture ? "texture" : "surface",e->second.bytes/1024.0,e->second.owner.c_str());
+            }
+        }
+    }
+    SDL_AtomicUnlock(&lock);
+}
+
+void mem_write_json(FILE *file)
+{
+    SDL_AtomicLock(&lock);
+    fprintf(file,"{\"current_bytes\": %lld, \"peak_bytes\": %lld, \"budget_bytes\": %lld, \"live_allocations\": %d, \"screens\": {",
+            currentBytes,peakBytes,budgetBytes,(int)entries.size());
+    bool first = true;
+    for(std::map<std::string, ScreenUsage>::iterator s = screens.begin(); s != screens.end(); ++s)
+    {
+        fprintf(file,"%s\"%s\": {\"current_bytes\": %lld, \"peak_bytes\": %lld, \"budget_bytes\": %lld}",
+                first ? "" : ", ",s->first.c_str(),s->second.current,s->second.peak,s->second.budget);
+        first = false;
+    }
+    fprintf(file,"}}");
+    SDL_AtomicUnlock(&lock);
+}
@@ -0,0 +1,51 @@
+#ifndef MEMTRACK_H
+#define MEMTRACK_H
+
+#include <SDL2/SDL.h>
+#include <cstdio>
+
+//Every texture and surface the program holds is registered here with the
+//name of its owner (file or label) and the screen that created it.
+
+//Sets the screen new allocations are charged to, returns the previous one
+const char *mem_set_screen(const char *screen);
+const char *mem_get_screen();
+
+//Charges allocations to a screen for the lifetime of the scope
+class MemScope
+{
+    public:
+        MemScope(const char *screen) {previous = mem_set_screen(screen);};
+        ~MemScope() {mem_set_screen(previous);};
+    private:
+        const char *previous;
+};
+
+//Registers a texture or surface, returns it unchanged so calls can be wrapped
+SDL_Texture *mem_track_texture(SDL_Texture *texture, const char *owner);
+SDL_Surface *mem_track_surface(SDL_Surface *surface, const char *owner);
+
+//Unregisters and frees, use instead of SDL_DestroyTexture / SDL_FreeSurface
+void mem_destroy_texture(SDL_Texture *texture);
+void mem_free_surface(SDL_Surface *surface);
+
+//Called with every texture mem_destroy_texture() frees, just before it is destroyed
+void mem_set_texture_destroy_hook(void (*hook)(SDL_Texture *texture));
+
+long long mem_current_bytes();
+long long mem_peak_bytes();
+long long mem_screen_bytes(const char *screen);
+long long mem_screen_peak_bytes(const char *screen);
+
+//Budgets in bytes, 0 disables. A warning is printed each time usage crosses one.
+void mem_set_budget(long long bytes);
+void mem_set_screen_budget(const char *screen, long long bytes);
+long long mem_get_budget();
+
+//Prints every live allocation grouped by screen
+void mem_report(FILE *file);
+
+//Writes the totals as a JSON object (no trailing newline)
+void mem_write_json(FILE *file);
+
+#endif // MEMTRACK_H
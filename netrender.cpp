@@ -0,0 +1,970 @@
+#include "netrender.h"
+#include "jobs.h"
+#include <cstdio>
+#include <cstring>
+#include <deque>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <process.h>
+typedef SOCKET Socket;
+#define NO_SOCKET INVALID_SOCKET
+#define close_socket closesocket
+#define getpid _getpid
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <signal.h>
+#include <spawn.h>
+extern char **environ;
+typedef int Socket;
+#define NO_SOCKET -1
+#define close_socket close
+#endif
+
+//------------------ Sockets  -------------------------
+
+static void net_startup()
+{
+#ifdef _WIN32
+    static bool started = false;
+    if(!started)
+    {
+        WSADATA data;
+        WSAStartup(MAKEWORD(2,2),&data);
+        started = true;
+    }
+#else
+    //A peer closing mid-send should fail the send, not kill the process
+    signal(SIGPIPE,SIG_IGN);
+#endif
+}
+
+static bool is_unix_address(const std::string &address)
+{
+    return address.compare(0,5,"unix:") == 0;
+}
+
+//Splits "host:port", a bare port means every interface for listening and loopback for connecting
+static bool tcp_address(const std::string &address, bool passive, struct addrinfo **result)
+{
+    std::string host;
+    std::string port = address;
+    size_t colon = address.rfind(':');
+    if(colon != std::string::npos)
+    {
+        host = address.substr(0,colon);
+        port = address.substr(colon+1);
+    }
+
+    struct addrinfo hints;
+    memset(&hints,0,sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    if(getaddrinfo(host.empty() ? (passive ? NULL : "127.0.0.1") : host.c_str(),port.c_str(),&hints,result) != 0)
+    {
+        printf("Bad address %s\n",address.c_str());
+        return false;
+    }
+    return true;
+}
+
+#ifndef _WIN32
+static bool unix_address(const std::string &address, struct sockaddr_un *result)
+{
+    std::string path = address.substr(5);
+    if(path.size() >= sizeof(result->sun_path))
+    {
+        printf("Socket path too long: %s\n",path.c_str());
+        return false;
+    }
+    memset(result,0,sizeof(*result));
+    result->sun_family = AF_UNIX;
+    strcpy(result->sun_path,path.c_str());
+    return true;
+}
+#endif
+
+static Socket net_listen(const std::string &address)
+{
+    Socket listener = NO_SOCKET;
+    if(is_unix_address(address))
+    {
+#ifdef _WIN32
+        printf("Unix sockets are not supported here, use host:port\n");
+#else
+        struct sockaddr_un local;
+        if(!unix_address(address,&local))
+            return NO_SOCKET;
+        unlink(local.sun_path);
+        listener = socket(AF_UNIX,SOCK_STREAM,0);
+        if(listener != NO_SOCKET && bind(listener,(struct sockaddr*)&local,sizeof(local)) != 0)
+        {
+            close_socket(listener);
+            listener = NO_SOCKET;
+        }
+#endif
+    }
+    else
+    {
+        struct addrinfo *info = NULL;
+        if(!tcp_address(address,true,&info))
+            return NO_SOCKET;
+        for(struct addrinfo *i = info; i != NULL && listener == NO_SOCKET; i = i->ai_next)
+        {
+            listener = socket(i->ai_family,i->ai_socktype,i->ai_protocol);
+            if(listener == NO_SOCKET)
+                continue;
+            int on = 1;
+            setsockopt(listener,SOL_SOCKET,SO_REUSEADDR,(const char*)&on,sizeof(on));
+            if(bind(listener,i->ai_addr,(int)i->ai_addrlen) != 0)
+            {
+                close_socket(listener);
+                listener = NO_SOCKET;
+            }
+        }
+        freeaddrinfo(info);
+    }
+
+    if(listener != NO_SOCKET && listen(listener,4) != 0)
+    {
+        close_socket(listener);
+        listener = NO_SOCKET;
+    }
+    if(listener == NO_SOCKET)
+        printf("Could not listen on %s\n",address.c_str());
+    return listener;
+}
+
+static Socket net_connect(const std::string &address)
+{
+    Socket connection = NO_SOCKET;
+    if(is_unix_address(address))
+    {
+#ifndef _WIN32
+        struct sockaddr_un remote;
+        if(!unix_address(address,&remote))
+            return NO_SOCKET;
+        connection = socket(AF_UNIX,SOCK_STREAM,0);
+        if(connection != NO_SOCKET && connect(connection,(struct sockaddr*)&remote,sizeof(remote)) != 0)
+        {
+            close_socket(connection);
+            connection = NO_SOCKET;
+        }
+#endif
+        return connection;
+    }
+
+    struct addrinfo *info = NULL;
+    if(!tcp_address(address,false,&info))
+        return NO_SOCKET;
+    for(struct addrinfo *i = info; i != NULL && connection == NO_SOCKET; i = i->ai_next)
+    {
+        connection = socket(i->ai_family,i->ai_socktype,i->ai_protocol);
+        if(connection == NO_SOCKET)
+            continue;
+        if(connect(connection,i->ai_addr,(int)i->ai_addrlen) != 0)
+        {
+            close_socket(connection);
+            connection = NO_SOCKET;
+            continue;
+        }
+        //Jobs are small and answered one at a time, don't hold them back
+        int on = 1;
+        setsockopt(connection,IPPROTO_TCP,TCP_NODELAY,(const char*)&on,sizeof(on));
+    }
+    freeaddrinfo(info);
+    return connection;
+}
+
+static bool send_all(Socket connection, const void *data, size_t size)
+{
+    const char *bytes = (const char*)data;
+    while(size > 0)
+    {
+        int sent = send(connection,bytes,size > 65536 ? 65536 : (int)size,0);
+        if(sent <= 0)
+            return false;
+        bytes += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+//Waits at most timeoutMs for data (forever if negative), giving up early once stop is set
+static bool recv_all(Socket connection, void *data, size_t size, int timeoutMs, SDL_atomic_t *stop)
+{
+    char *bytes = (char*)data;
+    Uint32 start = SDL_GetTicks();
+    while(size > 0)
+    {
+        if(timeoutMs >= 0 || stop != NULL)
+        {
+            //Short waits, so stop is noticed soon after it is set
+            fd_set readable;
+            FD_ZERO(&readable);
+            FD_SET(connection,&readable);
+            struct timeval wait;
+            wait.tv_sec = 0;
+            wait.tv_usec = 100000;
+            int ready = select((int)connection + 1,&readable,NULL,NULL,&wait);
+            if(ready < 0)
+                return false;
+            if(stop != NULL && SDL_AtomicGet(stop))
+                return false;
+            if(ready == 0)
+            {
+                if(timeoutMs >= 0 && SDL_GetTicks() - start > (Uint32)timeoutMs)
+                    return false;
+                continue;
+            }
+        }
+
+        int received = recv(connection,bytes,size > 65536 ? 65536 : (int)size,0);
+        if(received <= 0)
+            return false;
+        bytes += received;
+        size -= received;
+        start = SDL_GetTicks();
+    }
+    return true;
+}
+
+//------------------ Messages  -------------------------
+
+//Every message is a 12 byte header, then length bytes of payload. Numbers
+//are little endian whatever the machine.
+static const Uint32 MESSAGE_MAGIC = 0x46524354; //"FRCT"
+
+enum MessageType
+{
+    MESSAGE_TILE = 1,
+    MESSAGE_RESULT = 2
+};
+
+//Payload larger than any tile could need, anything bigger is a broken stream
+static const Uint32 MAX_PAYLOAD = 256*1048576;
+
+class MessageWriter
+{
+    public:
+        std::vector<Uint8> bytes;
+
+        void begin(Uint32 type)
+        {
+            bytes.clear();
+            put32(MESSAGE_MAGIC);
+            put32(type);
+            put32(0);
+        };
+
+        void put32(Uint32 value)
+        {
+            value = SDL_SwapLE32(value);
+            bytes.insert(bytes.end(),(Uint8*)&value,(Uint8*)&value + 4);
+        };
+
+        void put64(Uint64 value)
+        {
+            value = SDL_SwapLE64(value);
+            bytes.insert(bytes.end(),(Uint8*)&value,(Uint8*)&value + 8);
+        };
+
+        void put_double(double value)
+        {
+            Uint64 bits;
+            memcpy(&bits,&value,8);
+            put64(bits);
+        };
+
+        bool send(Socket connection)
+        {
+            Uint32 length = SDL_SwapLE32((Uint32)bytes.size() - 12);
+            memcpy(&bytes[8],&length,4);
+            return send_all(connection,&bytes[0],bytes.size());
+        };
+};
+
+class MessageReader
+{
+    public:
+        Uint32 type;
+        std::vector<Uint8> bytes;
+        size_t position;
+
+        bool receive(Socket connection, int timeoutMs, SDL_atomic_t *stop)
+        {
+            Uint32 header[3];
+            if(!recv_all(connection,header,sizeof(header),timeoutMs,stop))
+                return false;
+            Uint32 length = SDL_SwapLE32(header[2]);
+            if(SDL_SwapLE32(header[0]) != MESSAGE_MAGIC || length > MAX_PAYLOAD)
+            {
+                printf("Not a render message, dropping the connection\n");
+                return false;
+            }
+            type = SDL_SwapLE32(header[1]);
+            bytes.resize(length);
+            position = 0;
+            return length == 0 || recv_all(connection,&bytes[0],length,timeoutMs,stop);
+        };
+
+        bool has(size_t size)
+        {
+            return position + size <= bytes.size();
+        };
+
+        Uint32 get32()
+        {
+            Uint32 value = 0;
+            if(has(4))
+                memcpy(&value,&bytes[position],4);
+            position += 4;
+            return SDL_SwapLE32(value);
+        };
+
+        Uint64 get64()
+        {
+            Uint64 value = 0;
+            if(has(8))
+                memcpy(&value,&bytes[position],8);
+            position += 8;
+            return SDL_SwapLE64(value);
+        };
+
+        double get_double()
+        {
+            Uint64 bits = get64();
+            double value;
+            memcpy(&value,&bits,8);
+            return value;
+        };
+};
+
+//What a worker needs to render one tile, the view is already centered on the tile
+struct TileRequest
+{
+    Uint32 id;
+    FractalType type;
+    FractalPrecision precision;
+    FractalView view;
+    int width;
+    int height;
+};
+
+static void write_request(MessageWriter &writer, const TileRequest &request)
+{
+    writer.begin(MESSAGE_TILE);
+    writer.put32(request.id);
+    writer.put32(request.type);
+    writer.put32(request.precision);
+    writer.put_double(request.view.centerX);
+    writer.put_double(request.view.centerY);
+    writer.put_double(request.view.pixelSize);
+    writer.put_double(request.view.juliaX);
+    writer.put_double(request.view.juliaY);
+    writer.put32(request.view.maxIt);
+    writer.put32(request.width);
+    writer.put32(request.height);
+}
+
+static bool read_request(MessageReader &reader, TileRequest &request)
+{
+    request.id = reader.get32();
+    request.type = (FractalType)reader.get32();
+    request.precision = (FractalPrecision)reader.get32();
+    request.view.centerX = reader.get_double();
+    request.view.centerY = reader.get_double();
+    request.view.pixelSize = reader.get_double();
+    request.view.juliaX = reader.get_double();
+    request.view.juliaY = reader.get_double();
+    request.view.maxIt = reader.get32();
+    request.width = reader.get32();
+    request.height = reader.get32();
+    return reader.position == reader.bytes.size() && request.type < FRACTAL_TYPE_COUNT && request.precision < FRACTAL_PRECISION_COUNT
+        && request.width > 0 && request.height > 0 && (Uint64)request.width*request.height*4 <= MAX_PAYLOAD;
+}
+
+//------------------ Compression  -------------------------
+
+//Escape counts change slowly across a tile and sit still in whole regions.
+//Each value is stored as the zigzagged difference from the one before in
+//LEB128 varints, and a difference of 0 is followed by how many more values
+//repeat it. Noisy areas take a byte or two per pixel, flat ones next to nothing.
+
+static void put_varint(std::vector<Uint8> &out, Uint32 value)
+{
+    while(value >= 0x80)
+    {
+        out.push_back((Uint8)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((Uint8)value);
+}
+
+static bool get_varint(const Uint8 *&data, const Uint8 *end, Uint32 &value)
+{
+    value = 0;
+    for(int shift = 0; shift < 35; shift += 7)
+    {
+        if(data == end)
+            return false;
+        Uint8 byte = *data++;
+        value |= (Uint32)(byte & 0x7F) << shift;
+        if(byte < 0x80)
+            return true;
+    }
+    return false;
+}
+
+static void compress_iterations(const Uint32 *values, int count, std::vector<Uint8> &out)
+{
+    Uint32 previous = 0;
+    int i = 0;
+    while(i < count)
+    {
+        Uint32 value = values[i];
+        if(value == previous)
+        {
+            int run = 1;
+            while(i + run < count && values[i + run] == value)
+                run++;
+            put_varint(out,0);
+            put_varint(out,run - 1);
+            i += run;
+            continue;
+        }
+
+        Sint32 delta = (Sint32)(value - previous);
+        put_varint(out,((Uint32)delta << 1) ^ (Uint32)(delta >> 31));
+        previous = value;
+        i++;
+    }
+}
+
+static bool decompress_iterations(const Uint8 *data, size_t size, Uint32 *values, int count)
+{
+    const Uint8 *end = data + size;
+    Uint32 previous = 0;
+    int i = 0;
+    while(i < count)
+    {
+        Uint32 code;
+        if(!get_varint(data,end,code))
+            return false;
+        if(code == 0)
+        {
+            Uint32 more;
+            if(!get_varint(data,end,more) || more >= (Uint32)(count - i))
+                return false;
+            for(Uint32 j = 0; j <= more; ++j)
+                values[i++] = previous;
+            continue;
+        }
+
+        Sint32 delta = (Sint32)((code >> 1) ^ (0u - (code & 1)));
+        previous += (Uint32)delta;
+        values[i++] = previous;
+    }
+    return data == end;
+}
+
+//------------------ Worker  -------------------------
+
+static const int TILE_BANDS = 16;
+
+struct TileWork
+{
+    FractalKernel kernel;
+    FractalView view;
+    Uint32 *pixels;
+    int width;
+    int height;
+    Uint64 bandIterations[TILE_BANDS];
+};
+
+static void tile_band(void *data, int index)
+{
+    TileWork *work = (TileWork*)data;
+    int rowStart = work->height*index/TILE_BANDS;
+    int rowEnd = work->height*(index+1)/TILE_BANDS;
+    work->bandIterations[index] = work->kernel(work->view,work->pixels,work->width*4,work->width,work->height,rowStart,rowEnd);
+}
+
+//Answers tiles until the coordinator hangs up, returns false if the worker should exit
+static bool serve(Socket connection, const RenderWorkerOptions &options, int &served)
+{
+    MessageReader reader;
+    MessageWriter writer;
+    std::vector<Uint32> tile;
+    std::vector<Uint8> compressed;
+
+    while(reader.receive(connection,-1,NULL))
+    {
+        TileRequest request;
+        if(reader.type != MESSAGE_TILE || !read_request(reader,request))
+        {
+            printf("Bad tile request, dropping the connection\n");
+            return true;
+        }
+
+        if(options.failAfter > 0 && served >= options.failAfter)
+        {
+            printf("Worker failing on purpose after %d tiles\n",served);
+            return false;
+        }
+
+        Uint64 start = SDL_GetPerformanceCounter();
+
+        tile.resize((size_t)request.width*request.height);
+        TileWork work;
+        work.kernel = get_iteration_kernel(request.type,request.precision);
+        work.view = request.view;
+        work.pixels = &tile[0];
+        work.width = request.width;
+        work.height = request.height;
+        jobs_parallel_for(tile_band,&work,TILE_BANDS);
+
+        if(options.delayMs > 0)
+            SDL_Delay(options.delayMs);
+
+        Uint64 iterations = 0;
+        for(int i = 0; i < TILE_BANDS; ++i)
+            iterations += work.bandIterations[i];
+
+        compressed.clear();
+        compress_iterations(&tile[0],(int)tile.size(),compressed);
+
+        Uint32 computeUs = (Uint32)((SDL_GetPerformanceCounter()-start)*1000000/SDL_GetPerformanceFrequency());
+
+        writer.begin(MESSAGE_RESULT);
+        writer.put32(request.id);
+        writer.put32(computeUs);
+        writer.put64(iterations);
+        writer.bytes.insert(writer.bytes.end(),compressed.begin(),compressed.end());
+        if(!writer.send(connection))
+            return true;
+        served++;
+    }
+    return true;
+}
+
+int render_worker(const char *address, const RenderWorkerOptions &options)
+{
+    net_startup();
+    Socket listener = net_listen(address);
+    if(listener == NO_SOCKET)
+        return 1;
+
+    printf("Render worker listening on %s with %d threads\n",address,jobs_thread_count());
+    fflush(stdout);
+
+    int served = 0;
+    while(true)
+    {
+        Socket connection = accept(listener,NULL,NULL);
+        if(connection == NO_SOCKET)
+            continue;
+
+        bool keepGoing = serve(connection,options,served);
+        close_socket(connection);
+        if(!keepGoing)
+            break;
+    }
+
+    close_socket(listener);
+    return 1;
+}
+
+//------------------ Coordinator  -------------------------
+
+//Tiles a worker is sent ahead of the one it is rendering, so it never waits on the network
+static const int PIPELINE_DEPTH = 2;
+
+//How long to keep trying workers that are still starting up
+static const Uint32 CONNECT_WAIT_MS = 5000;
+
+struct TileState
+{
+    int x;
+    int y;
+    int width;
+    int height;
+    bool done;
+
+    //Workers it is outstanding on
+    int running;
+    Uint32 sentAt;
+};
+
+struct Coordinator
+{
+    const RenderJob *job;
+    Uint32 *iterations;
+    RenderStats *stats;
+
+    SDL_mutex *lock;
+    SDL_cond *changed;
+    std::vector<TileState> tiles;
+    std::deque<int> pending;
+    int remaining;
+
+    //Set when every tile is done, so workers still busy with copies stop waiting
+    SDL_atomic_t finished;
+};
+
+struct WorkerLink
+{
+    Coordinator *coordinator;
+    int index;
+    std::string address;
+    Socket connection;
+    std::deque<int> outstanding;
+};
+
+//Called with the lock held. Queued tiles first, then a copy of the tile running longest elsewhere.
+static int take_tile(Coordinator *coordinator, WorkerLink *link)
+{
+    while(!coordinator->pending.empty())
+    {
+        int tile = coordinator->pending.front();
+        coordinator->pending.pop_front();
+        if(!coordinator->tiles[tile].done)
+            return tile;
+    }
+
+    if(!link->outstanding.empty())
+        return -1;
+
+    int oldest = -1;
+    for(unsigned int i = 0; i < coordinator->tiles.size(); ++i)
+    {
+        const TileState &tile = coordinator->tiles[i];
+        if(!tile.done && tile.running == 1 && (oldest < 0 || tile.sentAt < coordinator->tiles[oldest].sentAt))
+            oldest = i;
+    }
+    if(oldest >= 0)
+        coordinator->stats->speculative++;
+    return oldest;
+}
+
+//Requeues whatever the worker still had that nobody else is working on
+static void fail_link(WorkerLink *link)
+{
+    Coordinator *coordinator = link->coordinator;
+    SDL_LockMutex(coordinator->lock);
+    bool wasNeeded = false;
+    while(!link->outstanding.empty())
+    {
+        int tile = link->outstanding.back();
+        link->outstanding.pop_back();
+        TileState &state = coordinator->tiles[tile];
+        state.running--;
+        if(!state.done && state.running == 0)
+        {
+            coordinator->pending.push_front(tile);
+            coordinator->stats->retried++;
+        }
+        wasNeeded = wasNeeded || !state.done;
+    }
+    if(wasNeeded)
+    {
+        coordinator->stats->workers[link->index].failed = true;
+        printf("Worker %s failed, its tiles go back on the queue\n",link->address.c_str());
+    }
+    SDL_CondBroadcast(coordinator->changed);
+    SDL_UnlockMutex(coordinator->lock);
+}
+
+static int link_main(void *data)
+{
+    WorkerLink *link = (WorkerLink*)data;
+    Coordinator *coordinator = link->coordinator;
+    const RenderJob &job = *coordinator->job;
+    RenderWorkerStats &stats = coordinator->stats->workers[link->index];
+
+    Uint32 connectStart = SDL_GetTicks();
+    link->connection = net_connect(link->address);
+    while(link->connection == NO_SOCKET && SDL_GetTicks() - connectStart < CONNECT_WAIT_MS && !SDL_AtomicGet(&coordinator->finished))
+    {
+        SDL_Delay(50);
+        link->connection = net_connect(link->address);
+    }
+    if(link->connection == NO_SOCKET)
+    {
+        printf("Could not reach worker %s\n",link->address.c_str());
+        return 0;
+    }
+    stats.connected = true;
+
+    MessageWriter writer;
+    MessageReader reader;
+    std::vector<Uint32> tile;
+    std::vector<int> toSend;
+
+    while(true)
+    {
+        SDL_LockMutex(coordinator->lock);
+        if(coordinator->remaining == 0)
+        {
+            SDL_UnlockMutex(coordinator->lock);
+            break;
+        }
+
+        toSend.clear();
+        while(link->outstanding.size() < (size_t)PIPELINE_DEPTH)
+        {
+            int next = take_tile(coordinator,link);
+            if(next < 0)
+                break;
+            coordinator->tiles[next].running++;
+            coordinator->tiles[next].sentAt = SDL_GetTicks();
+            link->outstanding.push_back(next);
+            toSend.push_back(next);
+        }
+
+        if(link->outstanding.empty())
+        {
+            SDL_CondWaitTimeout(coordinator->changed,coordinator->lock,100);
+            SDL_UnlockMutex(coordinator->lock);
+            continue;
+        }
+        SDL_UnlockMutex(coordinator->lock);
+
+        bool ok = true;
+        for(unsigned int i = 0; i < toSend.size() && ok; ++i)
+        {
+            const TileState &state = coordinator->tiles[toSend[i]];
+
+            //Centered so the kernel lands on the same pixel grid as the whole image
+            TileRequest request;
+            request.id = toSend[i];
+            request.type = job.type;
+            request.precision = job.precision;
+            request.view = job.view;
+            request.view.centerX = job.view.centerX + (state.x + state.width/2 - job.width/2)*job.view.pixelSize;
+            request.view.centerY = job.view.centerY + (state.y + state.height/2 - job.height/2)*job.view.pixelSize;
+            request.width = state.width;
+            request.height = state.height;
+
+            write_request(writer,request);
+            ok = writer.send(link->connection);
+        }
+
+        //Answers come back in the order the tiles were sent
+        int expected = link->outstanding.front();
+        const TileState &state = coordinator->tiles[expected];
+        ok = ok && reader.receive(link->connection,job.timeoutMs,&coordinator->finished) && reader.type == MESSAGE_RESULT;
+        ok = ok && reader.get32() == (Uint32)expected;
+        Uint32 computeUs = reader.get32();
+        Uint64 iterations = reader.get64();
+        tile.resize((size_t)state.width*state.height);
+        ok = ok && reader.has(0) && decompress_iterations(&reader.bytes[0] + reader.position,reader.bytes.size() - reader.position,&tile[0],(int)tile.size());
+        if(!ok)
+        {
+            if(!SDL_AtomicGet(&coordinator->finished))
+                fail_link(link);
+            break;
+        }
+
+        SDL_LockMutex(coordinator->lock);
+        link->outstanding.pop_front();
+        TileState &done = coordinator->tiles[expected];
+        done.running--;
+        if(!done.done)
+        {
+            for(int row = 0; row < done.height; ++row)
+            {
+                memcpy(coordinator->iterations + (size_t)(done.y + row)*job.width + done.x,&tile[(size_t)row*done.width],done.width*4);
+            }
+            done.done = true;
+            coordinator->remaining--;
+            if(coordinator->remaining == 0)
+                SDL_AtomicSet(&coordinator->finished,1);
+            stats.tiles++;
+        }
+        else
+        {
+            stats.duplicates++;
+        }
+        stats.pixels += (Uint64)done.width*done.height;
+        stats.iterations += iterations;
+        stats.computeMs += computeUs/1000.0;
+        stats.rawBytes += (Uint64)done.width*done.height*4;
+        stats.compressedBytes += reader.position < reader.bytes.size() ? reader.bytes.size() - reader.position : 0;
+        SDL_CondBroadcast(coordinator->changed);
+        SDL_UnlockMutex(coordinator->lock);
+    }
+
+    close_socket(link->connection);
+    return 0;
+}
+
+bool render_distributed(const RenderJob &job, const std::vector<std::string> &workers, Uint32 *iterations, RenderStats *stats)
+{
+    net_startup();
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    Coordinator coordinator;
+    coordinator.job = &job;
+    coordinator.iterations = iterations;
+    coordinator.stats = stats;
+    coordinator.lock = SDL_CreateMutex();
+    coordinator.changed = SDL_CreateCond();
+    SDL_AtomicSet(&coordinator.finished,0);
+
+    for(int y = 0; y < job.height; y += job.tileSize)
+    {
+        for(int x = 0; x < job.width; x += job.tileSize)
+        {
+            TileState tile;
+            tile.x = x;
+            tile.y = y;
+            tile.width = x + job.tileSize < job.width ? job.tileSize : job.width - x;
+            tile.height = y + job.tileSize < job.height ? job.tileSize : job.height - y;
+            tile.done = false;
+            tile.running = 0;
+            tile.sentAt = 0;
+            coordinator.pending.push_back(coordinator.tiles.size());
+            coordinator.tiles.push_back(tile);
+        }
+    }
+    coordinator.remaining = coordinator.tiles.size();
+
+    stats->tiles = coordinator.tiles.size();
+    stats->retried = 0;
+    stats->speculative = 0;
+    stats->workers.assign(workers.size(),RenderWorkerStats());
+
+    std::vector<WorkerLink> links(workers.size());
+    std::vector<SDL_Thread*> threads(workers.size());
+    for(unsigned int i = 0; i < workers.size(); ++i)
+    {
+        RenderWorkerStats &worker = stats->workers[i];
+        worker.address = workers[i];
+        worker.connected = false;
+        worker.failed = false;
+        worker.tiles = 0;
+        worker.duplicates = 0;
+        worker.pixels = 0;
+        worker.iterations = 0;
+        worker.computeMs = 0.0;
+        worker.rawBytes = 0;
+        worker.compressedBytes = 0;
+
+        links[i].coordinator = &coordinator;
+        links[i].index = i;
+        links[i].address = workers[i];
+        links[i].connection = NO_SOCKET;
+        threads[i] = SDL_CreateThread(link_main,"render link",&links[i]);
+    }
+    for(unsigned int i = 0; i < threads.size(); ++i)
+    {
+        SDL_WaitThread(threads[i],NULL);
+    }
+
+    SDL_DestroyCond(coordinator.changed);
+    SDL_DestroyMutex(coordinator.lock);
+
+    stats->wallMs = (SDL_GetPerformanceCounter()-start)*1000.0/SDL_GetPerformanceFrequency();
+    if(coordinator.remaining > 0)
+        printf("Every worker failed with %d of %d tiles left\n",coordinator.remaining,stats->tiles);
+    return coordinator.remaining == 0;
+}
+
+//------------------ Local workers  -------------------------
+
+#ifdef _WIN32
+static std::vector<intptr_t> localWorkers;
+#else
+static std::vector<pid_t> localWorkers;
+#endif
+static std::vector<std::string> localSockets;
+
+bool render_spawn_local_workers(const char *executable, int count, bool tcp, const std::vector<std::string> &arguments, std::vector<std::string> &addresses)
+{
+#ifdef _WIN32
+    tcp = true;
+#endif
+    for(int i = 0; i < count; ++i)
+    {
+        char address[256];
+        if(tcp)
+            sprintf(address,"127.0.0.1:%d",47000 + i);
+        else
+            sprintf(address,"unix:/tmp/fractal-worker-%d-%d.sock",(int)getpid(),i);
+
+        std::vector<std::string> words;
+        words.push_back(executable);
+        words.push_back("--render-worker");
+        words.push_back(address);
+        if(i < (int)arguments.size())
+        {
+            //Split on spaces, none of the worker options take quoted values
+            std::string extra = arguments[i];
+            size_t begin = 0;
+            while(begin < extra.size())
+            {
+                size_t end = extra.find(' ',begin);
+                if(end == std::string::npos)
+                    end = extra.size();
+                if(end > begin)
+                    words.push_back(extra.substr(begin,end - begin));
+                begin = end + 1;
+            }
+        }
+
+        std::vector<char*> argv;
+        for(unsigned int j = 0; j < words.size(); ++j)
+            argv.push_back((char*)words[j].c_str());
+        argv.push_back(NULL);
+
+#ifdef _WIN32
+        intptr_t process = _spawnv(_P_NOWAIT,executable,&argv[0]);
+        if(process == -1)
+#else
+        pid_t process;
+        if(posix_spawnp(&process,executable,NULL,NULL,&argv[0],environ) != 0)
+#endif
+        {
+            printf("Could not start a local worker from %s\n",executable);
+            return false;
+        }
+
+        localWorkers.push_back(process);
+        if(!tcp)
+            localSockets.push_back(address + 5);
+        addresses.push_back(address);
+    }
+    return true;
+}
+
+void render_stop_local_workers()
+{
+    for(unsigned int i = 0; i < localWorkers.size(); ++i)
+    {
+#ifdef _WIN32
+        TerminateProcess((HANDLE)localWorkers[i],0);
+        CloseHandle((HANDLE)localWorkers[i]);
+#else
+        kill(localWorkers[i],SIGTERM);
+        waitpid(localWorkers[i],NULL,0);
+#endif
+    }
+    localWorkers.clear();
+
+#ifndef _WIN32
+    for(unsigned int i = 0; i < localSockets.size(); ++i)
+        unlink(localSockets[i].c_str());
+#endif
+    localSockets.clear();
+}
@@ -0,0 +1,89 @@
+#ifndef NETRENDER_H
+#define NETRENDER_H
+
+#include <SDL2/SDL.h>
+#include <string>
+#include <vector>
+#include "fractal.h"
+
+//Offline fractal renders split across worker processes, on this machine or
+//others. A worker (--render-worker) listens on a socket and answers tile jobs
+//with the tile's escape counts, delta and run-length encoded. The coordinator
+//keeps every worker two tiles ahead from a shared queue, so faster workers
+//take more tiles; once the queue is empty, idle workers also take copies of
+//tiles still running elsewhere and the first answer wins, so one slow worker
+//cannot hold up the end of the render. Tiles on a worker that disconnects or
+//stops answering go back on the queue.
+//
+//Addresses are "unix:/path/to/socket" or "host:port".
+
+struct RenderJob
+{
+    FractalType type;
+    FractalPrecision precision;
+    FractalView view;
+    int width;
+    int height;
+    int tileSize;
+
+    //A worker silent for this long with tiles outstanding is given up on
+    int timeoutMs;
+};
+
+struct RenderWorkerStats
+{
+    std::string address;
+    bool connected;
+    bool failed;
+    int tiles;
+
+    //Tiles this worker finished after another worker already had
+    int duplicates;
+    Uint64 pixels;
+    Uint64 iterations;
+    double computeMs;
+    Uint64 rawBytes;
+    Uint64 compressedBytes;
+};
+
+struct RenderStats
+{
+    double wallMs;
+    int tiles;
+
+    //Tiles sent again after their worker failed
+    int retried;
+
+    //Tiles copied to an idle worker while still running on another
+    int speculative;
+    std::vector<RenderWorkerStats> workers;
+};
+
+//Testing knobs for a worker, to see the coordinator cope with slow and dying workers
+struct RenderWorkerOptions
+{
+    //Added to every tile
+    int delayMs;
+
+    //The process exits without answering the tile after this many, 0 never
+    int failAfter;
+};
+
+//Serves coordinators one at a time until the process is killed. Tiles are
+//computed with the job pool, so call jobs_init() first. Returns non-zero on error.
+int render_worker(const char *address, const RenderWorkerOptions &options);
+
+//Renders job.width x job.height escape counts into iterations (see
+//IterationColoring) using every worker that can be reached. Returns false
+//if the workers all failed before every tile was done.
+bool render_distributed(const RenderJob &job, const std::vector<std::string> &workers, Uint32 *iterations, RenderStats *stats);
+
+//Starts count copies of executable in worker mode on this machine, on loopback
+//TCP from port 47000 up or on Unix sockets in /tmp, and adds their addresses.
+//arguments[i] is passed to worker i on top of the address.
+bool render_spawn_local_workers(const char *executable, int count, bool tcp, const std::vector<std::string> &arguments, std::vector<std::string> &addresses);
+
+//Kills the workers render_spawn_local_workers() started and waits for them
+void render_stop_local_workers();
+
+#endif // NETRENDER_H
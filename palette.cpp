@@ -0,0 +1,410 @@
+#include "palette.h"
+#include "jobs.h"
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+
+//AVX2 is compiled per function and only called when the CPU reports it
+#if defined(__GNUC__) || defined(__clang__)
+#define PALETTE_AVX2
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(_MSC_VER)
+#define PALETTE_AVX2
+#define TARGET_AVX2
+#endif
+#endif
+
+const char *PALETTE_SCHEME_NAMES[PALETTE_SCHEME_COUNT] = {"banded","smooth","equalized"};
+
+static const int PALETTE_BANDS = 64;
+static const int RAMP_BITS = 12;
+
+//Counts per turn of the ramp. The banded ramp is 2^7 = 128 counts, where all
+//three channels wrap together; the smooth one is the old t = mu*0.15.
+static const int BANDED_BITS = 7;
+static const double SMOOTH_PERIOD = 2.0*M_PI/0.15;
+
+struct RowLookup
+{
+    const Uint32 *positions;
+    const Uint32 *slopes;
+    const Uint32 *ramp;
+    Uint32 lastCount;
+    Uint32 interiorCount;
+    Uint32 offset;
+};
+
+typedef void (*ColorizeRow)(const RowLookup &lookup, const Uint32 *escapes, Uint32 *pixels, int count);
+
+//Fraction of a turn in 1/2^32 steps
+static Uint32 to_turns(double turns)
+{
+    double position = (turns - floor(turns))*4294967296.0;
+    return position >= 4294967295.0 ? 0xFFFFFFFF : (Uint32)position;
+}
+
+//------------------ Scalar  -------------------------
+
+static void colorize_row_scalar(const RowLookup &lookup, const Uint32 *escapes, Uint32 *pixels, int count)
+{
+    for(int i = 0; i < count; ++i)
+    {
+        Uint32 escape = escapes[i];
+        Uint32 it = escape >> 8;
+        if(it > lookup.lastCount)
+            it = lookup.lastCount;
+        Uint32 position = lookup.positions[it] + lookup.slopes[it]*(escape & 0xFF) + lookup.offset;
+        pixels[i] = it >= lookup.interiorCount ? 0xFF000000 : lookup.ramp[position >> (32 - RAMP_BITS)];
+    }
+}
+
+//------------------ AVX2  -------------------------
+
+#ifdef PALETTE_AVX2
+
+//Every lane is loaded before any is stored, so escapes and pixels may be the same row
+TARGET_AVX2 static void colorize_row_avx2(const RowLookup &lookup, const Uint32 *escapes, Uint32 *pixels, int count)
+{
+    __m256i last = _mm256_set1_epi32(lookup.lastCount);
+    __m256i interior = _mm256_set1_epi32(lookup.interiorCount - 1);
+    __m256i offset = _mm256_set1_epi32(lookup.offset);
+    __m256i fraction = _mm256_set1_epi32(0xFF);
+    __m256i black = _mm256_set1_epi32((int)0xFF000000);
+
+    int i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256i escape = _mm256_loadu_si256((const __m256i*)(escapes + i));
+        __m256i it = _mm256_min_epu32(_mm256_srli_epi32(escape,8),last);
+        __m256i position = _mm256_i32gather_epi32((const int*)lookup.positions,it,4);
+        __m256i slope = _mm256_i32gather_epi32((const int*)lookup.slopes,it,4);
+        position = _mm256_add_epi32(_mm256_add_epi32(position,_mm256_mullo_epi32(slope,_mm256_and_si256(escape,fraction))),offset);
+        __m256i color = _mm256_i32gather_epi32((const int*)lookup.ramp,_mm256_srli_epi32(position,32 - RAMP_BITS),4);
+        color = _mm256_blendv_epi8(color,black,_mm256_cmpgt_epi32(it,interior));
+        _mm256_storeu_si256((__m256i*)(pixels + i),color);
+    }
+    colorize_row_scalar(lookup,escapes + i,pixels + i,count - i);
+}
+
+#endif
+
+//Picked once from what the CPU supports
+static ColorizeRow colorizeRow = colorize_row_scalar;
+static const char *kernelName = "scalar";
+
+//------------------ FractalPalette  -------------------------
+
+FractalPalette::FractalPalette()
+{
+    offset = 0.0;
+    escapes = NULL;
+    escapePitch = 0;
+    pixels = NULL;
+    pitch = 0;
+    width = 0;
+    height = 0;
+    prepare(PALETTE_BANDED,0,NULL,0,0,0);
+
+#ifdef PALETTE_AVX2
+    if(SDL_HasAVX2())
+    {
+        colorizeRow = colorize_row_avx2;
+        kernelName = "avx2";
+    }
+#endif
+}
+
+void FractalPalette::prepare(PaletteScheme scheme, int maxIt, const Uint32 *escapes, int pitch, int width, int height)
+{
+    this->scheme = scheme;
+    this->maxIt = maxIt > 0 ? maxIt : 0;
+    int counts = this->maxIt + 2;
+    positions.assign(counts,0);
+    slopes.assign(counts,0);
+
+    if(scheme == PALETTE_BANDED)
+    {
+        //The interior is just the next band, as it always was
+        interiorCount = counts;
+        for(int it = 0; it < counts; ++it)
+            positions[it] = (Uint32)it << (32 - BANDED_BITS);
+        for(int i = 0; i < 4096; ++i)
+        {
+            int it = i >> (RAMP_BITS - BANDED_BITS);
+            Uint8 r = it*200;
+            Uint8 g = it*100;
+            Uint8 b = it*50;
+            ramp[i] = 0xFF000000 | (r << 16) | (g << 8) | b;
+        }
+        return;
+    }
+
+    interiorCount = this->maxIt + 1;
+    for(int i = 0; i < 4096; ++i)
+    {
+        double t = 2.0*M_PI*i/4096.0;
+        Uint8 r = 127.5 + 127.5*sin(t);
+        Uint8 g = 127.5 + 127.5*sin(t + 2.094);
+        Uint8 b = 127.5 + 127.5*sin(t + 4.188);
+        ramp[i] = 0xFF000000 | (r << 16) | (g << 8) | b;
+    }
+
+    if(scheme == PALETTE_SMOOTH)
+    {
+        Uint32 slope = (Uint32)(4294967296.0/(SMOOTH_PERIOD*128.0));
+        for(int it = 0; it < counts; ++it)
+        {
+            positions[it] = to_turns(it/SMOOTH_PERIOD);
+            slopes[it] = slope;
+        }
+        return;
+    }
+
+    //Runs once per finished grid, not per frame, so one thread is plenty
+    histogram.assign(counts,0);
+    Uint64 escaped = 0;
+    for(int y = 0; y < height && escapes != NULL; ++y)
+    {
+        const Uint32 *row = (const Uint32*)((const Uint8*)escapes + y*pitch);
+        for(int x = 0; x < width; ++x)
+        {
+            Uint32 it = row[x] >> 8;
+            if(it <= (Uint32)this->maxIt)
+            {
+                histogram[it]++;
+                escaped++;
+            }
+        }
+    }
+    if(escaped == 0)
+        return;
+
+    //Each count starts where the share of escaped pixels below it ends, and
+    //the fraction spreads its pixels over the count's own share. A whole
+    //count of nu is a fraction of 128, which reaches the next count's start.
+    Uint64 below = 0;
+    double start = 0.0;
+    for(int it = 0; it <= this->maxIt; ++it)
+    {
+        below += histogram[it];
+        double end = (double)below/escaped;
+        positions[it] = start >= 1.0 ? 0xFFFFFFFF : (Uint32)(start*4294967296.0);
+        slopes[it] = (Uint32)((end - start)*4294967296.0/128.0);
+        start = end;
+    }
+}
+
+void FractalPalette::colorize_row(const Uint32 *escapes, Uint32 *pixels, int count)
+{
+    RowLookup lookup;
+    lookup.positions = &positions[0];
+    lookup.slopes = &slopes[0];
+    lookup.ramp = ramp;
+    lookup.lastCount = maxIt + 1;
+    lookup.interiorCount = interiorCount;
+    lookup.offset = to_turns(offset);
+    colorizeRow(lookup,escapes,pixels,count);
+}
+
+void FractalPalette::colorize_band(void *data, int index)
+{
+    FractalPalette *palette = (FractalPalette*)data;
+    int rowStart = palette->height*index/PALETTE_BANDS;
+    int rowEnd = palette->height*(index + 1)/PALETTE_BANDS;
+    for(int y = rowStart; y < rowEnd; ++y)
+    {
+        const Uint32 *in = (const Uint32*)((const Uint8*)palette->escapes + y*palette->escapePitch);
+        Uint32 *out = (Uint32*)((Uint8*)palette->pixels + y*palette->pitch);
+        palette->colorize_row(in,out,palette->width);
+    }
+}
+
+void FractalPalette::colorize(const Uint32 *escapes, int escapePitch, Uint32 *pixels, int pitch, int width, int height)
+{
+    this->escapes = escapes;
+    this->escapePitch = escapePitch;
+    this->pixels = pixels;
+    this->pitch = pitch;
+    this->width = width;
+    this->height = height;
+    jobs_parallel_for(colorize_band,this,PALETTE_BANDS);
+    this->escapes = NULL;
+    this->pixels = NULL;
+}
+
+const char *FractalPalette::kernel_name()
+{
+    return kernelName;
+}
+
+//------------------ Antialiasing  -------------------------
+
+//Counts from view.maxIt + 1 up are the interior (see EscapeColoring)
+static inline bool counts_differ(Uint32 a, Uint32 b, Uint32 interior, Uint32 countDelta)
+{
+    Uint32 countA = a >> 8;
+    Uint32 countB = b >> 8;
+    if((countA >= interior) != (countB >= interior))
+        return true;
+    if(countDelta == 0 || countA >= interior)
+        return false;
+    return countA > countB ? countA - countB >= countDelta : countB - countA >= countDelta;
+}
+
+//Iterations the kernel ran for a run of escape values, interior ones ran them all
+static inline Uint64 iterations_of(const Uint32 *escapes, int count, Uint32 maxIt)
+{
+    Uint64 iterations = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        Uint32 it = escapes[i] >> 8;
+        iterations += (it < maxIt ? it : maxIt) + 1;
+    }
+    return iterations;
+}
+
+static inline Uint32 average_colors(const Uint32 *colors, int count)
+{
+    Uint32 r = 0;
+    Uint32 g = 0;
+    Uint32 b = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        r += (colors[i] >> 16) & 0xFF;
+        g += (colors[i] >> 8) & 0xFF;
+        b += colors[i] & 0xFF;
+    }
+    return 0xFF000000 | ((r + count/2)/count << 16) | ((g + count/2)/count << 8) | (b + count/2)/count;
+}
+
+//Runs the kernel over an n x n grid of points spread evenly inside pixel (x,y), samples get their escape values
+static void sample_pixel(FractalKernel kernel, const FractalView &view, int width, int height, int x, int y, int n, Uint32 *samples)
+{
+    FractalView grid = view;
+    grid.pixelSize = view.pixelSize/n;
+    double offset = -0.5*view.pixelSize + 0.5*grid.pixelSize + (n/2)*grid.pixelSize;
+    grid.centerX = view.centerX + (x - width/2)*view.pixelSize + offset;
+    grid.centerY = view.centerY + (y - height/2)*view.pixelSize + offset;
+    kernel(grid,samples,n*4,n,n,0,n);
+}
+
+//Set on a refined pixel's alpha while its 2x2 samples disagree and it may still get the full grid
+static const Uint32 DISAGREE_MARK = 0xFE000000;
+
+static inline bool is_edge(const Uint32 *above, const Uint32 *row, const Uint32 *below, int x, int width, Uint32 interior, Uint32 delta)
+{
+    Uint32 center = row[x];
+    return counts_differ(center,above[x],interior,delta) || counts_differ(center,below[x],interior,delta)
+           || (x > 0 && counts_differ(center,row[x - 1],interior,delta)) || (x + 1 < width && counts_differ(center,row[x + 1],interior,delta));
+}
+
+void antialias_rows(FractalKernel kernel, const FractalView &view, FractalPalette &palette, const Uint32 *escapes, int escapePitch,
+                    Uint32 *destination, int destinationPitch, int width, int height, int rowStart, int rowEnd,
+                    int maxSamples, int countDelta, AntialiasStats *stats)
+{
+    int n = 2;
+    while((n + 1)*(n + 1) <= maxSamples)
+        n++;
+    Uint32 samples[64*64];
+    if(n > 64)
+        n = 64;
+
+    Uint32 maxIt = view.maxIt > 0 ? view.maxIt : 0;
+    Uint32 interior = maxIt + 1;
+    Uint32 delta = countDelta > 0 ? countDelta : 0;
+
+    //Colors every row, then adds up the iterations the rows took with one
+    //sample and what 2x2 samples of their edges would take, each sample
+    //guessed to take as long as its pixel did
+    Uint64 budget = 0;
+    Uint64 needed = 0;
+    for(int y = rowStart; y < rowEnd; ++y)
+    {
+        const Uint32 *in = (const Uint32*)((const Uint8*)escapes + y*escapePitch);
+        const Uint32 *above = y > 0 ? (const Uint32*)((const Uint8*)in - escapePitch) : in;
+        const Uint32 *below = y + 1 < height ? (const Uint32*)((const Uint8*)in + escapePitch) : in;
+        palette.colorize_row(in,(Uint32*)((Uint8*)destination + y*destinationPitch),width);
+        budget += (Uint64)(iterations_of(in,width,maxIt)*ANTIALIAS_BUDGET);
+        for(int x = 0; x < width && maxSamples >= 4; ++x)
+        {
+            if(is_edge(above,in,below,x,width,interior,delta))
+                needed += 4*iterations_of(in + x,1,maxIt);
+        }
+    }
+    if(maxSamples < 4)
+        return;
+
+    //When the edges cost more than the budget, the same share of them is
+    //refined everywhere, spread out by stride instead of the first ones reached
+    double share = needed > budget ? (double)budget/needed : 1.0;
+    double credit = 0.5;
+    Uint64 spent = 0;
+    Uint64 escalate = 0;
+    for(int y = rowStart; y < rowEnd; ++y)
+    {
+        const Uint32 *in = (const Uint32*)((const Uint8*)escapes + y*escapePitch);
+        const Uint32 *above = y > 0 ? (const Uint32*)((const Uint8*)in - escapePitch) : in;
+        const Uint32 *below = y + 1 < height ? (const Uint32*)((const Uint8*)in + escapePitch) : in;
+        Uint32 *out = (Uint32*)((Uint8*)destination + y*destinationPitch);
+        for(int x = 0; x < width; ++x)
+        {
+            if(!is_edge(above,in,below,x,width,interior,delta))
+                continue;
+
+            credit += share;
+            if(credit < 1.0)
+            {
+                stats->skipped++;
+                continue;
+            }
+            credit -= 1.0;
+
+            sample_pixel(kernel,view,width,height,x,y,2,samples);
+            spent += iterations_of(samples,4,maxIt);
+            stats->refined++;
+            stats->samples += 4;
+
+            bool agree = !counts_differ(samples[0],samples[1],interior,delta) && !counts_differ(samples[0],samples[2],interior,delta)
+                         && !counts_differ(samples[0],samples[3],interior,delta);
+            palette.colorize_row(samples,samples,4);
+            out[x] = average_colors(samples,4);
+            if(!agree && n > 2)
+            {
+                out[x] = (out[x] & 0xFFFFFF) | DISAGREE_MARK;
+                escalate += n*n*iterations_of(in + x,1,maxIt);
+            }
+        }
+    }
+    if(escalate == 0)
+        return;
+
+    //The full grid gets what the 2x2 samples left, at most half the budget,
+    //shared out over the marked pixels the same way
+    Uint64 left = spent < budget ? budget - spent : 0;
+    if(left > budget/2)
+        left = budget/2;
+    share = escalate > left ? (double)left/escalate : 1.0;
+    credit = 0.5;
+    for(int y = rowStart; y < rowEnd; ++y)
+    {
+        Uint32 *out = (Uint32*)((Uint8*)destination + y*destinationPitch);
+        for(int x = 0; x < width; ++x)
+        {
+            if((out[x] & 0xFF000000) != DISAGREE_MARK)
+                continue;
+
+            out[x] |= 0xFF000000;
+            credit += share;
+            if(credit < 1.0)
+                continue;
+            credit -= 1.0;
+
+            sample_pixel(kernel,view,width,height,x,y,n,samples);
+            stats->escalated++;
+            stats->samples += n*n;
+            palette.colorize_row(samples,samples,n*n);
+            out[x] = average_colors(samples,n*n);
+        }
+    }
+}
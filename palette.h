@@ -0,0 +1,112 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+#include "fractal.h"
+
+//Colors for the escape values get_escape_kernel() stores. A view is computed
+//once into a buffer of those and colorize() maps the buffer to ARGB8888 in
+//bands across the job pool, so switching or animating the palette runs no
+//iterations at all. Every value goes through two tables: its count to a
+//position around a 4096 entry ramp, then the position to a color. With AVX2
+//both are gathers, 8 pixels at a time; other CPUs take the scalar loop.
+
+enum PaletteScheme
+{
+    //The original look, channels wrapping at it*200, it*100 and it*50
+    PALETTE_BANDED,
+
+    //Continuous count through a sine ramp, interior is black
+    PALETTE_SMOOTH,
+
+    //The smooth ramp spread over the counts in the image by their histogram,
+    //each color covers about as many pixels
+    PALETTE_EQUALIZED,
+
+    PALETTE_SCHEME_COUNT
+};
+
+extern const char *PALETTE_SCHEME_NAMES[PALETTE_SCHEME_COUNT];
+
+class FractalPalette
+{
+    public:
+        FractalPalette();
+
+        //Builds the count table for the scheme and maxIt. Equalized needs the
+        //width x height buffer it will color for its histogram, call it again
+        //whenever the buffer changes; the other schemes ignore it.
+        void prepare(PaletteScheme scheme, int maxIt, const Uint32 *escapes, int pitch, int width, int height);
+
+        //Maps a width x height block of escape values to ARGB8888, rows split across the job pool
+        void colorize(const Uint32 *escapes, int escapePitch, Uint32 *pixels, int pitch, int width, int height);
+
+        //One row on the calling thread, pixels may be escapes
+        void colorize_row(const Uint32 *escapes, Uint32 *pixels, int count);
+
+        //"avx2" or "scalar"
+        const char *kernel_name();
+
+        PaletteScheme scheme;
+        int maxIt;
+
+        //Turns around the ramp, palette cycling moves it
+        double offset;
+
+    private:
+        static void colorize_band(void *data, int index);
+
+        //Per count up to maxIt+1: position in 1/2^32 turns, and how far each
+        //step of the stored fraction moves it
+        std::vector<Uint32> positions;
+        std::vector<Uint32> slopes;
+        std::vector<Uint32> histogram;
+        Uint32 ramp[4096];
+
+        //Counts from this one up are the interior
+        int interiorCount;
+
+        //Set for the duration of colorize()
+        const Uint32 *escapes;
+        int escapePitch;
+        Uint32 *pixels;
+        int pitch;
+        int width;
+        int height;
+};
+
+//------------------ Antialiasing  -------------------------
+
+//Refining may spend at most this many kernel iterations for every one the
+//single sample pass of the rows took, going on to the full grid only half
+//of them. When the edges need more, an even share of them is refined
+//throughout the rows and the rest keep their one or their 2x2 samples.
+const double ANTIALIAS_BUDGET = 1.0;
+
+struct AntialiasStats
+{
+    //Pixels given 2x2 samples, and those of them that went on to the full count
+    Uint64 refined;
+    Uint64 escalated;
+
+    //Edges left with one sample because the budget was used up
+    Uint64 skipped;
+
+    //Samples taken on top of the one per pixel
+    Uint64 samples;
+};
+
+//Writes rows [rowStart,rowEnd) of destination in color from a finished one
+//sample per pixel grid of escape values the escape kernel drew of view.
+//A pixel is an edge when it is inside the set and a 4-neighbour is not, or
+//the other way round, or when their escape counts differ by countDelta or
+//more; 0 only takes the edge of the set. Edges are sampled again on a 2x2
+//grid inside the pixel and, if those are edges of each other too, on the
+//largest square grid with at most maxSamples points while ANTIALIAS_BUDGET
+//allows; the rest keep their one sample. maxSamples below 4 only colors.
+void antialias_rows(FractalKernel kernel, const FractalView &view, FractalPalette &palette, const Uint32 *escapes, int escapePitch,
+                    Uint32 *destination, int destinationPitch, int width, int height, int rowStart, int rowEnd,
+                    int maxSamples, int countDelta, AntialiasStats *stats);
+
+#endif // PALETTE_H
@@ -0,0 +1,273 @@
+#include "resample.h"
+#include "jobs.h"
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RESAMPLE_SSE2
+#include <emmintrin.h>
+#endif
+
+//------------------ Pixels  -------------------------
+
+//One pixel as four floats in memory order (b, g, r, a), rgb premultiplied by alpha.
+//The SSE2 and plain versions round the same way up to ties.
+#ifdef RESAMPLE_SSE2
+
+struct Pixel4
+{
+    __m128 v;
+};
+
+static inline Pixel4 pixel_zero()
+{
+    Pixel4 pixel = {_mm_setzero_ps()};
+    return pixel;
+}
+
+static inline Pixel4 pixel_load(Uint32 argb)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i wide = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(argb),zero),zero);
+    __m128 value = _mm_cvtepi32_ps(wide);
+
+    //Scale rgb by alpha/255 and leave alpha as it is
+    __m128 alpha = _mm_shuffle_ps(value,value,_MM_SHUFFLE(3,3,3,3));
+    __m128 factor = _mm_mul_ps(alpha,_mm_set_ps(0.0f,1.0f/255.0f,1.0f/255.0f,1.0f/255.0f));
+    factor = _mm_add_ps(factor,_mm_set_ps(1.0f,0.0f,0.0f,0.0f));
+    Pixel4 pixel = {_mm_mul_ps(value,factor)};
+    return pixel;
+}
+
+static inline Pixel4 pixel_madd(Pixel4 sum, Pixel4 pixel, float weight)
+{
+    sum.v = _mm_add_ps(sum.v,_mm_mul_ps(pixel.v,_mm_set1_ps(weight)));
+    return sum;
+}
+
+static inline Uint32 pixel_store(Pixel4 pixel)
+{
+    __m128 alpha = _mm_shuffle_ps(pixel.v,pixel.v,_MM_SHUFFLE(3,3,3,3));
+    alpha = _mm_min_ps(_mm_max_ps(alpha,_mm_setzero_ps()),_mm_set1_ps(255.0f));
+
+    //Undo the premultiply, fully transparent pixels come out black
+    __m128 visible = _mm_cmpgt_ps(alpha,_mm_set1_ps(0.5f));
+    __m128 factor = _mm_div_ps(_mm_set1_ps(255.0f),_mm_max_ps(alpha,_mm_set1_ps(1.0f)));
+    factor = _mm_and_ps(factor,visible);
+    __m128 rgb = _mm_mul_ps(pixel.v,factor);
+
+    __m128 alphaLane = _mm_castsi128_ps(_mm_set_epi32(-1,0,0,0));
+    __m128 result = _mm_or_ps(_mm_andnot_ps(alphaLane,rgb),_mm_and_ps(alphaLane,alpha));
+
+    __m128i wide = _mm_cvtps_epi32(result);
+    wide = _mm_packs_epi32(wide,wide);
+    wide = _mm_packus_epi16(wide,wide);
+    return _mm_cvtsi128_si32(wide);
+}
+
+#else
+
+struct Pixel4
+{
+    float v[4];
+};
+
+static inline Pixel4 pixel_zero()
+{
+    Pixel4 pixel = {{0.0f,0.0f,0.0f,0.0f}};
+    return pixel;
+}
+
+static inline Pixel4 pixel_load(Uint32 argb)
+{
+    Pixel4 pixel;
+    float alpha = (argb >> 24)/255.0f;
+    pixel.v[0] = (argb & 0xFF)*alpha;
+    pixel.v[1] = ((argb >> 8) & 0xFF)*alpha;
+    pixel.v[2] = ((argb >> 16) & 0xFF)*alpha;
+    pixel.v[3] = argb >> 24;
+    return pixel;
+}
+
+static inline Pixel4 pixel_madd(Pixel4 sum, Pixel4 pixel, float weight)
+{
+    for(int i = 0; i < 4; ++i)
+        sum.v[i] += pixel.v[i]*weight;
+    return sum;
+}
+
+static inline Uint8 clamp_channel(float value)
+{
+    return value <= 0.0f ? 0 : value >= 255.0f ? 255 : (Uint8)(value + 0.5f);
+}
+
+static inline Uint32 pixel_store(Pixel4 pixel)
+{
+    float alpha = pixel.v[3] < 0.0f ? 0.0f : pixel.v[3] > 255.0f ? 255.0f : pixel.v[3];
+    float factor = alpha > 0.5f ? 255.0f/(alpha > 1.0f ? alpha : 1.0f) : 0.0f;
+    return ((Uint32)clamp_channel(alpha) << 24) | (clamp_channel(pixel.v[2]*factor) << 16)
+         | (clamp_channel(pixel.v[1]*factor) << 8) | clamp_channel(pixel.v[0]*factor);
+}
+
+#endif
+
+//------------------ Filter  -------------------------
+
+static double lanczos3(double x)
+{
+    if(x == 0.0)
+        return 1.0;
+    if(x <= -3.0 || x >= 3.0)
+        return 0.0;
+    double px = M_PI*x;
+    return 3.0*sin(px)*sin(px/3.0)/(px*px);
+}
+
+//Source range and normalized weights for every destination pixel along one axis
+struct FilterTaps
+{
+    int maxTaps;
+    std::vector<int> start;
+    std::vector<int> count;
+    std::vector<float> weights;
+
+    FilterTaps(int sourceSize, int destinationSize)
+    {
+        double scale = (double)sourceSize/destinationSize;
+        double stretch = scale > 1.0 ? scale : 1.0;
+        double support = 3.0*stretch;
+
+        maxTaps = (int)ceil(support)*2 + 1;
+        start.resize(destinationSize);
+        count.resize(destinationSize);
+        weights.assign((size_t)destinationSize*maxTaps,0.0f);
+
+        for(int i = 0; i < destinationSize; ++i)
+        {
+            double center = (i + 0.5)*scale;
+            int left = (int)floor(center - support);
+            int right = (int)ceil(center + support);
+            if(left < 0)
+                left = 0;
+            if(right > sourceSize)
+                right = sourceSize;
+            if(right - left > maxTaps)
+                right = left + maxTaps;
+
+            float *w = &weights[(size_t)i*maxTaps];
+            double total = 0.0;
+            for(int j = left; j < right; ++j)
+            {
+                w[j-left] = lanczos3((j + 0.5 - center)/stretch);
+                total += w[j-left];
+            }
+            for(int j = left; j < right && total != 0.0; ++j)
+            {
+                w[j-left] /= total;
+            }
+            start[i] = left;
+            count[i] = right - left;
+        }
+    }
+};
+
+//Bands of rows per job, small enough to balance and large enough to amortize
+static const int RESAMPLE_BANDS = 64;
+
+struct ResampleJob
+{
+    SDL_Surface *source;
+    SDL_Surface *destination;
+    FilterTaps *horizontal;
+    FilterTaps *vertical;
+
+    //Source height x destination width, premultiplied
+    std::vector<Pixel4> columns;
+};
+
+//Filters every source row down to the destination width
+static void horizontal_band(void *data, int index)
+{
+    ResampleJob *job = (ResampleJob*)data;
+    const FilterTaps &taps = *job->horizontal;
+    int width = job->destination->w;
+    int rowStart = job->source->h*index/RESAMPLE_BANDS;
+    int rowEnd = job->source->h*(index+1)/RESAMPLE_BANDS;
+
+    for(int y = rowStart; y < rowEnd; ++y)
+    {
+        const Uint32 *row = (const Uint32*)((const Uint8*)job->source->pixels + y*job->source->pitch);
+        Pixel4 *out = &job->columns[(size_t)y*width];
+        for(int x = 0; x < width; ++x)
+        {
+            const float *w = &taps.weights[(size_t)x*taps.maxTaps];
+            const Uint32 *in = row + taps.start[x];
+            Pixel4 sum = pixel_zero();
+            for(int k = 0; k < taps.count[x]; ++k)
+            {
+                sum = pixel_madd(sum,pixel_load(in[k]),w[k]);
+            }
+            out[x] = sum;
+        }
+    }
+}
+
+//Filters the columns down to the destination height and packs the result
+static void vertical_band(void *data, int index)
+{
+    ResampleJob *job = (ResampleJob*)data;
+    const FilterTaps &taps = *job->vertical;
+    int width = job->destination->w;
+    int rowStart = job->destination->h*index/RESAMPLE_BANDS;
+    int rowEnd = job->destination->h*(index+1)/RESAMPLE_BANDS;
+    std::vector<Pixel4> sums(width);
+
+    for(int y = rowStart; y < rowEnd; ++y)
+    {
+        for(int x = 0; x < width; ++x)
+            sums[x] = pixel_zero();
+
+        const float *w = &taps.weights[(size_t)y*taps.maxTaps];
+        for(int k = 0; k < taps.count[y]; ++k)
+        {
+            const Pixel4 *in = &job->columns[(size_t)(taps.start[y] + k)*width];
+            for(int x = 0; x < width; ++x)
+            {
+                sums[x] = pixel_madd(sums[x],in[x],w[k]);
+            }
+        }
+
+        Uint32 *out = (Uint32*)((Uint8*)job->destination->pixels + y*job->destination->pitch);
+        for(int x = 0; x < width; ++x)
+        {
+            out[x] = pixel_store(sums[x]);
+        }
+    }
+}
+
+SDL_Surface *resample_surface(SDL_Surface *source, int width, int height)
+{
+    if(source == NULL || width <= 0 || height <= 0)
+        return NULL;
+
+    SDL_Surface *destination = SDL_CreateRGBSurfaceWithFormat(0,width,height,32,SDL_PIXELFORMAT_ARGB8888);
+    if(destination == NULL)
+        return NULL;
+
+    FilterTaps horizontal(source->w,width);
+    FilterTaps vertical(source->h,height);
+
+    ResampleJob job;
+    job.source = source;
+    job.destination = destination;
+    job.horizontal = &horizontal;
+    job.vertical = &vertical;
+    job.columns.resize((size_t)source->h*width);
+
+    SDL_LockSurface(source);
+    jobs_parallel_for(horizontal_band,&job,RESAMPLE_BANDS);
+    SDL_UnlockSurface(source);
+    jobs_parallel_for(vertical_band,&job,RESAMPLE_BANDS);
+
+    return destination;
+}
@@ -0,0 +1,15 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <SDL2/SDL.h>
+
+//Load-time image scaling, so photos are stored at the size they are drawn
+//instead of being shrunk by the renderer every frame.
+
+//Returns a new ARGB8888 surface of width x height filtered with Lanczos-3,
+//widened when shrinking so every source pixel contributes. Filtering is done
+//on premultiplied alpha, four channels at a time with SSE2 where available,
+//with the rows split across the job pool. source must be ARGB8888.
+SDL_Surface *resample_surface(SDL_Surface *source, int width, int height);
+
+#endif // RESAMPLE_H
@@ -0,0 +1,67 @@
+#include "resolution.h"
+
+//Scale moves along this ladder, one step at a time
+static const float SCALE_STEPS[] = {1.0f, 0.9f, 0.8f, 0.7f, 0.6f, 0.5f, 0.4f};
+static const int SCALE_STEP_COUNT = sizeof(SCALE_STEPS)/sizeof(SCALE_STEPS[0]);
+
+//Frames to wait after a change so the average reflects the new scale
+static const int COOLDOWN_FRAMES = 20;
+
+ResolutionController::ResolutionController()
+{
+    scale = 1.0f;
+    minScale = 0.5f;
+    targetMs = 1000.0f/60.0f;
+    averageMs = 0.0f;
+    enabled = true;
+    cooldown = 0;
+    primed = false;
+}
+
+void ResolutionController::frame(float ms)
+{
+    //A single hitch (a screen loading, a fractal pass) should not throw the scale to the floor
+    if(targetMs > 0.0f && ms > targetMs*2.0f)
+    {
+        ms = targetMs*2.0f;
+    }
+
+    if(!primed)
+    {
+        averageMs = ms;
+        primed = true;
+    }
+    averageMs = averageMs*0.9f + ms*0.1f;
+
+    if(!enabled || targetMs <= 0.0f)
+    {
+        return;
+    }
+    if(cooldown > 0)
+    {
+        cooldown--;
+        return;
+    }
+
+    int step = 0;
+    while(step+1 < SCALE_STEP_COUNT && SCALE_STEPS[step] > scale + 0.001f)
+    {
+        step++;
+    }
+
+    if(averageMs > targetMs*1.1f && step+1 < SCALE_STEP_COUNT && SCALE_STEPS[step+1] >= minScale - 0.001f)
+    {
+        scale = SCALE_STEPS[step+1];
+        cooldown = COOLDOWN_FRAMES;
+    }
+    else if(step > 0)
+    {
+        //Only step up if the predicted cost at the larger scale still fits with some headroom
+        float ratio = SCALE_STEPS[step-1]/scale;
+        if(averageMs*ratio*ratio < targetMs*0.85f)
+        {
+            scale = SCALE_STEPS[step-1];
+            cooldown = COOLDOWN_FRAMES;
+        }
+    }
+}
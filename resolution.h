@@ -0,0 +1,26 @@
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+
+//Picks the internal render scale from measured frame times. Frames are drawn
+//into a render target at scale*SCREEN_WIDTH x scale*SCREEN_HEIGHT and
+//stretched to the window, so fill cost goes with scale squared.
+class ResolutionController
+{
+    public:
+        float scale;
+        float minScale;
+        float targetMs;
+        float averageMs;
+        bool enabled;
+
+        ResolutionController();
+
+        //Feeds the time the last frame took to draw and present, may change scale
+        void frame(float ms);
+
+    private:
+        int cooldown;
+        bool primed;
+};
+
+#endif // RESOLUTION_H
@@ -0,0 +1,152 @@
+#include "snapshot.h"
+
+static const int FRESH = 4;
+static const int INDEX_MASK = 3;
+
+FrameSnapshot::FrameSnapshot()
+{
+    epoch = 0;
+    sequence = 0;
+    transitionClick = 0;
+    transitionPrewarmed = false;
+    scale = 1.0f;
+    commands.reserve(64);
+}
+
+void FrameSnapshot::clear()
+{
+    commands.clear();
+    transitionClick = 0;
+    transitionPrewarmed = false;
+}
+
+void FrameSnapshot::add(SDL_Texture *texture, const SDL_Rect *source, const SDL_Rect &destination)
+{
+    SDL_FRect exact;
+    exact.x = destination.x;
+    exact.y = destination.y;
+    exact.w = destination.w;
+    exact.h = destination.h;
+    add(texture,source,exact);
+}
+
+void FrameSnapshot::add(SDL_Texture *texture, const SDL_Rect *source, const SDL_FRect &destination)
+{
+    DrawCommand command;
+    command.texture = texture;
+    command.wholeTexture = source == NULL;
+    command.stream = NULL;
+    if(source != NULL)
+        command.source = *source;
+    command.destination = destination;
+    commands.push_back(command);
+}
+
+TripleBuffer::TripleBuffer()
+{
+    backIndex = 0;
+    SDL_AtomicSet(&middle,1);
+    frontIndex = 2;
+}
+
+FrameSnapshot *TripleBuffer::back()
+{
+    return &slots[backIndex];
+}
+
+void TripleBuffer::publish()
+{
+    //Everything written to the back slot must be visible before the reader can take it
+    SDL_MemoryBarrierRelease();
+    backIndex = SDL_AtomicSet(&middle,backIndex | FRESH) & INDEX_MASK;
+}
+
+FrameSnapshot *TripleBuffer::acquire()
+{
+    if(!(SDL_AtomicGet(&middle) & FRESH))
+    {
+        return NULL;
+    }
+    frontIndex = SDL_AtomicSet(&middle,frontIndex) & INDEX_MASK;
+    SDL_MemoryBarrierAcquire();
+    return &slots[frontIndex];
+}
+
+StreamingImage::StreamingImage(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    for(int i = 0; i < 3; ++i)
+    {
+        slots[i].assign((size_t)width*height,0);
+        written[i][0] = 0;
+        written[i][1] = 0;
+    }
+    backIndex = 0;
+    SDL_AtomicSet(&middle,1);
+    frontIndex = 2;
+}
+
+Uint32 *StreamingImage::back()
+{
+    return &slots[backIndex][0];
+}
+
+int StreamingImage::pitch()
+{
+    return width*4;
+}
+
+void StreamingImage::publish(int width, int height)
+{
+    written[backIndex][0] = width;
+    written[backIndex][1] = height;
+    SDL_MemoryBarrierRelease();
+    backIndex = SDL_AtomicSet(&middle,backIndex | FRESH) & INDEX_MASK;
+}
+
+const Uint32 *StreamingImage::acquire(int *width, int *height)
+{
+    if(!(SDL_AtomicGet(&middle) & FRESH))
+    {
+        return NULL;
+    }
+    frontIndex = SDL_AtomicSet(&middle,frontIndex) & INDEX_MASK;
+    SDL_MemoryBarrierAcquire();
+    *width = written[frontIndex][0];
+    *height = written[frontIndex][1];
+    return &slots[frontIndex][0];
+}
+
+EventQueue::EventQueue()
+{
+    SDL_AtomicSet(&head,0);
+    SDL_AtomicSet(&tail,0);
+}
+
+bool EventQueue::push(const SDL_Event &event)
+{
+    int t = SDL_AtomicGet(&tail);
+    int next = (t + 1) % CAPACITY;
+    if(next == SDL_AtomicGet(&head))
+    {
+        return false;
+    }
+    events[t] = event;
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&tail,next);
+    return true;
+}
+
+bool EventQueue::pop(SDL_Event *event)
+{
+    int h = SDL_AtomicGet(&head);
+    if(h == SDL_AtomicGet(&tail))
+    {
+        return false;
+    }
+    SDL_MemoryBarrierAcquire();
+    *event = events[h];
+    SDL_AtomicSet(&head,(h + 1) % CAPACITY);
+    return true;
+}
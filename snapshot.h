@@ -0,0 +1,119 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+
+//With --threaded the simulation thread records each frame as a list of
+//texture copies and hands it to the render thread, which owns the renderer.
+
+struct DrawCommand
+{
+    SDL_Texture *texture;
+    SDL_Rect source;
+
+    //Layout units, kept as floats so scrolling content can sit between pixels
+    SDL_FRect destination;
+    bool wholeTexture;
+
+    //Uploaded into texture before it is drawn, NULL for ordinary textures
+    class StreamingImage *stream;
+};
+
+//Everything the render thread needs to draw one frame
+class FrameSnapshot
+{
+    public:
+        std::vector<DrawCommand> commands;
+
+        //Renderer resources changed by a render call invalidate older snapshots
+        int epoch;
+        Uint32 sequence;
+
+        //Set on the first frame of a new screen to the time its button was clicked
+        Uint64 transitionClick;
+        bool transitionPrewarmed;
+
+        //Render scale the frame was computed for, it is drawn at the same one
+        float scale;
+
+        FrameSnapshot();
+
+        void clear();
+        void add(SDL_Texture *texture, const SDL_Rect *source, const SDL_Rect &destination);
+        void add(SDL_Texture *texture, const SDL_Rect *source, const SDL_FRect &destination);
+};
+
+//Three snapshots: the writer fills one, the reader draws one and the third
+//holds the newest finished frame. Handing one over is a single atomic
+//exchange, so neither side ever waits for the other.
+class TripleBuffer
+{
+    public:
+        TripleBuffer();
+
+        //Writer side
+        FrameSnapshot *back();
+        void publish();
+
+        //Reader side, returns NULL if nothing was published since the last call
+        FrameSnapshot *acquire();
+
+    private:
+        FrameSnapshot slots[3];
+        int backIndex;
+        int frontIndex;
+
+        //Index of the middle slot, with FRESH set when it holds an unread frame
+        SDL_atomic_t middle;
+};
+
+//Pixels a screen rewrites while it runs, for a streaming texture. The
+//update side fills its own buffer and publishes it, the render thread
+//uploads the newest one when it draws, so neither waits for the other.
+//The buffers are exchanged the same way as TripleBuffer's snapshots.
+class StreamingImage
+{
+    public:
+        StreamingImage(int width, int height);
+
+        //Writer side: a width x height buffer, pitch() bytes a row
+        Uint32 *back();
+        int pitch();
+
+        //Hands the back buffer over, with the part of it that was written
+        void publish(int width, int height);
+
+        //Reader side, returns NULL if nothing was published since the last call
+        const Uint32 *acquire(int *width, int *height);
+
+        int width;
+        int height;
+
+    private:
+        std::vector<Uint32> slots[3];
+        int written[3][2];
+        int backIndex;
+        int frontIndex;
+        SDL_atomic_t middle;
+};
+
+//Single producer single consumer queue of events from the render thread,
+//which has to pump SDL's event loop, to the simulation thread
+class EventQueue
+{
+    public:
+        EventQueue();
+
+        //Returns false and drops the event if the queue is full
+        bool push(const SDL_Event &event);
+        bool pop(SDL_Event *event);
+
+    private:
+        static const int CAPACITY = 256;
+        SDL_Event events[CAPACITY];
+        SDL_atomic_t head;
+        SDL_atomic_t tail;
+};
+
+#endif // SNAPSHOT_H
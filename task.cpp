@@ -0,0 +1,145 @@
+#include "task.h"
+#include <cstdlib>
+#include <vector>
+
+//Suspended tasks in the order they are resumed
+static std::vector<std::coroutine_handle<> > waiting;
+static unsigned int nextTask = 0;
+
+//Performance counter value the current slice ends at, 0 outside tasks_run()
+static Uint64 sliceEnd = 0;
+
+static void remove_waiting(std::coroutine_handle<> handle)
+{
+    for(unsigned int i = 0; i < waiting.size(); ++i)
+    {
+        if(waiting[i] == handle)
+        {
+            waiting.erase(waiting.begin() + i);
+            if(nextTask > i)
+                nextTask--;
+            return;
+        }
+    }
+}
+
+//------------------ Task  -------------------------
+
+Task Task::promise_type::get_return_object()
+{
+    std::coroutine_handle<promise_type> handle = std::coroutine_handle<promise_type>::from_promise(*this);
+    waiting.push_back(handle);
+    return Task(handle);
+}
+
+void Task::promise_type::unhandled_exception()
+{
+    abort();
+}
+
+Task::Task()
+{
+    handle = NULL;
+}
+
+Task::Task(std::coroutine_handle<promise_type> handle)
+{
+    this->handle = handle;
+}
+
+Task::Task(Task &&other)
+{
+    handle = other.handle;
+    other.handle = NULL;
+}
+
+Task &Task::operator=(Task &&other)
+{
+    if(this != &other)
+    {
+        cancel();
+        handle = other.handle;
+        other.handle = NULL;
+    }
+    return *this;
+}
+
+Task::~Task()
+{
+    cancel();
+}
+
+bool Task::done()
+{
+    return !handle || handle.done();
+}
+
+void Task::finish()
+{
+    if(done())
+        return;
+
+    Uint64 previous = sliceEnd;
+    sliceEnd = ~(Uint64)0;
+    while(!handle.done())
+    {
+        handle.resume();
+    }
+    sliceEnd = previous;
+    remove_waiting(handle);
+}
+
+void Task::cancel()
+{
+    if(!handle)
+        return;
+
+    remove_waiting(handle);
+    handle.destroy();
+    handle = NULL;
+}
+
+//------------------ Scheduler  -------------------------
+
+bool FrameSlice::await_ready()
+{
+    return SDL_GetPerformanceCounter() < sliceEnd;
+}
+
+FrameSlice frame_slice()
+{
+    return FrameSlice();
+}
+
+void tasks_run(float sliceMs)
+{
+    if(waiting.empty())
+        return;
+
+    sliceEnd = SDL_GetPerformanceCounter() + (Uint64)(sliceMs*SDL_GetPerformanceFrequency()/1000.0);
+
+    //A task only comes back once it finishes or spends the slice, so this
+    //usually resumes one or two. The next frame starts after the last one.
+    unsigned int count = waiting.size();
+    for(unsigned int i = 0; i < count && !waiting.empty(); ++i)
+    {
+        if(i > 0 && SDL_GetPerformanceCounter() >= sliceEnd)
+            break;
+
+        if(nextTask >= waiting.size())
+            nextTask = 0;
+        std::coroutine_handle<> handle = waiting[nextTask];
+        handle.resume();
+        if(handle.done())
+            remove_waiting(handle);
+        else
+            nextTask++;
+    }
+
+    sliceEnd = 0;
+}
+
+int tasks_pending()
+{
+    return waiting.size();
+}
@@ -0,0 +1,69 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <SDL2/SDL.h>
+#include <coroutine>
+
+//Cooperative tasks for work too long for one frame, written as C++20
+//coroutines. A function returning Task starts suspended, and tasks_run(),
+//called once a frame, resumes the waiting tasks in turn until the frame's
+//slice is spent. Between pieces of work a task does co_await frame_slice(),
+//which carries straight on while the slice has time left and otherwise
+//suspends until the next frame.
+//
+//Tasks are created, resumed and destroyed on the thread that runs the
+//screens' update(), or inside a render_call() it is waiting on, so the
+//scheduler needs no lock.
+
+class Task
+{
+    public:
+        struct promise_type
+        {
+            Task get_return_object();
+            std::suspend_always initial_suspend() noexcept {return std::suspend_always();};
+            std::suspend_always final_suspend() noexcept {return std::suspend_always();};
+            void return_void() {};
+            void unhandled_exception();
+        };
+
+        Task();
+        Task(Task &&other);
+        Task &operator=(Task &&other);
+        ~Task();
+
+        //True once the coroutine has returned, and for a Task that holds none
+        bool done();
+
+        //Runs whatever is left right away, ignoring the slice
+        void finish();
+
+        //Destroys the coroutine wherever it is suspended
+        void cancel();
+
+    private:
+        Task(std::coroutine_handle<promise_type> handle);
+        Task(const Task &other) = delete;
+        Task &operator=(const Task &other) = delete;
+
+        std::coroutine_handle<promise_type> handle;
+};
+
+//What frame_slice() returns, only suspends once the slice is spent
+struct FrameSlice
+{
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> handle) {};
+    void await_resume() {};
+};
+
+FrameSlice frame_slice();
+
+//Resumes waiting tasks until sliceMs have passed. The first one is always
+//resumed so every task moves on however small the slice.
+void tasks_run(float sliceMs);
+
+//Tasks that have not returned yet
+int tasks_pending();
+
+#endif // TASK_H